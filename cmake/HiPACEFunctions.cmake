@@ -227,5 +227,6 @@ function(hipace_print_summary)
     message("    MPI: ${HiPACE_MPI}")
     message("    OPENPMD: ${HiPACE_OPENPMD}")
     message("    PRECISION: ${HiPACE_PRECISION}")
+    message("    MIXED_PRECISION: ${HiPACE_MIXED_PRECISION}")
     message("")
 endfunction()
@@ -0,0 +1,83 @@
+#! /usr/bin/env python3
+
+# This Python analysis script is part of the code Hipace++
+#
+# It compares the fields and the particles of two simulations that should give the same result,
+# e.g. with and without an optional optimization, or on a different number of ranks.
+#
+# The fields are compared point by point, relative to the maximum of the reference field.
+# The particle quantities are sorted before the comparison, so that the particle order does not
+# matter. Invalid particles (negative id) are ignored.
+
+import numpy as np
+import argparse
+from openpmd_viewer import OpenPMDTimeSeries
+
+parser = argparse.ArgumentParser(description='Compare the output of two simulations')
+parser.add_argument('--ref-dir',
+                    dest='ref_dir',
+                    required=True,
+                    help='Path to the directory containing the reference output files')
+parser.add_argument('--output-dir',
+                    dest='output_dir',
+                    required=True,
+                    help='Path to the directory containing the output files to compare')
+parser.add_argument('--fields',
+                    dest='fields',
+                    nargs='*',
+                    default=['ExmBy', 'EypBx', 'Ez', 'Bx', 'By', 'Bz', 'jz'],
+                    help='Fields to compare')
+parser.add_argument('--species',
+                    dest='species',
+                    nargs='*',
+                    default=[],
+                    help='Particle species to compare')
+parser.add_argument('--rtol',
+                    dest='rtol',
+                    type=float,
+                    default=0.,
+                    help='Tolerance on the error, relative to the maximum of the reference')
+args = parser.parse_args()
+
+ts_ref = OpenPMDTimeSeries(args.ref_dir)
+ts = OpenPMDTimeSeries(args.output_dir)
+
+assert(np.array_equal(ts_ref.iterations, ts.iterations))
+
+def relative_error(F_ref, F):
+    """Maximum difference between F and F_ref, relative to the maximum of F_ref"""
+    assert(F_ref.shape == F.shape)
+    if F_ref.size == 0:
+        return 0.
+    scale = np.max(np.abs(F_ref))
+    error = np.max(np.abs(F - F_ref))
+    return error / scale if scale > 0. else error
+
+passed = True
+for iteration in ts_ref.iterations:
+    for field in args.fields:
+        F_ref = ts_ref.get_field(field=field, iteration=iteration)[0]
+        F = ts.get_field(field=field, iteration=iteration)[0]
+        error = relative_error(F_ref, F)
+        print("iteration " + str(iteration) + ", field " + field + ": relative error "
+              + str(error) + " (tolerance = " + str(args.rtol) + ")")
+        passed = passed and error <= args.rtol
+
+    for species in args.species:
+        var_list = ['id', 'x', 'y', 'z', 'ux', 'uy', 'uz', 'w']
+        data_ref = ts_ref.get_particle(species=species, iteration=iteration, var_list=var_list)
+        data = ts.get_particle(species=species, iteration=iteration, var_list=var_list)
+        valid_ref = data_ref[0] >= 0
+        valid = data[0] >= 0
+        print("iteration " + str(iteration) + ", species " + species + ": "
+              + str(np.sum(valid)) + " particles, reference " + str(np.sum(valid_ref)))
+        assert(np.sum(valid_ref) == np.sum(valid))
+        for var, p_ref, p in zip(var_list[1:], data_ref[1:], data[1:]):
+            p_ref = np.sort(p_ref[valid_ref])
+            p = np.sort(p[valid])
+            error = relative_error(p_ref, p)
+            print("iteration " + str(iteration) + ", species " + species + ", " + var
+                  + ": relative error " + str(error) + " (tolerance = " + str(args.rtol) + ")")
+            passed = passed and error <= args.rtol
+
+assert(passed)
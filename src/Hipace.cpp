@@ -13,6 +13,7 @@
 #endif
 
 #include <algorithm>
+#include <cmath>
 #include <memory>
 
 #ifdef AMREX_USE_MPI
@@ -97,6 +98,17 @@ Hipace::Hipace () :
     AMREX_ALWAYS_ASSERT_WITH_MESSAGE(m_numprocs_x*m_numprocs_y*m_numprocs_z
                                      == amrex::ParallelDescriptor::NProcs(),
                                      "Check hipace.numprocs_x and hipace.numprocs_y");
+    // Beam and plasma particles are not binned per transverse box, they only deposit to and
+    // gather from the first box of the slice. Only the fields are distributed.
+    AMREX_ALWAYS_ASSERT_WITH_MESSAGE(m_multi_beam.get_nbeams() == 0 ||
+                                     m_numprocs_x*m_numprocs_y == 1,
+        "Beams do not support transverse parallelization, use hipace.numprocs_x = numprocs_y = 1");
+    AMREX_ALWAYS_ASSERT_WITH_MESSAGE(m_multi_plasma.GetNPlasmas() == 0 ||
+                                     m_numprocs_x*m_numprocs_y == 1,
+        "Plasmas do not support transverse parallelization, use numprocs_x = numprocs_y = 1");
+    AMREX_ALWAYS_ASSERT_WITH_MESSAGE(m_fields.getDiagSliceDir() < 0 ||
+                                     m_numprocs_x*m_numprocs_y == 1,
+        "Transverse parallelization requires diagnostic.diag_type = xyz");
     pph.query("do_beam_jx_jy_deposition", m_do_beam_jx_jy_deposition);
     pph.query("do_device_synchronize", m_do_device_synchronize);
     pph.query("external_ExmBy_slope", m_external_ExmBy_slope);
@@ -115,7 +127,35 @@ Hipace::Hipace () :
     AMREX_ALWAYS_ASSERT_WITH_MESSAGE(
         !(m_explicit && !m_normalized_units),
         "The explicit solver doesn't work with SI yet. If you need it, please open an issue");
+    AMREX_ALWAYS_ASSERT_WITH_MESSAGE(
+        !(m_explicit && m_fields.SpectralGradient()),
+        "The explicit solver needs Psi, which is not computed with fields.spectral_gradient = 1");
+
+    if (maxLevel() > 0) {
+        AMREX_ALWAYS_ASSERT_WITH_MESSAGE(maxLevel() == 1,
+            "Only one refined patch is supported, amr.max_level must be 0 or 1");
+        AMREX_ALWAYS_ASSERT_WITH_MESSAGE(refRatio(0)[Direction::z] == 1,
+            "Mesh refinement is transverse only, please use amr.ref_ratio_vect = rx ry 1");
+        AMREX_ALWAYS_ASSERT_WITH_MESSAGE(m_numprocs_x*m_numprocs_y == 1,
+            "Mesh refinement does not support transverse parallelization");
+        amrex::Vector<amrex::Real> loc_array;
+        pph.getarr("patch_lo", loc_array);
+        AMREX_ALWAYS_ASSERT_WITH_MESSAGE(loc_array.size() == 2,
+            "hipace.patch_lo must contain the lower corner of the patch in x and y");
+        for (int idim = 0; idim < 2; ++idim) m_patch_lo[idim] = loc_array[idim];
+        pph.getarr("patch_hi", loc_array);
+        AMREX_ALWAYS_ASSERT_WITH_MESSAGE(loc_array.size() == 2,
+            "hipace.patch_hi must contain the upper corner of the patch in x and y");
+        for (int idim = 0; idim < 2; ++idim) m_patch_hi[idim] = loc_array[idim];
+    }
 
+    std::string explicit_linear_solver = "mlmg";
+    pph.query("explicit_linear_solver", explicit_linear_solver);
+    AMREX_ALWAYS_ASSERT_WITH_MESSAGE(
+        explicit_linear_solver == "mlmg" || explicit_linear_solver == "pcg",
+        "hipace.explicit_linear_solver must be mlmg or pcg");
+    if (explicit_linear_solver == "pcg") m_explicit_pcg = true;
+    pph.query("pcg_max_iterations", m_pcg_max_iterations);
     pph.query("MG_tolerance_rel", m_MG_tolerance_rel);
     pph.query("MG_tolerance_abs", m_MG_tolerance_abs);
 
@@ -203,6 +243,39 @@ Hipace::DefineSliceGDB (const amrex::BoxArray& ba, const amrex::DistributionMapp
         tmp_dom, tmp_probdom, Geom(lev).Coord(), Geom(lev).isPeriodic());
 }
 
+void
+Hipace::DefineFineSliceGDB ()
+{
+    constexpr int lev = 1;
+    const amrex::Geometry& crse_geom = Geom(lev-1);
+
+    // Snap the patch to the cells of level 0. The slice of the patch has the same longitudinal
+    // index as the slice of level 0.
+    amrex::Box crse_patch = m_slice_ba[0];
+    for (int idim = 0; idim < Direction::z; ++idim) {
+        const amrex::Real dx = crse_geom.CellSize(idim);
+        const amrex::Real plo = crse_geom.ProbLo(idim);
+        crse_patch.setSmall(idim, static_cast<int>(std::floor((m_patch_lo[idim] - plo)/dx)));
+        crse_patch.setBig(idim, static_cast<int>(std::ceil((m_patch_hi[idim] - plo)/dx)) - 1);
+    }
+    // The guard cells of the patch are interpolated from valid cells of level 0, away from the
+    // domain boundaries.
+    const int nguards_xy = std::max(1, m_depos_order_xy);
+    AMREX_ALWAYS_ASSERT_WITH_MESSAGE(
+        crse_patch.ok() &&
+        m_slice_ba[0].contains(amrex::grow(crse_patch, amrex::IntVect(nguards_xy+1, nguards_xy+1, 0))),
+        "The refined patch must not be empty and must be at least hipace.depos_order_xy+1 cells "
+        "away from the domain boundaries");
+
+    m_fine_slice_ba = amrex::BoxArray(amrex::refine(crse_patch, refRatio(lev-1)));
+    m_fine_slice_dm = amrex::DistributionMapping(amrex::Vector<int>{m_slice_dm[0]});
+    const amrex::RealBox patch_probdom{crse_patch, crse_geom.CellSize(), crse_geom.ProbLo()};
+    m_fine_slice_geom = amrex::Geometry(
+        m_fine_slice_ba[0], patch_probdom, crse_geom.Coord(), amrex::Array<int,3>{{0, 0, 0}});
+
+    m_fields.AllocSliceData(lev, m_fine_slice_ba, m_fine_slice_dm, m_fine_slice_geom);
+}
+
 bool
 Hipace::InSameTransverseCommunicator (int rank) const
 {
@@ -224,10 +297,13 @@ Hipace::InitData ()
     SetMaxGridSize(new_max_grid_size);
 
     AmrCore::InitFromScratch(0.0); // function argument is time
+    // The refined patch only exists on slices, it is not a level of AmrCore
+    if (maxLevel() > 0) DefineFineSliceGDB();
     constexpr int lev = 0;
     m_multi_beam.InitData(geom[0]);
     m_multi_plasma.InitData(lev, m_slice_ba, m_slice_dm, m_slice_geom, geom[0]);
-    m_adaptive_time_step.Calculate(m_dt, m_multi_beam, m_multi_plasma.maxDensity());
+    m_adaptive_time_step.Calculate(m_dt, m_multi_beam, m_multi_plasma.maxDensity(),
+                                   Geom(0).CellSize(Direction::z));
 #ifdef AMREX_USE_MPI
     m_adaptive_time_step.WaitTimeStep(m_dt, m_comm_z);
     m_adaptive_time_step.NotifyTimeStep(m_dt, m_comm_z);
@@ -320,17 +396,25 @@ Hipace::Evolve ()
 
     m_box_sorters.clear();
     m_multi_beam.sortParticlesByBox(m_box_sorters, boxArray(lev), geom[lev]);
+    // The beams generated per box have no particles yet in the boxes they will fill, which
+    // must not be skipped by the communications
+    if (HeadRank()) {
+        m_leftmost_box_snd = std::min(m_leftmost_box_snd,
+                                      m_multi_beam.LazyLeftmostBox(boxArray(lev)));
+    }
 
     // now each rank starts with its own time step and writes to its own file. Highest rank starts with step 0
     for (int step = m_numprocs_z - 1 - m_rank_z; step <= m_max_step; step += m_numprocs_z)
     {
 #ifdef HIPACE_USE_OPENPMD
-        m_openpmd_writer.InitDiagnostics(step, m_output_period, m_max_step);
+        m_openpmd_writer.InitDiagnostics(step, m_output_period, m_max_step, m_comm_xy);
 #endif
 
         if (m_verbose>=1) std::cout<<"Rank "<<rank<<" started  step "<<step<<" with dt = "<<m_dt<<'\n';
 
         ResetAllQuantities(lev);
+        m_fields.SetPsiForDiagnostics(m_output_period > 0 &&
+                                      (step == m_max_step || step % m_output_period == 0));
 
         /* Store charge density of (immobile) ions into WhichSlice::RhoIons */
         m_multi_plasma.DepositNeutralizingBackground(m_fields, WhichSlice::RhoIons, geom[lev], lev);
@@ -340,9 +424,22 @@ Hipace::Evolve ()
         {
             Wait(step, it);
 
-            m_box_sorters.clear();
+            // Beams generated per box get the particles of box it, and of box it-1 for the
+            // ghost particles, the first time the head rank reaches box it
+            if (step == 0) {
+                m_multi_beam.InitDataDownToBox(std::max(it-1, 0), boxArray(lev), geom[lev]);
+            }
 
-            m_multi_beam.sortParticlesByBox(m_box_sorters, boxArray(lev), geom[lev]);
+            // Invalid beam particles are deleted once per time step, before the first box
+            const bool remove_invalid = it == m_numprocs_z-1 && m_multi_beam.isCompactionStep(step);
+            // Since the previous sort, only the particles of box it+1 were pushed, and the
+            // particles of box it were received. The boxes below it-1 can be kept as they are,
+            // so that only the received particles and those that slipped into it-1 are sorted.
+            const int first_box = it < m_numprocs_z-1 ? std::max(it-1, 0) : 0;
+            const int num_beam_removed = m_multi_beam.sortParticlesByBox(
+                m_box_sorters, boxArray(lev), geom[lev], remove_invalid, first_box);
+            if (m_verbose>=2 && remove_invalid) amrex::AllPrint()<<"Rank "<<rank<<": removed "
+                                   << num_beam_removed << " invalid beam particles\n";
             m_leftmost_box_snd = std::min(leftmostBoxWithParticles(), m_leftmost_box_snd);
 
             WriteDiagnostics(step, it, OpenPMDWriterCallType::beams);
@@ -352,7 +449,8 @@ Hipace::Evolve ()
             // This handles both beam initialization and particle slippage.
             if (it>0) m_multi_beam.PackLocalGhostParticles(it-1, m_box_sorters);
 
-            const amrex::Box& bx = boxArray(lev)[it];
+            // Box it in z of this rank in the transverse plane
+            const amrex::Box& bx = boxArray(lev)[it*m_numprocs_x*m_numprocs_y + m_rank_xy];
             m_fields.ResizeFDiagFAB(bx, lev);
 
             amrex::Vector<BeamBins> bins;
@@ -375,11 +473,13 @@ Hipace::Evolve ()
             m_multi_beam.RemoveGhosts();
 
             m_adaptive_time_step.Calculate(m_dt, m_multi_beam, m_multi_plasma.maxDensity(),
-                                           it, m_box_sorters, false);
+                                           geom[lev].CellSize(Direction::z), it, m_box_sorters,
+                                           false);
 
             // averaging predictor corrector loop diagnostics
             m_predcorr_avg_iterations /= (bx.bigEnd(Direction::z) + 1 - bx.smallEnd(Direction::z));
             m_predcorr_avg_B_error /= (bx.bigEnd(Direction::z) + 1 - bx.smallEnd(Direction::z));
+            m_explicit_avg_iterations /= (bx.bigEnd(Direction::z) + 1 - bx.smallEnd(Direction::z));
 
             WriteDiagnostics(step, it, OpenPMDWriterCallType::fields);
 
@@ -390,8 +490,12 @@ Hipace::Evolve ()
         if (m_verbose>=2) amrex::AllPrint()<<"Rank "<<rank<<": avg. number of iterations "
                                    << m_predcorr_avg_iterations << " avg. transverse B field error "
                                    << m_predcorr_avg_B_error << "\n";
+        if (m_verbose>=2 && m_explicit && m_explicit_pcg) amrex::AllPrint()<<"Rank "<<rank
+                                   <<": avg. number of PCG iterations "
+                                   << m_explicit_avg_iterations << "\n";
         m_predcorr_avg_iterations = 0.;
         m_predcorr_avg_B_error = 0.;
+        m_explicit_avg_iterations = 0.;
 
         m_physical_time += m_dt;
     }
@@ -412,17 +516,9 @@ Hipace::SolveOneSlice (int islice, int lev, const int ibox,
 
     const amrex::Box& bx = boxArray(lev)[ibox];
 
-    if (m_explicit) {
-        // Set all quantities to 0 except Bx and By: the previous slice serves as initial guess.
-        const int ibx = Comps[WhichSlice::This]["Bx"];
-        const int iby = Comps[WhichSlice::This]["By"];
-        const int nc = Comps[WhichSlice::This]["N"];
-        AMREX_ALWAYS_ASSERT( iby == ibx+1 );
-        m_fields.getSlices(lev, WhichSlice::This).setVal(0., 0, ibx);
-        m_fields.getSlices(lev, WhichSlice::This).setVal(0., iby+1, nc-iby-1);
-    } else {
-        m_fields.getSlices(lev, WhichSlice::This).setVal(0.);
-    }
+    // With the explicit solver, Bx and By of the previous slice serve as initial guess, they are
+    // read from Previous1.
+    m_fields.getSlices(lev, WhichSlice::This).setVal(0.);
 
     if (!m_explicit) m_multi_plasma.AdvanceParticles(m_fields, geom[lev], false,
                                                      true, false, false, lev);
@@ -472,8 +568,7 @@ Hipace::SolveOneSlice (int islice, int lev, const int ibox,
 
     j_slice.FillBoundary(Geom(lev).periodicity());
 
-    m_fields.SolvePoissonEz(Geom(lev),lev);
-    m_fields.SolvePoissonBz(Geom(lev), lev);
+    m_fields.SolvePoissonEzAndBz(Geom(lev), lev);
 
     // Modifies Bx and By in the current slice and the force terms of the plasma particles
     if (m_explicit){
@@ -485,8 +580,13 @@ Hipace::SolveOneSlice (int islice, int lev, const int ibox,
         PredictorCorrectorLoopToSolveBxBy(islice, lev, bx, bins, ibox);
     }
 
-    // Push beam particles
-    m_multi_beam.AdvanceBeamParticlesSlice(m_fields, geom[lev], lev, islice, bx, bins, m_box_sorters, ibox);
+    if (maxLevel() > lev) SolveFineSlice(islice, bx, bins, ibox);
+
+    // Push beam particles, with the fields of the refined patch if they are in it
+    m_multi_beam.AdvanceBeamParticlesSlice(
+        m_fields, geom[lev], lev, islice, bx, bins, m_box_sorters, ibox,
+        m_adaptive_time_step.BetatronTimeStepCoeff(m_multi_plasma.maxDensity(),
+                                                   m_external_ExmBy_slope));
 
     m_fields.FillDiagnostics(lev, islice);
 
@@ -494,10 +594,41 @@ Hipace::SolveOneSlice (int islice, int lev, const int ibox,
 
     m_multi_plasma.DoFieldIonization(lev, geom[lev], m_fields);
 
+    const int num_plasma_removed = m_multi_plasma.RemoveInvalidParticles(lev);
+    if (m_verbose >= 3 && num_plasma_removed > 0) {
+        amrex::AllPrint()<<"Rank "<<amrex::ParallelDescriptor::MyProc()<<": islice "<<islice
+                         <<" removed "<<num_plasma_removed<<" invalid plasma particles\n";
+    }
+
+    m_multi_plasma.SortParticles(geom[lev], lev);
+
     // After this, the parallel context is the full 3D communicator again
     amrex::ParallelContext::pop();
 }
 
+void
+Hipace::SolveFineSlice (int islice, const amrex::Box& bx, amrex::Vector<BeamBins>& bins,
+                        const int ibox)
+{
+    HIPACE_PROFILE("Hipace::SolveFineSlice()");
+    constexpr int lev = 1;
+
+    m_fields.getSlices(lev, WhichSlice::This).setVal(0.);
+    m_fields.InterpolateFromCoarse(lev, refRatio(lev-1));
+
+    // Transversally, the beam deposits on the patch, in the index space of level 1
+    amrex::Box bx_fine = bx;
+    for (int idim = 0; idim < Direction::z; ++idim) {
+        bx_fine.setSmall(idim, m_fine_slice_ba[0].smallEnd(idim));
+        bx_fine.setBig(idim, m_fine_slice_ba[0].bigEnd(idim));
+    }
+    m_multi_beam.DepositCurrentSlice(m_fields, geom[lev], lev, islice, bx_fine, bins,
+                                     m_box_sorters, ibox, m_do_beam_jx_jy_deposition,
+                                     WhichSlice::This);
+
+    m_fields.SolveFineCorrection(m_fine_slice_geom, lev);
+}
+
 void
 Hipace::ResetAllQuantities (int lev)
 {
@@ -522,13 +653,10 @@ Hipace::ExplicitSolveBxBy (const int lev)
     amrex::MultiFab& nslicemf = m_fields.getSlices(lev, nsl);
     const int psl = WhichSlice::Previous1;
     amrex::MultiFab& pslicemf = m_fields.getSlices(lev, psl);
-    const amrex::BoxArray ba = slicemf.boxArray();
-    const amrex::DistributionMapping dm = slicemf.DistributionMap();
-    const amrex::IntVect ngv = slicemf.nGrowVect();
 
     // Later this should have only 1 component, but we have 2 for now, with always the same values.
-    amrex::MultiFab Mult(ba, dm, 2, ngv);
-    amrex::MultiFab S(ba, dm, 2, ngv);
+    amrex::MultiFab Mult = m_fields.getScratch(lev, "Mult", 2);
+    amrex::MultiFab S = m_fields.getScratch(lev, "S", 2);
     Mult.setVal(0.);
     S.setVal(0.);
 
@@ -648,13 +776,24 @@ Hipace::ExplicitSolveBxBy (const int lev)
             );
     }
 
-#ifdef AMREX_USE_LINEAR_SOLVERS
-    // For now, we construct the solver locally. Later, we want to move it to the hipace class as
-    // a member so that we can reuse it.
     amrex::Geometry slice_geom = m_slice_geom;
     slice_geom.setPeriodicity({0,0,0});
     amrex::MultiFab BxBy (slicemf, amrex::make_alias, Comps[isl]["Bx" ], 2);
 
+    // Warm start from the previous slice, which is strongly correlated with this one
+    amrex::MultiFab::Copy(BxBy, pslicemf, Comps[psl]["Bx"], 0, 2, 0);
+
+    if (m_explicit_pcg) {
+        m_explicit_avg_iterations += m_fields.SolveHelmholtzPCG(
+            BxBy, Mult, S, slice_geom, m_MG_tolerance_rel, m_MG_tolerance_abs,
+            m_pcg_max_iterations, lev);
+        amrex::ParallelContext::pop();
+        return;
+    }
+
+#ifdef AMREX_USE_LINEAR_SOLVERS
+    // For now, we construct the solver locally. Later, we want to move it to the hipace class as
+    // a member so that we can reuse it.
     if (!m_mlalaplacian){
         // If first call, initialize the MG solver
         amrex::LPInfo lpinfo{};
@@ -721,23 +860,13 @@ Hipace::PredictorCorrectorLoopToSolveBxBy (const int islice, const int lev, cons
     m_fields.getSlices(lev, WhichSlice::This).FillBoundary(Geom(lev).periodicity());
     amrex::ParallelContext::pop();
 
-    /* creating temporary Bx and By arrays for the current and previous iteration */
-    amrex::MultiFab Bx_iter(m_fields.getSlices(lev, WhichSlice::This).boxArray(),
-                            m_fields.getSlices(lev, WhichSlice::This).DistributionMap(), 1,
-                            m_fields.getSlices(lev, WhichSlice::This).nGrowVect());
-    amrex::MultiFab By_iter(m_fields.getSlices(lev, WhichSlice::This).boxArray(),
-                            m_fields.getSlices(lev, WhichSlice::This).DistributionMap(), 1,
-                            m_fields.getSlices(lev, WhichSlice::This).nGrowVect());
-    Bx_iter.setVal(0.0);
-    By_iter.setVal(0.0);
-    amrex::MultiFab Bx_prev_iter(m_fields.getSlices(lev, WhichSlice::This).boxArray(),
-                                 m_fields.getSlices(lev, WhichSlice::This).DistributionMap(), 1,
-                                 m_fields.getSlices(lev, WhichSlice::This).nGrowVect());
+    /* temporary Bx and By arrays for the current and previous iteration, from the workspace */
+    amrex::MultiFab Bx_iter = m_fields.getScratch(lev, "Bx_iter");
+    amrex::MultiFab By_iter = m_fields.getScratch(lev, "By_iter");
+    amrex::MultiFab Bx_prev_iter = m_fields.getScratch(lev, "Bx_prev_iter");
     amrex::MultiFab::Copy(Bx_prev_iter, m_fields.getSlices(lev, WhichSlice::This),
                           Comps[WhichSlice::This]["Bx"], 0, 1, 0);
-    amrex::MultiFab By_prev_iter(m_fields.getSlices(lev, WhichSlice::This).boxArray(),
-                                 m_fields.getSlices(lev, WhichSlice::This).DistributionMap(), 1,
-                                 m_fields.getSlices(lev, WhichSlice::This).nGrowVect());
+    amrex::MultiFab By_prev_iter = m_fields.getScratch(lev, "By_prev_iter");
     amrex::MultiFab::Copy(By_prev_iter, m_fields.getSlices(lev, WhichSlice::This),
                           Comps[WhichSlice::This]["By"], 0, 1, 0);
 
@@ -753,9 +882,6 @@ Hipace::PredictorCorrectorLoopToSolveBxBy (const int islice, const int lev, cons
                             amrex::make_alias, Comps[WhichSlice::Next]["jy_beam"], 1);
 
 
-    /* shift force terms, update force terms using guessed Bx and By */
-    m_multi_plasma.AdvanceParticles( m_fields, geom[lev], false, false, true, true, lev);
-
     /* Begin of predictor corrector loop  */
     int i_iter = 0;
     /* resetting the initial B-field error for mixing between iterations */
@@ -766,12 +892,10 @@ Hipace::PredictorCorrectorLoopToSolveBxBy (const int islice, const int lev, cons
         i_iter++;
         m_predcorr_avg_iterations += 1.0;
 
-        /* Push particles to the next slice */
-        m_multi_plasma.AdvanceParticles(m_fields, geom[lev], true, true, false, false, lev);
-
-        /* deposit current to next slice */
-        m_multi_plasma.DepositCurrent(
-            m_fields, WhichSlice::Next, true, true, false, false, false, geom[lev], lev);
+        /* In one pass over the plasma particles: update the force terms using the guessed or
+         * calculated Bx and By (shifting them first in the first iteration), push particles to
+         * the next slice and deposit their current there */
+        m_multi_plasma.PushAndDepositParticles(m_fields, geom[lev], true, i_iter == 1, lev);
 
         m_multi_beam.DepositCurrentSlice(m_fields, geom[lev], lev, islice, bx, bins, m_box_sorters,
                                          ibox, m_do_beam_jx_jy_deposition, WhichSlice::Next);
@@ -785,8 +909,7 @@ Hipace::PredictorCorrectorLoopToSolveBxBy (const int islice, const int lev, cons
         amrex::ParallelContext::pop();
 
         /* Calculate Bx and By */
-        m_fields.SolvePoissonBx(Bx_iter, Geom(lev), lev);
-        m_fields.SolvePoissonBy(By_iter, Geom(lev), lev);
+        m_fields.SolvePoissonBxAndBy(Bx_iter, By_iter, Geom(lev), lev);
 
         relative_Bfield_error = m_fields.ComputeRelBFieldError(
             m_fields.getSlices(lev, WhichSlice::This),
@@ -816,13 +939,14 @@ Hipace::PredictorCorrectorLoopToSolveBxBy (const int islice, const int lev, cons
         m_fields.getSlices(lev, WhichSlice::This).FillBoundary(Geom(lev).periodicity());
         amrex::ParallelContext::pop();
 
-        /* Update force terms using the calculated Bx and By */
-        m_multi_plasma.AdvanceParticles(m_fields, geom[lev], false, false, true, false, lev);
-
         /* Shift relative_Bfield_error values */
         relative_Bfield_error_prev_iter = relative_Bfield_error;
     } /* end of predictor corrector loop */
 
+    /* Update force terms using the calculated Bx and By. Without any iteration, the force terms
+     * have not been shifted yet */
+    m_multi_plasma.AdvanceParticles(m_fields, geom[lev], false, false, true, i_iter == 0, lev);
+
     /* resetting the particle position after they have been pushed to the next slice */
     m_multi_plasma.ResetParticles(lev);
 
@@ -889,8 +1013,10 @@ Hipace::Wait (const int step, int it, bool only_ghost)
     {
         const amrex::Long np_total = std::accumulate(np_rcv.begin(), np_rcv.begin()+nbeams, 0);
         if (np_total == 0) return;
-        const amrex::Long psize = sizeof(BeamParticleContainer::SuperParticleType);
-        const amrex::Long buffer_size = psize*np_total;
+        amrex::Long buffer_size = 0;
+        for (int ibeam = 0; ibeam < nbeams; ibeam++){
+            buffer_size += BeamParticleContainer::CommBufferSize(np_rcv[ibeam]);
+        }
         auto recv_buffer = (char*)amrex::The_Pinned_Arena()->alloc(buffer_size);
 
         MPI_Status status;
@@ -900,63 +1026,12 @@ Hipace::Wait (const int step, int it, bool only_ghost)
                  amrex::ParallelDescriptor::Mpi_typemap<char>::type(),
                  (m_rank_z+1)%m_numprocs_z, loc_pcomm_z_tag, m_comm_z, &status);
 
-        int offset_beam = 0;
+        // The particles of each beam are stored one attribute after the other
+        amrex::Long offset_beam = 0;
         for (int ibeam = 0; ibeam < nbeams; ibeam++){
-            auto& ptile = m_multi_beam.getBeam(ibeam);
             const int np = np_rcv[ibeam];
-            auto old_size = ptile.numParticles();
-            auto new_size = old_size + np;
-            ptile.resize(new_size);
-            const auto ptd = ptile.getParticleTileData();
-
-            const amrex::Gpu::DeviceVector<int> comm_real(m_multi_beam.NumRealComps(), 1);
-            const amrex::Gpu::DeviceVector<int> comm_int (m_multi_beam.NumIntComps(),  1);
-            const auto p_comm_real = comm_real.data();
-            const auto p_comm_int = comm_int.data();
-
-#ifdef AMREX_USE_GPU
-            if (amrex::Gpu::inLaunchRegion() && np > 0) {
-                int const np_per_block = 128;
-                int const nblocks = (np+np_per_block-1)/np_per_block;
-                std::size_t const shared_mem_bytes = np_per_block * psize;
-                // NOTE - TODO DPC++
-                amrex::launch(
-                    nblocks, np_per_block, shared_mem_bytes, amrex::Gpu::gpuStream(),
-                    [=] AMREX_GPU_DEVICE () noexcept
-                    {
-                        amrex::Gpu::SharedMemory<char> gsm;
-                        char* const shared = gsm.dataPtr();
-
-                        // Copy packed data from recv_buffer (in pinned memory) to shared memory
-                        const int i = blockDim.x*blockIdx.x+threadIdx.x;
-                        const unsigned int m = threadIdx.x;
-                        const unsigned int mend = amrex::min<unsigned int>
-                            (blockDim.x, np-blockDim.x*blockIdx.x);
-                        for (unsigned int index = m;
-                             index < mend*psize/sizeof(double); index += blockDim.x) {
-                            const double *csrc = (double *)
-                                (recv_buffer+offset_beam*psize+blockDim.x*blockIdx.x*psize);
-                            double *cdest = (double *)shared;
-                            cdest[index] = csrc[index];
-                        }
-
-                        __syncthreads();
-                        // Unpack in shared memory, and move to device memory
-                        if (i < np) {
-                            ptd.unpackParticleData(
-                                shared, m*psize, i+old_size, p_comm_real, p_comm_int);
-                        }
-                    });
-            } else
-#endif
-            {
-                for (int i = 0; i < np; ++i)
-                {
-                    ptd.unpackParticleData(
-                        recv_buffer+offset_beam*psize, i*psize, i+old_size, p_comm_real, p_comm_int);
-                }
-            }
-            offset_beam += np;
+            m_multi_beam.getBeam(ibeam).UnpackParticles(recv_buffer+offset_beam, np);
+            offset_beam += BeamParticleContainer::CommBufferSize(np);
         }
 
         amrex::Gpu::Device::synchronize();
@@ -1031,83 +1106,34 @@ Hipace::Notify (const int step, const int it,
     {
         const amrex::Long np_total = std::accumulate(np_snd.begin(), np_snd.begin()+nbeams, 0);
         if (np_total == 0) return;
-        const amrex::Long psize = sizeof(BeamParticleContainer::SuperParticleType);
-        const amrex::Long buffer_size = psize*np_total;
+        amrex::Long buffer_size = 0;
+        for (int ibeam = 0; ibeam < nbeams; ibeam++){
+            buffer_size += BeamParticleContainer::CommBufferSize(np_snd[ibeam]);
+        }
         char*& psend_buffer = only_ghost ? m_psend_buffer_ghost : m_psend_buffer;
         psend_buffer = (char*)amrex::The_Pinned_Arena()->alloc(buffer_size);
 
-        int offset_beam = 0;
+        amrex::Long offset_beam = 0;
         for (int ibeam = 0; ibeam < nbeams; ibeam++){
             const int offset_box = m_box_sorters[ibeam].boxOffsetsPtr()[it];
-            const amrex::Long np = np_snd[ibeam];
-
+            const int np = np_snd[ibeam];
             auto& ptile = m_multi_beam.getBeam(ibeam);
-            const auto ptd = ptile.getConstParticleTileData();
-
-            const amrex::Gpu::DeviceVector<int> comm_real(m_multi_beam.NumRealComps(), 1);
-            const amrex::Gpu::DeviceVector<int> comm_int (m_multi_beam.NumIntComps(),  1);
-            const auto p_comm_real = comm_real.data();
-            const auto p_comm_int = comm_int.data();
-            const auto p_psend_buffer = psend_buffer + offset_beam*psize;
-
-            BeamBins::index_type* indices = nullptr;
-            BeamBins::index_type const * offsets = 0;
-            BeamBins::index_type cell_start = 0;
-
-            indices = bins[ibeam].permutationPtr();
-            offsets = bins[ibeam].offsetsPtr();
 
             // The particles that are in the last slice (sent as ghost particles) are
             // given by the indices[cell_start:cell_stop-1]
-            cell_start = offsets[bx.bigEnd(Direction::z)-bx.smallEnd(Direction::z)];
-
-#ifdef AMREX_USE_GPU
-            if (amrex::Gpu::inLaunchRegion() && np > 0) {
-                const int np_per_block = 128;
-                const int nblocks = (np+np_per_block-1)/np_per_block;
-                const std::size_t shared_mem_bytes = np_per_block * psize;
-                // NOTE - TODO DPC++
-                amrex::launch(
-                    nblocks, np_per_block, shared_mem_bytes, amrex::Gpu::gpuStream(),
-                    [=] AMREX_GPU_DEVICE () noexcept
-                    {
-                        amrex::Gpu::SharedMemory<char> gsm;
-                        char* const shared = gsm.dataPtr();
-
-                        // Pack particles from device memory to shared memory
-                        const int i = blockDim.x*blockIdx.x+threadIdx.x;
-                        const unsigned int m = threadIdx.x;
-                        const unsigned int mend = amrex::min<unsigned int>(blockDim.x, np-blockDim.x*blockIdx.x);
-                        if (i < np) {
-                            const int src_i = only_ghost ? indices[cell_start+i] : i;
-                            ptd.packParticleData(shared, offset_box+src_i, m*psize, p_comm_real, p_comm_int);
-                        }
-
-                        __syncthreads();
-
-                        // Copy packed particles from shared memory to psend_buffer in pinned memory
-                        for (unsigned int index = m;
-                             index < mend*psize/sizeof(double); index += blockDim.x) {
-                            const double *csrc = (double *)shared;
-                            double *cdest = (double *)(p_psend_buffer+blockDim.x*blockIdx.x*psize);
-                            cdest[index] = csrc[index];
-                        }
-                    });
-            } else
-#endif
-            {
-                for (int i = 0; i < np; ++i)
-                {
-                    const int src_i = only_ghost ? indices[cell_start+i] : i;
-                    ptd.packParticleData(p_psend_buffer, offset_box+src_i, i*psize, p_comm_real, p_comm_int);
-                }
+            BeamBins::index_type const * indices = nullptr;
+            if (only_ghost) {
+                const BeamBins::index_type cell_start =
+                    bins[ibeam].offsetsPtr()[bx.bigEnd(Direction::z)-bx.smallEnd(Direction::z)];
+                indices = bins[ibeam].permutationPtr() + cell_start;
             }
+            ptile.PackParticles(psend_buffer+offset_beam, np, offset_box, indices);
             amrex::Gpu::Device::synchronize();
 
             // Delete beam particles that we just sent from the particle array
             if (!only_ghost) ptile.resize(offset_box);
-            offset_beam += np;
-        } // here
+            offset_beam += BeamParticleContainer::CommBufferSize(np);
+        }
 
         const int loc_pcomm_z_tag = only_ghost ? pcomm_z_tag_ghost : pcomm_z_tag;
         MPI_Request* loc_psend_request = only_ghost ? &m_psend_request_ghost : &m_psend_request;
@@ -1231,18 +1257,17 @@ Hipace::CheckGhostSlice (int it)
 
         // Get pointers to ghost particles
         auto& ptile = m_multi_beam.getBeam(ibeam);
-        auto& aos = ptile.GetArrayOfStructs();
-        const auto& pos_structs = aos.begin() + nreal;
+        auto& soa = ptile.GetStructOfArrays();
+        amrex::ParticleReal const * const zp = soa.GetRealData(BeamIdx::z).data() + nreal;
+        int * const idp = soa.GetIntData(BeamIdx::id).data() + nreal;
 
         // Invalidate particles out of the ghost slice
         amrex::ParallelFor(
             nghost,
             [=] AMREX_GPU_DEVICE (long idx) {
-                // Get zp of ghost particle
-                const amrex::Real zp = pos_structs[idx].pos(2);
                 // Invalidate ghost particle if not in the ghost slice
-                if ( zp < zmin_leftcell || zp > zmax_leftcell ) {
-                    pos_structs[idx].id() = -1;
+                if ( zp[idx] < zmin_leftcell || zp[idx] > zmax_leftcell ) {
+                    idp[idx] = -1;
                 }
             }
             );
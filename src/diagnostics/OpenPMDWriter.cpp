@@ -19,9 +19,11 @@ OpenPMDWriter::OpenPMDWriter ()
 }
 
 void
-OpenPMDWriter::InitDiagnostics (const int output_step, const int output_period, const int max_step)
+OpenPMDWriter::InitDiagnostics (const int output_step, const int output_period, const int max_step,
+                                MPI_Comm comm_xy)
 {
     HIPACE_PROFILE("OpenPMDWriter::InitDiagnostics()");
+    amrex::ignore_unused(comm_xy);
 
     // Dump every m_output_period steps and after last step
     if (output_period < 0 ||
@@ -29,6 +31,21 @@ OpenPMDWriter::InitDiagnostics (const int output_step, const int output_period,
 
     std::string filename = m_file_prefix + "/openpmd_%06T.h5"; // bp or h5
 
+#ifdef AMREX_USE_MPI
+    // With transverse parallelization, each rank of the slice writes its part of the fields
+    int nprocs_xy = 1;
+    MPI_Comm_size(comm_xy, &nprocs_xy);
+    if (nprocs_xy > 1) {
+#if openPMD_HAVE_MPI
+        m_outputSeries = std::make_unique< openPMD::Series >(
+            filename, openPMD::Access::CREATE, comm_xy);
+        return;
+#else
+        amrex::Abort("Output with transverse parallelization requires openPMD-api with MPI");
+#endif
+    }
+#endif
+
     m_outputSeries = std::make_unique< openPMD::Series >(
         filename, openPMD::Access::CREATE);
 
@@ -171,35 +188,31 @@ OpenPMDWriter::WriteBeamParticleData (MultiBeam& beams, openPMD::Iteration itera
             continue;
         }
 
-        // get position and particle ID from aos
-        // note: this implementation iterates the AoS 4x...
-        // if we flush late as we do now, we can also copy out the data in one go
-        const auto& aos = beam.GetArrayOfStructs();  // size =  numParticlesOnTile
-        const auto& pos_structs = aos.begin() + box_offset;
+        // get position and particle ID from soa
+        auto const& soa = beam.GetStructOfArrays();
         {
             // Save positions
             std::vector< std::string > const positionComponents{"x", "y", "z"};
+            const amrex::GpuArray<int, AMREX_SPACEDIM> position_idx{BeamIdx::x, BeamIdx::y,
+                                                                    BeamIdx::z};
 
             for (auto currDim = 0; currDim < AMREX_SPACEDIM; currDim++)
             {
-                std::shared_ptr< amrex::ParticleReal > curr(
-                    new amrex::ParticleReal[numParticleOnTile],
-                    [](amrex::ParticleReal const *p){ delete[] p; } );
-
-                for (uint64_t i=0; i<numParticleOnTile; i++) {
-                    curr.get()[i] = pos_structs[i].pos(currDim);
-                }
                 std::string const positionComponent = positionComponents[currDim];
-                beam_species["position"][positionComponent].storeChunk(curr, {m_offset[ibeam]},
-                                                                       {numParticleOnTile64});
+                beam_species["position"][positionComponent].storeChunk(
+                    openPMD::shareRaw(soa.GetRealData(position_idx[currDim]).data()+box_offset),
+                    {m_offset[ibeam]}, {numParticleOnTile64});
             }
 
-            // save particle ID after converting it to a globally unique ID
+            // save particle ID after converting it to a globally unique ID.
+            // All beam particles are created on the head rank.
             std::shared_ptr< uint64_t > ids( new uint64_t[numParticleOnTile],
                                              [](uint64_t const *p){ delete[] p; } );
 
+            const int* idp = soa.GetIntData(BeamIdx::id).data() + box_offset;
+            const int cpu = amrex::ParallelDescriptor::NProcs()-1;
             for (uint64_t i=0; i<numParticleOnTile; i++) {
-                ids.get()[i] = utils::localIDtoGlobal( aos[i].id(), aos[i].cpu() );
+                ids.get()[i] = utils::localIDtoGlobal( idp[i], cpu );
             }
             auto const scalar = openPMD::RecordComponent::SCALAR;
             beam_species["id"][scalar].storeChunk(ids, {m_offset[ibeam]}, {numParticleOnTile64});
@@ -1,17 +1,38 @@
 #include "Fields.H"
 #include "fft_poisson_solver/FFTPoissonSolverPeriodic.H"
 #include "fft_poisson_solver/FFTPoissonSolverDirichlet.H"
+#include "fft_poisson_solver/FFTPoissonSolverOpenBoundary.H"
 #include "Hipace.H"
 #include "utils/HipaceProfilerWrapper.H"
 #include "utils/Constants.H"
 
+#include <algorithm>
+#include <utility>
+
 Fields::Fields (Hipace const* a_hipace)
-    : m_F(a_hipace->maxLevel()+1),
+    : m_poisson_solver(a_hipace->maxLevel()+1),
+      m_F(a_hipace->maxLevel()+1),
       m_slices(a_hipace->maxLevel()+1),
+      m_scratch(a_hipace->maxLevel()+1),
       m_diags(a_hipace->maxLevel()+1)
 {
     amrex::ParmParse ppf("fields");
     ppf.query("do_dirichlet_poisson", m_do_dirichlet_poisson);
+    ppf.query("do_open_boundary_poisson", m_do_open_boundary_poisson);
+    ppf.query("spectral_gradient", m_spectral_gradient);
+    std::string planner = "estimate";
+    ppf.query("fft_planner", planner);
+    AMREX_ALWAYS_ASSERT_WITH_MESSAGE(
+        planner == "estimate" || planner == "measure" || planner == "patient",
+        "fields.fft_planner must be estimate, measure or patient");
+    if (planner == "measure") {
+        AnyFFT::SetPlanner(AnyFFT::planner::measure);
+    } else if (planner == "patient") {
+        AnyFFT::SetPlanner(AnyFFT::planner::patient);
+    } else {
+        AnyFFT::SetPlanner(AnyFFT::planner::estimate);
+    }
+    ppf.query("fft_wisdom_file", m_fft_wisdom_file);
 }
 
 void
@@ -32,6 +53,14 @@ Fields::AllocData (
     // Note: we pass ba[0] as a dummy box, it will be resized properly in the loop over boxes in Evolve
     m_diags.AllocData(lev, ba[0], Comps[WhichSlice::This]["N"], geom);
 
+    AllocSliceData(lev, slice_ba, slice_dm, geom);
+}
+
+void
+Fields::AllocSliceData (int lev, const amrex::BoxArray& slice_ba,
+                        const amrex::DistributionMapping& slice_dm, amrex::Geometry const& geom)
+{
+    HIPACE_PROFILE("Fields::AllocSliceData()");
     for (int islice=0; islice<WhichSlice::N; islice++) {
         m_slices[lev][islice].define(
             slice_ba, slice_dm, Comps[islice]["N"], m_slices_nguards,
@@ -39,20 +68,91 @@ Fields::AllocData (
         m_slices[lev][islice].setVal(0.0);
     }
 
+    // Only the scratch components used by the solvers of this run are allocated
+    Hipace const& hipace = Hipace::GetInstance();
+    int nscratch = ScratchComps["By_prev_iter"] + 1;
+    if (lev > 0) {
+        nscratch = ScratchComps["correction"] + 2;
+    } else if (hipace.m_explicit && hipace.m_explicit_pcg) {
+        nscratch = ScratchComps["N"];
+    } else if (hipace.m_explicit) {
+        nscratch = ScratchComps["S"] + 2;
+    }
+    m_scratch[lev].define(slice_ba, slice_dm, nscratch, m_slices_nguards,
+                          amrex::MFInfo().SetArena(amrex::The_Arena()));
+    // The guard cells outside of the domain must stay 0 for the PCG solver
+    m_scratch[lev].setVal(0.0);
+
+    if (Hipace::m_verbose >= 1) {
+        // The slices and the workspace are never reallocated, so this is their peak memory use
+        long npts = 0;
+        for (amrex::MFIter mfi(m_scratch[lev]); mfi.isValid(); ++mfi) {
+            npts += mfi.fabbox().numPts();
+        }
+        int nslice_comps = 0;
+        for (int islice=0; islice<WhichSlice::N; islice++) nslice_comps += Comps[islice]["N"];
+        long slice_bytes = npts * nslice_comps * sizeof(amrex::Real);
+        long scratch_bytes = npts * nscratch * sizeof(amrex::Real);
+        amrex::ParallelDescriptor::ReduceLongMax(slice_bytes);
+        amrex::ParallelDescriptor::ReduceLongMax(scratch_bytes);
+        amrex::Print() << "Level " << lev << ": slices use " << slice_bytes/1.e6
+                       << " MB and the scratch workspace " << scratch_bytes/1.e6
+                       << " MB per rank\n";
+    }
+
+    // FFTW wisdom depends on the transform sizes and on the precision, so one file is used
+    // per transverse grid size and precision.
+    std::string wisdom_file;
+    if (!m_fft_wisdom_file.empty()) {
+        const amrex::IntVect domain_size = geom.Domain().length();
+#ifdef AMREX_USE_FLOAT
+        const std::string precision = "single";
+#else
+        const std::string precision = "double";
+#endif
+        wisdom_file = m_fft_wisdom_file + "_" + std::to_string(domain_size[0]) + "x"
+            + std::to_string(domain_size[1]) + "_" + precision + ".wisdom";
+        AnyFFT::ImportWisdom(wisdom_file);
+    }
+
     // The Poisson solver operates on transverse slices only.
     // The constructor takes the BoxArray and the DistributionMap of a slice,
     // so the FFTPlans are built on a slice.
-    if (m_do_dirichlet_poisson){
-        m_poisson_solver = std::unique_ptr<FFTPoissonSolverDirichlet>(
+    // The refined levels only solve for a correction that vanishes on the patch boundary,
+    // see SolveFineCorrection, so they always use Dirichlet boundary conditions.
+    if (lev > 0) {
+        m_poisson_solver[lev] = std::unique_ptr<FFTPoissonSolverDirichlet>(
+            new FFTPoissonSolverDirichlet(getSlices(lev, WhichSlice::This).boxArray(),
+                                          getSlices(lev, WhichSlice::This).DistributionMap(),
+                                          geom));
+    } else if (m_do_open_boundary_poisson){
+        m_poisson_solver[lev] = std::unique_ptr<FFTPoissonSolverOpenBoundary>(
+            new FFTPoissonSolverOpenBoundary(getSlices(lev, WhichSlice::This).boxArray(),
+                                             getSlices(lev, WhichSlice::This).DistributionMap(),
+                                             geom));
+    } else if (m_do_dirichlet_poisson){
+        m_poisson_solver[lev] = std::unique_ptr<FFTPoissonSolverDirichlet>(
             new FFTPoissonSolverDirichlet(getSlices(lev, WhichSlice::This).boxArray(),
                                           getSlices(lev, WhichSlice::This).DistributionMap(),
                                           geom));
     } else {
-        m_poisson_solver = std::unique_ptr<FFTPoissonSolverPeriodic>(
+        m_poisson_solver[lev] = std::unique_ptr<FFTPoissonSolverPeriodic>(
             new FFTPoissonSolverPeriodic(getSlices(lev, WhichSlice::This).boxArray(),
                                          getSlices(lev, WhichSlice::This).DistributionMap(),
                                          geom));
     }
+
+    // Save the plans measured above, so the next run with the same grid can reuse them.
+    if (!wisdom_file.empty()) AnyFFT::ExportWisdom(wisdom_file);
+}
+
+amrex::MultiFab
+Fields::getScratch (int lev, const std::string& name, int ncomp)
+{
+    const int comp = ScratchComps[name];
+    AMREX_ALWAYS_ASSERT_WITH_MESSAGE(comp + ncomp <= m_scratch[lev].nComp(),
+                                     "Scratch component " + name + " is not allocated");
+    return amrex::MultiFab(m_scratch[lev], amrex::make_alias, comp, ncomp);
 }
 
 void
@@ -194,14 +294,21 @@ Fields::FillDiagnostics (int lev, int i_slice)
          m_diags.getF(lev), m_diags.sliceDir());
 }
 
+void
+Fields::SetPsiForDiagnostics (const bool is_output_step)
+{
+    const amrex::Vector<std::string>& comps = m_diags.getComps();
+    m_psi_for_diags = m_spectral_gradient && is_output_step &&
+        std::find(comps.begin(), comps.end(), "Psi") != comps.end();
+}
+
 void
 Fields::ShiftSlices (int lev)
 {
     HIPACE_PROFILE("Fields::ShiftSlices()");
-    amrex::MultiFab::Copy(
-        getSlices(lev, WhichSlice::Previous2), getSlices(lev, WhichSlice::Previous1),
-        Comps[WhichSlice::Previous1]["Bx"], Comps[WhichSlice::Previous2]["Bx"],
-        2, m_slices_nguards);
+    // Previous1 -> Previous2 only exchanges the MultiFab handles, the memory of Previous2 is
+    // then overwritten by This -> Previous1
+    std::swap(m_slices[lev][WhichSlice::Previous2], m_slices[lev][WhichSlice::Previous1]);
     amrex::MultiFab::Copy(
         getSlices(lev, WhichSlice::Previous1), getSlices(lev, WhichSlice::This),
         Comps[WhichSlice::This]["Bx"], Comps[WhichSlice::Previous1]["Bx"],
@@ -257,14 +364,33 @@ Fields::SolvePoissonExmByAndEypBx (amrex::Geometry const& geom, const MPI_Comm&
                         Comps[WhichSlice::This]["Psi"], 1);
 
     // calculating the right-hand side 1/episilon0 * -(rho-Jz/c)
-    amrex::MultiFab::Copy(m_poisson_solver->StagingArea(), getSlices(lev, WhichSlice::This),
+    auto set_rhs = [&] () {
+        amrex::MultiFab& staging_area = m_poisson_solver[lev]->StagingArea();
+        amrex::MultiFab::Copy(staging_area, getSlices(lev, WhichSlice::This),
                               Comps[WhichSlice::This]["jz"], 0, 1, 0);
-    m_poisson_solver->StagingArea().mult(-1./phys_const.c);
-    amrex::MultiFab::Add(m_poisson_solver->StagingArea(), getSlices(lev, WhichSlice::This),
-                          Comps[WhichSlice::This]["rho"], 0, 1, 0);
-    m_poisson_solver->StagingArea().mult(-1./phys_const.ep0);
+        staging_area.mult(-1./phys_const.c, 0, 1);
+        amrex::MultiFab::Add(staging_area, getSlices(lev, WhichSlice::This),
+                             Comps[WhichSlice::This]["rho"], 0, 1, 0);
+        staging_area.mult(-1./phys_const.ep0, 0, 1);
+    };
+    set_rhs();
+
+    if (m_spectral_gradient) {
+        // Compute ExmBy and EypBx from grad(-psi) in spectral space
+        amrex::MultiFab exmby(getSlices(lev, WhichSlice::This), amrex::make_alias,
+                              Comps[WhichSlice::This]["ExmBy"], 1);
+        amrex::MultiFab eypbx(getSlices(lev, WhichSlice::This), amrex::make_alias,
+                              Comps[WhichSlice::This]["EypBx"], 1);
+        m_poisson_solver[lev]->SolvePoissonEquationGradient(exmby, eypbx, -1.);
+        // Psi itself is only needed by the diagnostics. The solve consumed the staging area.
+        if (m_psi_for_diags) {
+            set_rhs();
+            m_poisson_solver[lev]->SolvePoissonEquation(lhs);
+        }
+        return;
+    }
 
-    m_poisson_solver->SolvePoissonEquation(lhs);
+    m_poisson_solver[lev]->SolvePoissonEquation(lhs);
 
     /* ---------- Transverse FillBoundary Psi ---------- */
     amrex::ParallelContext::push(m_comm_xy);
@@ -295,139 +421,226 @@ Fields::SolvePoissonExmByAndEypBx (amrex::Geometry const& geom, const MPI_Comm&
 
 
 void
-Fields::SolvePoissonEz (amrex::Geometry const& geom, const int lev)
+Fields::SolvePoissonEzAndBz (amrex::Geometry const& geom, const int lev)
 {
-    /* Solves Laplacian(Ez) =  1/(episilon0 *c0 )*(d_x(jx) + d_y(jy)) */
-    HIPACE_PROFILE("Fields::SolvePoissonEz()");
+    /* Solves Laplacian(Ez) =  1/(episilon0 *c0 )*(d_x(jx) + d_y(jy))
+     * and Laplacian(Bz) = mu_0*(d_y(jx) - d_x(jy)) in one batched Poisson solve */
+    HIPACE_PROFILE("Fields::SolvePoissonEzAndBz()");
 
     PhysConst phys_const = get_phys_const();
-    // Left-Hand Side for Poisson equation is Bz in the slice MF
-    amrex::MultiFab lhs(getSlices(lev, WhichSlice::This), amrex::make_alias,
-                        Comps[WhichSlice::This]["Ez"], 1);
+    // Left-Hand Side for Poisson equation is Ez and Bz in the slice MF
+    amrex::MultiFab lhs_ez(getSlices(lev, WhichSlice::This), amrex::make_alias,
+                           Comps[WhichSlice::This]["Ez"], 1);
+    amrex::MultiFab lhs_bz(getSlices(lev, WhichSlice::This), amrex::make_alias,
+                           Comps[WhichSlice::This]["Bz"], 1);
     // Right-Hand Side for Poisson equation: compute 1/(episilon0 *c0 )*(d_x(jx) + d_y(jy))
-    // from the slice MF, and store in the staging area of poisson_solver
+    // from the slice MF, and store in component 0 of the staging area of poisson_solver
     TransverseDerivative(
         getSlices(lev, WhichSlice::This),
-        m_poisson_solver->StagingArea(),
+        m_poisson_solver[lev]->StagingArea(),
         Direction::x,
         geom.CellSize(Direction::x),
         1./(phys_const.ep0*phys_const.c),
         SliceOperatorType::Assign,
-        Comps[WhichSlice::This]["jx"]);
+        Comps[WhichSlice::This]["jx"], 0);
 
     TransverseDerivative(
         getSlices(lev, WhichSlice::This),
-        m_poisson_solver->StagingArea(),
+        m_poisson_solver[lev]->StagingArea(),
         Direction::y,
         geom.CellSize(Direction::y),
         1./(phys_const.ep0*phys_const.c),
         SliceOperatorType::Add,
-        Comps[WhichSlice::This]["jy"]);
-    // Solve Poisson equation.
-    // The RHS is in the staging area of poisson_solver.
-    // The LHS will be returned as lhs.
-    m_poisson_solver->SolvePoissonEquation(lhs);
+        Comps[WhichSlice::This]["jy"], 0);
+
+    // Right-Hand Side for Poisson equation: compute mu_0*(d_y(jx) - d_x(jy))
+    // from the slice MF, and store in component 1 of the staging area of m_poisson_solver
+    TransverseDerivative(
+        getSlices(lev, WhichSlice::This),
+        m_poisson_solver[lev]->StagingArea(),
+        Direction::y,
+        geom.CellSize(Direction::y),
+        phys_const.mu0,
+        SliceOperatorType::Assign,
+        Comps[WhichSlice::This]["jx"], 1);
+
+    TransverseDerivative(
+        getSlices(lev, WhichSlice::This),
+        m_poisson_solver[lev]->StagingArea(),
+        Direction::x,
+        geom.CellSize(Direction::x),
+        -phys_const.mu0,
+        SliceOperatorType::Add,
+        Comps[WhichSlice::This]["jy"], 1);
+    // Solve both Poisson equations in one batch.
+    // The RHS are in the staging area of poisson_solver.
+    // The LHS will be returned as lhs_ez and lhs_bz.
+    m_poisson_solver[lev]->SolvePoissonEquationBatch({&lhs_ez, &lhs_bz});
 }
 
 void
-Fields::SolvePoissonBx (amrex::MultiFab& Bx_iter, amrex::Geometry const& geom, const int lev)
+Fields::SolvePoissonBxAndBy (amrex::MultiFab& Bx_iter, amrex::MultiFab& By_iter,
+                             amrex::Geometry const& geom, const int lev)
 {
-    /* Solves Laplacian(Bx) = mu_0*(- d_y(jz) + d_z(jy) ) */
-    HIPACE_PROFILE("Fields::SolvePoissonBx()");
+    /* Solves Laplacian(Bx) = mu_0*(- d_y(jz) + d_z(jy) )
+     * and Laplacian(By) = mu_0*(d_x(jz) - d_z(jx) ) in one batched Poisson solve */
+    HIPACE_PROFILE("Fields::SolvePoissonBxAndBy()");
 
     PhysConst phys_const = get_phys_const();
-    // Right-Hand Side for Poisson equation: compute -mu_0*d_y(jz) from the slice MF,
-    // and store in the staging area of poisson_solver
+    // Right-Hand Side for Poisson equation: compute -mu_0*d_y(jz) + mu_0*d_z(jy) from the
+    // slice MF, and store in component 0 of the staging area of poisson_solver
     TransverseDerivative(
         getSlices(lev, WhichSlice::This),
-        m_poisson_solver->StagingArea(),
+        m_poisson_solver[lev]->StagingArea(),
         Direction::y,
         geom.CellSize(Direction::y),
         -phys_const.mu0,
         SliceOperatorType::Assign,
-        Comps[WhichSlice::This]["jz"]);
+        Comps[WhichSlice::This]["jz"], 0);
 
     LongitudinalDerivative(
         getSlices(lev, WhichSlice::Previous1),
         getSlices(lev, WhichSlice::Next),
-        m_poisson_solver->StagingArea(),
+        m_poisson_solver[lev]->StagingArea(),
         geom.CellSize(Direction::z),
         phys_const.mu0,
         SliceOperatorType::Add,
         Comps[WhichSlice::Previous1]["jy"],
-        Comps[WhichSlice::Next]["jy"]);
-    // Solve Poisson equation.
-    // The RHS is in the staging area of poisson_solver.
-    // The LHS will be returned as lhs.
-    m_poisson_solver->SolvePoissonEquation(Bx_iter);
-}
+        Comps[WhichSlice::Next]["jy"], 0);
 
-void
-Fields::SolvePoissonBy (amrex::MultiFab& By_iter, amrex::Geometry const& geom, const int lev)
-{
-    /* Solves Laplacian(By) = mu_0*(d_x(jz) - d_z(jx) ) */
-    HIPACE_PROFILE("Fields::SolvePoissonBy()");
-
-    PhysConst phys_const = get_phys_const();
-    // Right-Hand Side for Poisson equation: compute mu_0*d_x(jz) from the slice MF,
-    // and store in the staging area of poisson_solver
+    // Right-Hand Side for Poisson equation: compute mu_0*d_x(jz) - mu_0*d_z(jx) from the
+    // slice MF, and store in component 1 of the staging area of poisson_solver
     TransverseDerivative(
         getSlices(lev, WhichSlice::This),
-        m_poisson_solver->StagingArea(),
+        m_poisson_solver[lev]->StagingArea(),
         Direction::x,
         geom.CellSize(Direction::x),
         phys_const.mu0,
         SliceOperatorType::Assign,
-        Comps[WhichSlice::This]["jz"]);
+        Comps[WhichSlice::This]["jz"], 1);
 
     LongitudinalDerivative(
         getSlices(lev, WhichSlice::Previous1),
         getSlices(lev, WhichSlice::Next),
-        m_poisson_solver->StagingArea(),
+        m_poisson_solver[lev]->StagingArea(),
         geom.CellSize(Direction::z),
         -phys_const.mu0,
         SliceOperatorType::Add,
         Comps[WhichSlice::Previous1]["jx"],
-        Comps[WhichSlice::Next]["jx"]);
-    // Solve Poisson equation.
-    // The RHS is in the staging area of poisson_solver.
-    // The LHS will be returned as lhs.
-    m_poisson_solver->SolvePoissonEquation(By_iter);
+        Comps[WhichSlice::Next]["jx"], 1);
+    // Solve both Poisson equations in one batch.
+    // The RHS are in the staging area of poisson_solver.
+    // The LHS will be returned as Bx_iter and By_iter.
+    m_poisson_solver[lev]->SolvePoissonEquationBatch({&Bx_iter, &By_iter});
 }
 
 void
-Fields::SolvePoissonBz (amrex::Geometry const& geom, const int lev)
+Fields::InterpolateFromCoarse (const int lev, const amrex::IntVect& ref_ratio)
 {
-    /* Solves Laplacian(Bz) = mu_0*(d_y(jx) - d_x(jy)) */
-    HIPACE_PROFILE("Fields::SolvePoissonBz()");
+    HIPACE_PROFILE("Fields::InterpolateFromCoarse()");
+    using namespace amrex::literals;
+
+    constexpr int ncomp = 9;
+    const std::array<std::string, ncomp> crse_names
+        {"ExmBy", "EypBx", "Ez", "Bx", "By", "Bz", "jx_beam", "jy_beam", "jz_beam"};
+    const std::array<std::string, ncomp> fine_names
+        {"ExmBy", "EypBx", "Ez", "Bx", "By", "Bz", "jx", "jy", "jz"};
+    amrex::GpuArray<int, ncomp> crse_comps;
+    amrex::GpuArray<int, ncomp> fine_comps;
+    for (int n = 0; n < ncomp; ++n) {
+        crse_comps[n] = Comps[WhichSlice::This][crse_names[n]];
+        fine_comps[n] = Comps[WhichSlice::This][fine_names[n]];
+    }
+
+    // There is only one box on each level, on the same rank.
+    const amrex::MultiFab& crse = getSlices(lev-1, WhichSlice::This);
+    amrex::MultiFab& fine = getSlices(lev, WhichSlice::This);
+    amrex::Array4<amrex::Real const> const crse_arr = crse[0].const_array();
+    const amrex::Real rx = ref_ratio[0];
+    const amrex::Real ry = ref_ratio[1];
+
+    for ( amrex::MFIter mfi(fine); mfi.isValid(); ++mfi ){
+        amrex::Array4<amrex::Real> const fine_arr = fine.array(mfi);
+        const int kc = amrex::lbound(crse_arr).z;
+        amrex::ParallelFor(
+            mfi.fabbox(),
+            [=] AMREX_GPU_DEVICE(int i, int j, int k) noexcept
+            {
+                // Position of the fine cell center, in units of coarse cells from the center
+                // of coarse cell 0
+                const amrex::Real xc = (i + 0.5_rt)/rx - 0.5_rt;
+                const amrex::Real yc = (j + 0.5_rt)/ry - 0.5_rt;
+                const int ic = static_cast<int>(std::floor(xc));
+                const int jc = static_cast<int>(std::floor(yc));
+                const amrex::Real wx = xc - ic;
+                const amrex::Real wy = yc - jc;
+                for (int n = 0; n < ncomp; ++n) {
+                    const int c = crse_comps[n];
+                    fine_arr(i,j,k,fine_comps[n]) =
+                        (1._rt-wx)*(1._rt-wy)*crse_arr(ic  , jc  , kc, c)
+                        +      wx *(1._rt-wy)*crse_arr(ic+1, jc  , kc, c)
+                        + (1._rt-wx)*     wy *crse_arr(ic  , jc+1, kc, c)
+                        +      wx *     wy *crse_arr(ic+1, jc+1, kc, c);
+                }
+            });
+    }
+}
+
+void
+Fields::SolveFineCorrection (amrex::Geometry const& geom, const int lev)
+{
+    /* The current slice of level lev holds the fields and the beam currents of level lev-1,
+     * interpolated in InterpolateFromCoarse, and the beam currents deposited on level lev.
+     * The correction solves Laplacian(dEz) = 1/(episilon0 *c0 )*(d_x(djx) + d_y(djy)),
+     * Laplacian(dBz) = mu_0*(d_y(djx) - d_x(djy)), Laplacian(dBx) = -mu_0*d_y(djz) and
+     * Laplacian(dBy) = mu_0*d_x(djz), where dj is the difference between the fine and the
+     * interpolated beam currents. */
+    HIPACE_PROFILE("Fields::SolveFineCorrection()");
 
     PhysConst phys_const = get_phys_const();
-    // Left-Hand Side for Poisson equation is Bz in the slice MF
-    amrex::MultiFab lhs(getSlices(lev, WhichSlice::This), amrex::make_alias,
-                        Comps[WhichSlice::This]["Bz"], 1);
-    // Right-Hand Side for Poisson equation: compute mu_0*(d_y(jx) - d_x(jy))
-    // from the slice MF, and store in the staging area of m_poisson_solver
-    TransverseDerivative(
-        getSlices(lev, WhichSlice::This),
-        m_poisson_solver->StagingArea(),
-        Direction::y,
-        geom.CellSize(Direction::y),
-        phys_const.mu0,
-        SliceOperatorType::Assign,
-        Comps[WhichSlice::This]["jx"]);
+    amrex::MultiFab& S = getSlices(lev, WhichSlice::This);
 
-    TransverseDerivative(
-        getSlices(lev, WhichSlice::This),
-        m_poisson_solver->StagingArea(),
-        Direction::x,
-        geom.CellSize(Direction::x),
-        -phys_const.mu0,
-        SliceOperatorType::Add,
-        Comps[WhichSlice::This]["jy"]);
-    // Solve Poisson equation.
-    // The RHS is in the staging area of m_poisson_solver.
-    // The LHS will be returned as lhs.
-    m_poisson_solver->SolvePoissonEquation(lhs);
+    // jx = jx_beam - interpolated jx_beam, same for jy and jz
+    for (const std::string name : {"jx", "jy", "jz"}) {
+        amrex::MultiFab::LinComb(
+            S, 1., S, Comps[WhichSlice::This][name+"_beam"], -1., S, Comps[WhichSlice::This][name],
+            Comps[WhichSlice::This][name], 1, m_slices_nguards);
+    }
+
+    // The correction vanishes on the patch boundary, so it is solved with zero Dirichlet
+    // boundary conditions and added to the interpolated fields.
+    amrex::MultiFab correction = getScratch(lev, "correction", 2);
+    amrex::MultiFab correction0(correction, amrex::make_alias, 0, 1);
+    amrex::MultiFab correction1(correction, amrex::make_alias, 1, 1);
+    amrex::MultiFab& staging = m_poisson_solver[lev]->StagingArea();
+
+    // Ez and Bz
+    TransverseDerivative(S, staging, Direction::x, geom.CellSize(Direction::x),
+                         1./(phys_const.ep0*phys_const.c), SliceOperatorType::Assign,
+                         Comps[WhichSlice::This]["jx"], 0);
+    TransverseDerivative(S, staging, Direction::y, geom.CellSize(Direction::y),
+                         1./(phys_const.ep0*phys_const.c), SliceOperatorType::Add,
+                         Comps[WhichSlice::This]["jy"], 0);
+    TransverseDerivative(S, staging, Direction::y, geom.CellSize(Direction::y),
+                         phys_const.mu0, SliceOperatorType::Assign,
+                         Comps[WhichSlice::This]["jx"], 1);
+    TransverseDerivative(S, staging, Direction::x, geom.CellSize(Direction::x),
+                         -phys_const.mu0, SliceOperatorType::Add,
+                         Comps[WhichSlice::This]["jy"], 1);
+    m_poisson_solver[lev]->SolvePoissonEquationBatch({&correction0, &correction1});
+    amrex::MultiFab::Add(S, correction, 0, Comps[WhichSlice::This]["Ez"], 1, 0);
+    amrex::MultiFab::Add(S, correction, 1, Comps[WhichSlice::This]["Bz"], 1, 0);
+
+    // Bx and By
+    TransverseDerivative(S, staging, Direction::y, geom.CellSize(Direction::y),
+                         -phys_const.mu0, SliceOperatorType::Assign,
+                         Comps[WhichSlice::This]["jz"], 0);
+    TransverseDerivative(S, staging, Direction::x, geom.CellSize(Direction::x),
+                         phys_const.mu0, SliceOperatorType::Assign,
+                         Comps[WhichSlice::This]["jz"], 1);
+    m_poisson_solver[lev]->SolvePoissonEquationBatch({&correction0, &correction1});
+    amrex::MultiFab::Add(S, correction, 0, Comps[WhichSlice::This]["Bx"], 1, 0);
+    amrex::MultiFab::Add(S, correction, 1, Comps[WhichSlice::This]["By"], 1, 0);
 }
 
 void
@@ -558,3 +771,120 @@ Fields::ComputeRelBFieldError (
 
     return relative_Bfield_error;
 }
+
+int
+Fields::SolveHelmholtzPCG (amrex::MultiFab& BxBy, const amrex::MultiFab& Mult,
+                           const amrex::MultiFab& S, const amrex::Geometry& geom,
+                           const amrex::Real tol_rel, const amrex::Real tol_abs,
+                           const int max_iters, const int lev)
+{
+    HIPACE_PROFILE("Fields::SolveHelmholtzPCG()");
+    using namespace amrex::literals;
+
+    AMREX_ALWAYS_ASSERT_WITH_MESSAGE(m_do_dirichlet_poisson && !m_do_open_boundary_poisson,
+        "The PCG solver uses the Dirichlet FFT Poisson solver as preconditioner, "
+        "fields.do_dirichlet_poisson must be 1");
+    constexpr int ncomp = 2;
+    AMREX_ALWAYS_ASSERT(FFTPoissonSolver::m_max_batch >= ncomp);
+
+    const amrex::Real dxi2 = 1._rt/(geom.CellSize(0)*geom.CellSize(0));
+    const amrex::Real dyi2 = 1._rt/(geom.CellSize(1)*geom.CellSize(1));
+    const amrex::Box& domain = geom.Domain();
+    const int ilo = domain.smallEnd(0);
+    const int ihi = domain.bigEnd(0);
+    const int jlo = domain.smallEnd(1);
+    const int jhi = domain.bigEnd(1);
+
+    // Residual, preconditioned residual, search direction (with guard cells for the stencil)
+    // and operator applied to the search direction.
+    amrex::MultiFab r = getScratch(lev, "pcg_r", ncomp);
+    amrex::MultiFab z = getScratch(lev, "pcg_z", ncomp);
+    amrex::MultiFab p = getScratch(lev, "pcg_p", ncomp);
+    amrex::MultiFab q = getScratch(lev, "pcg_q", ncomp);
+    amrex::MultiFab z0(z, amrex::make_alias, 0, 1);
+    amrex::MultiFab z1(z, amrex::make_alias, 1, 1);
+    amrex::MultiFab& staging = m_poisson_solver[lev]->StagingArea();
+
+    // q = (Mult - Laplacian) x for both components, with homogeneous Dirichlet boundary
+    // conditions on the domain faces as in MLMG: the value in the guard cell outside the domain is
+    // the opposite of that of the boundary cell. The FFT preconditioner puts the zero one cell
+    // further out, it only approximates the inverse of this operator.
+    auto apply_operator = [&] (amrex::MultiFab& x) {
+        x.FillBoundary(geom.periodicity());
+        for ( amrex::MFIter mfi(q, amrex::TilingIfNotGPU()); mfi.isValid(); ++mfi ){
+            amrex::Array4<amrex::Real const> const xarr = x.const_array(mfi);
+            amrex::Array4<amrex::Real const> const marr = Mult.const_array(mfi);
+            amrex::Array4<amrex::Real> const qarr = q.array(mfi);
+            amrex::ParallelFor(
+                mfi.tilebox(), ncomp,
+                [=] AMREX_GPU_DEVICE(int i, int j, int k, int n) noexcept
+                {
+                    const amrex::Real xc = xarr(i,j,k,n);
+                    const amrex::Real xl = i > ilo ? xarr(i-1,j,k,n) : -xc;
+                    const amrex::Real xh = i < ihi ? xarr(i+1,j,k,n) : -xc;
+                    const amrex::Real yl = j > jlo ? xarr(i,j-1,k,n) : -xc;
+                    const amrex::Real yh = j < jhi ? xarr(i,j+1,k,n) : -xc;
+                    qarr(i,j,k,n) = marr(i,j,k,n)*xc
+                        - (xh - 2._rt*xc + xl)*dxi2
+                        - (yh - 2._rt*xc + yl)*dyi2;
+                });
+        }
+    };
+
+    // z = (-Laplacian)^-1 r, i.e. Laplacian(z) = -r, for both components in one batch
+    auto apply_preconditioner = [&] () {
+        amrex::MultiFab::Copy(staging, r, 0, 0, ncomp, 0);
+        staging.mult(-1., 0, ncomp);
+        m_poisson_solver[lev]->SolvePoissonEquationBatch({&z0, &z1});
+    };
+
+    // r = -S - (Mult - Laplacian) x0
+    apply_operator(BxBy);
+    amrex::MultiFab::LinComb(r, -1., S, 0, -1., q, 0, 0, ncomp, 0);
+
+    // Stopping criterion of MLMG: the max norm of the residual over both components must be
+    // below tol_abs, or below tol_rel times the larger of the max norms of the right-hand side
+    // and of the initial residual
+    amrex::Real rhs_norm0 = 0._rt;
+    amrex::Real res_norm0 = 0._rt;
+    for (int n = 0; n < ncomp; ++n) {
+        rhs_norm0 = std::max(rhs_norm0, S.norm0(n));
+        res_norm0 = std::max(res_norm0, r.norm0(n));
+    }
+    const amrex::Real tol = std::max(tol_abs, tol_rel*std::max(rhs_norm0, res_norm0));
+    std::array<amrex::Real, ncomp> rz;
+    std::array<bool, ncomp> converged;
+    for (int n = 0; n < ncomp; ++n) converged[n] = r.norm0(n) <= tol;
+    if (converged[0] && converged[1]) return 0;
+
+    apply_preconditioner();
+    amrex::MultiFab::Copy(p, z, 0, 0, ncomp, 0);
+    for (int n = 0; n < ncomp; ++n) rz[n] = amrex::MultiFab::Dot(r, n, z, n, 1, 0);
+
+    int iter = 0;
+    while (iter < max_iters && !(converged[0] && converged[1])) {
+        ++iter;
+        apply_operator(p);
+        for (int n = 0; n < ncomp; ++n) {
+            if (converged[n]) continue;
+            const amrex::Real alpha = rz[n] / amrex::MultiFab::Dot(p, n, q, n, 1, 0);
+            amrex::MultiFab::Saxpy(BxBy, alpha, p, n, n, 1, 0);
+            amrex::MultiFab::Saxpy(r, -alpha, q, n, n, 1, 0);
+            converged[n] = r.norm0(n) <= tol;
+        }
+        if (converged[0] && converged[1]) break;
+
+        apply_preconditioner();
+        for (int n = 0; n < ncomp; ++n) {
+            if (converged[n]) continue;
+            const amrex::Real rz_new = amrex::MultiFab::Dot(r, n, z, n, 1, 0);
+            const amrex::Real beta = rz_new / rz[n];
+            rz[n] = rz_new;
+            // p = z + beta*p
+            amrex::MultiFab::Xpay(p, beta, z, n, n, 1, 0);
+        }
+    }
+
+    BxBy.FillBoundary(geom.periodicity());
+    return iter;
+}
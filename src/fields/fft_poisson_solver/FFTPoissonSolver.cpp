@@ -1,10 +1,51 @@
 #include "FFTPoissonSolver.H"
 
+#include <algorithm>
+
 FFTPoissonSolver::~FFTPoissonSolver ()
 {}
 
+void
+FFTPoissonSolver::SolvePoissonEquation (amrex::MultiFab& lhs_mf)
+{
+    SolvePoissonEquationBatch({&lhs_mf});
+}
+
 amrex::MultiFab&
 FFTPoissonSolver::StagingArea ()
 {
     return m_stagingArea;
 }
+
+void
+FFTPoissonSolver::MakeSlabBoxArrays (amrex::Box const& bx, const int nslabs,
+                                     amrex::BoxArray& xslab_ba, amrex::BoxArray& yslab_ba)
+{
+    AMREX_ALWAYS_ASSERT_WITH_MESSAGE(bx.length(0) >= nslabs && bx.length(1) >= nslabs,
+        "The number of transverse ranks must not exceed the number of cells in x and y");
+
+    amrex::BoxList xslab_bl, yslab_bl;
+    for (int islab = 0; islab < nslabs; ++islab) {
+        // Slab sizes differ by at most 1 cell
+        amrex::Box xslab = bx;
+        xslab.setSmall(1, bx.smallEnd(1) + (islab*bx.length(1))/nslabs);
+        xslab.setBig  (1, bx.smallEnd(1) + ((islab+1)*bx.length(1))/nslabs - 1);
+        xslab_bl.push_back(xslab);
+
+        amrex::Box yslab = bx;
+        yslab.setSmall(0, bx.smallEnd(0) + (islab*bx.length(0))/nslabs);
+        yslab.setBig  (0, bx.smallEnd(0) + ((islab+1)*bx.length(0))/nslabs - 1);
+        yslab_bl.push_back(yslab);
+    }
+    xslab_ba.define(std::move(xslab_bl));
+    yslab_ba.define(std::move(yslab_bl));
+}
+
+amrex::DistributionMapping
+FFTPoissonSolver::MakeSlabDistributionMapping (amrex::DistributionMapping const& dm)
+{
+    amrex::Vector<int> procmap = dm.ProcessorMap();
+    std::sort(procmap.begin(), procmap.end());
+    procmap.erase(std::unique(procmap.begin(), procmap.end()), procmap.end());
+    return amrex::DistributionMapping(std::move(procmap));
+}
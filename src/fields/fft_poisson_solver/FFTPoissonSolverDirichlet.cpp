@@ -18,27 +18,41 @@ FFTPoissonSolverDirichlet::define ( amrex::BoxArray const& realspace_ba,
     using namespace amrex::literals;
 
     HIPACE_PROFILE("FFTPoissonSolverDirichlet::define()");
-    // If we are going to support parallel FFT, the constructor needs to take a communicator.
-    AMREX_ALWAYS_ASSERT_WITH_MESSAGE(realspace_ba.size() == 1, "Parallel FFT not supported yet");
-
-    // Create the box array that corresponds to spectral space
-    amrex::BoxList spectral_bl; // Create empty box list
-    // Loop over boxes and fill the box list
-    for (int i=0; i < realspace_ba.size(); i++ ) {
-        // For local FFTs, boxes in spectral space start at 0 in
-        // each direction and have the same number of points as the
-        // (cell-centered) real space box
-        // Define the corresponding box
-        amrex::Box spectral_bx = amrex::Box( amrex::IntVect::TheZeroVector(),
-                          realspace_ba[i].length() - amrex::IntVect::TheUnitVector() );
-        spectral_bl.push_back( spectral_bx );
+
+    m_is_distributed = realspace_ba.size() > 1;
+    m_dx = gm.CellSize(0);
+    m_dy = gm.CellSize(1);
+
+    amrex::DistributionMapping spectral_dm = dm;
+    if (m_is_distributed) {
+        // Slab decomposition: the 1D DSTs along x are done on x-slabs, those along y on y-slabs.
+        // The spectral data lives on the y-slabs, in the index space of the real-space domain.
+        spectral_dm = MakeSlabDistributionMapping(dm);
+        amrex::BoxArray xslab_ba;
+        MakeSlabBoxArrays(realspace_ba.minimalBox(), spectral_dm.size(),
+                          xslab_ba, m_spectralspace_ba);
+        m_xslab = amrex::MultiFab(xslab_ba, spectral_dm, m_max_batch, 0);
+        m_xslab.setVal(0.0);
+    } else {
+        // Create the box array that corresponds to spectral space
+        amrex::BoxList spectral_bl; // Create empty box list
+        // Loop over boxes and fill the box list
+        for (int i=0; i < realspace_ba.size(); i++ ) {
+            // For local FFTs, boxes in spectral space start at 0 in
+            // each direction and have the same number of points as the
+            // (cell-centered) real space box
+            // Define the corresponding box
+            amrex::Box spectral_bx = amrex::Box( amrex::IntVect::TheZeroVector(),
+                              realspace_ba[i].length() - amrex::IntVect::TheUnitVector() );
+            spectral_bl.push_back( spectral_bx );
+        }
+        m_spectralspace_ba.define( std::move(spectral_bl) );
     }
-    m_spectralspace_ba.define( std::move(spectral_bl) );
 
     // Allocate temporary arrays - in real space and spectral space
     // These arrays will store the data just before/after the FFT
-    m_stagingArea = amrex::MultiFab(realspace_ba, dm, 1, 0);
-    m_tmpSpectralField = amrex::MultiFab(m_spectralspace_ba, dm, 1, 0);
+    m_stagingArea = amrex::MultiFab(realspace_ba, dm, m_max_batch, 0);
+    m_tmpSpectralField = amrex::MultiFab(m_spectralspace_ba, spectral_dm, m_max_batch, 0);
     m_stagingArea.setVal(0.0); // this is not required
     m_tmpSpectralField.setVal(0.0);
 
@@ -58,19 +72,25 @@ FFTPoissonSolverDirichlet::define ( amrex::BoxArray const& realspace_ba,
     // This normalization is used regardless of the sine transform library
     const amrex::Real norm_fac = 0.5 / ( 2 * (( gm.Domain().length(0) + 1 ) * ( gm.Domain().length(1) + 1 )));
 
-    m_eigenvalue_matrix = amrex::MultiFab(m_spectralspace_ba, dm, 1, 0);
+    m_eigenvalue_matrix = amrex::MultiFab(m_spectralspace_ba, spectral_dm, 1, 0);
+    // Lower corner of the spectral domain: 0 for serial FFT, domain lower corner otherwise
+    const amrex::IntVect spectral_lo = m_spectralspace_ba.minimalBox().smallEnd();
+    const int ilo = spectral_lo[0];
+    const int jlo = spectral_lo[1];
 
     // Calculate the array of m_eigenvalue_matrix
     for (amrex::MFIter mfi(m_eigenvalue_matrix); mfi.isValid(); ++mfi ){
         amrex::Array4<amrex::Real> eigenvalue_matrix = m_eigenvalue_matrix.array(mfi);
-        amrex::Box const& bx = mfi.validbox();  // The lower corner of the "2D" slice Box is zero.
+        amrex::Box const& bx = mfi.validbox();
         amrex::ParallelFor(
             bx, [=] AMREX_GPU_DEVICE (int i, int j, int /* k */) noexcept
                 {
                     /* fast poisson solver diagonal x coeffs */
-                    amrex::Real sinex_sq = sin(( i + 1 ) * sine_x_factor) * sin(( i + 1 ) * sine_x_factor);
+                    amrex::Real sinex_sq = sin(( i - ilo + 1 ) * sine_x_factor)
+                                         * sin(( i - ilo + 1 ) * sine_x_factor);
                     /* fast poisson solver diagonal y coeffs */
-                    amrex::Real siney_sq = sin(( j + 1 ) * sine_y_factor) * sin(( j + 1 ) * sine_y_factor);
+                    amrex::Real siney_sq = sin(( j - jlo + 1 ) * sine_y_factor)
+                                         * sin(( j - jlo + 1 ) * sine_y_factor);
 
                     if ((sinex_sq!=0) && (siney_sq!=0)) {
                         eigenvalue_matrix(i,j,0) = norm_fac / ( -4.0 * ( sinex_sq / dxsquared + siney_sq / dysquared ));
@@ -81,57 +101,261 @@ FFTPoissonSolverDirichlet::define ( amrex::BoxArray const& realspace_ba,
                 });
     }
 
-    // Allocate and initialize the FFT plans
-    m_forward_plan = AnyDST::DSTplans(m_spectralspace_ba, dm);
-    m_backward_plan = AnyDST::DSTplans(m_spectralspace_ba, dm);
-    // Loop over boxes and allocate the corresponding plan
-    // for each box owned by the local MPI proc
+    if (m_is_distributed) {
+        // In-place batched 1D DSTs. DST-I is its own inverse (up to normalization),
+        // so the same plans are used for the forward and the backward transforms.
+        // Along x, all components are transformed in one batch (one plan per batch size).
+        for (int nbatch = 1; nbatch <= m_max_batch; ++nbatch) {
+            m_xslab_plan[nbatch-1] = AnyDST::DSTplans(m_xslab.boxArray(), spectral_dm);
+            for ( amrex::MFIter mfi(m_xslab); mfi.isValid(); ++mfi ){
+                // Rows along x are contiguous in memory (AMReX FABs are Fortran-order),
+                // and so are the components
+                const amrex::IntVect n = mfi.validbox().length();
+                m_xslab_plan[nbatch-1][mfi] = AnyDST::CreatePlanMany1D(
+                    n[0], n[1]*nbatch, 1, n[0], &m_xslab[mfi], &m_xslab[mfi]);
+            }
+        }
+        // Along y, all components are transformed with one plan (one plan per batch size)
+        for (int nbatch = 1; nbatch <= m_max_batch; ++nbatch) {
+            m_yslab_plan[nbatch-1] = AnyDST::DSTplans(m_spectralspace_ba, spectral_dm);
+            for ( amrex::MFIter mfi(m_tmpSpectralField); mfi.isValid(); ++mfi ){
+                // Columns along y have a stride of the local number of cells in x
+                const amrex::IntVect n = mfi.validbox().length();
+                m_yslab_plan[nbatch-1][mfi] = AnyDST::CreatePlanMany1D(
+                    n[1], n[0], n[0], 1, &m_tmpSpectralField[mfi], &m_tmpSpectralField[mfi],
+                    0, AnyDST::kind::sine, nbatch);
+            }
+        }
+        // Plans for the backward transform of the gradient
+        m_xslab_gradient_plan[0] = AnyDST::DSTplans(m_xslab.boxArray(), spectral_dm);
+        m_xslab_gradient_plan[1] = AnyDST::DSTplans(m_xslab.boxArray(), spectral_dm);
+        for ( amrex::MFIter mfi(m_xslab); mfi.isValid(); ++mfi ){
+            const amrex::IntVect n = mfi.validbox().length();
+            m_xslab_gradient_plan[0][mfi] = AnyDST::CreatePlanMany1D(
+                n[0], n[1], 1, n[0], &m_xslab[mfi], &m_xslab[mfi], 0, AnyDST::kind::cosine);
+            m_xslab_gradient_plan[1][mfi] = AnyDST::CreatePlanMany1D(
+                n[0], n[1], 1, n[0], &m_xslab[mfi], &m_xslab[mfi], 1, AnyDST::kind::sine);
+        }
+        m_yslab_cosine_plan = AnyDST::DSTplans(m_spectralspace_ba, spectral_dm);
+        for ( amrex::MFIter mfi(m_tmpSpectralField); mfi.isValid(); ++mfi ){
+            const amrex::IntVect n = mfi.validbox().length();
+            m_yslab_cosine_plan[mfi] = AnyDST::CreatePlanMany1D(
+                n[1], n[0], n[0], 1, &m_tmpSpectralField[mfi], &m_tmpSpectralField[mfi],
+                1, AnyDST::kind::cosine);
+        }
+        return;
+    }
+
+    // Allocate and initialize the FFT plans, one per batch size
+    for (int nbatch = 1; nbatch <= m_max_batch; ++nbatch) {
+        m_forward_plan[nbatch-1] = AnyDST::DSTplans(m_spectralspace_ba, dm);
+        m_backward_plan[nbatch-1] = AnyDST::DSTplans(m_spectralspace_ba, dm);
+        // Loop over boxes and allocate the corresponding plan
+        // for each box owned by the local MPI proc
+        for ( amrex::MFIter mfi(m_stagingArea); mfi.isValid(); ++mfi ){
+            // Note: the size of the real-space box and spectral-space box
+            // differ when using real-to-complex FFT. When initializing
+            // the FFT plan, the valid dimensions are those of the real-space box.
+            amrex::IntVect fft_size = mfi.validbox().length();
+            m_forward_plan[nbatch-1][mfi] = AnyDST::CreatePlan(
+                fft_size, &m_stagingArea[mfi], &m_tmpSpectralField[mfi], nbatch);
+
+            m_backward_plan[nbatch-1][mfi] = AnyDST::CreatePlan(
+                fft_size, &m_tmpSpectralField[mfi], &m_stagingArea[mfi], nbatch);
+        }
+    }
+    m_gradient_plan = AnyDST::DSTplans(m_spectralspace_ba, dm);
     for ( amrex::MFIter mfi(m_stagingArea); mfi.isValid(); ++mfi ){
-        // Note: the size of the real-space box and spectral-space box
-        // differ when using real-to-complex FFT. When initializing
-        // the FFT plan, the valid dimensions are those of the real-space box.
-        amrex::IntVect fft_size = mfi.validbox().length();
-        m_forward_plan[mfi] = AnyDST::CreatePlan(
-            fft_size, &m_stagingArea[mfi], &m_tmpSpectralField[mfi]);
-
-        m_backward_plan[mfi] = AnyDST::CreatePlan(
-            fft_size, &m_tmpSpectralField[mfi], &m_stagingArea[mfi]);
+        m_gradient_plan[mfi] = AnyDST::CreateGradientPlan(
+            mfi.validbox().length(), &m_tmpSpectralField[mfi], &m_stagingArea[mfi]);
     }
 }
 
 
 void
-FFTPoissonSolverDirichlet::SolvePoissonEquation (amrex::MultiFab& lhs_mf)
+FFTPoissonSolverDirichlet::SolvePoissonEquationBatch (amrex::Vector<amrex::MultiFab*> const& lhs_mfs)
 {
-    HIPACE_PROFILE("FFTPoissonSolverDirichlet::SolvePoissonEquation()");
+    HIPACE_PROFILE("FFTPoissonSolverDirichlet::SolvePoissonEquationBatch()");
+
+    const int nbatch = lhs_mfs.size();
+    AMREX_ALWAYS_ASSERT_WITH_MESSAGE(nbatch >= 1 && nbatch <= m_max_batch,
+                                     "Number of Poisson equations solved at once out of range");
+
+    if (m_is_distributed) {
+        SolvePoissonEquationDistributed(lhs_mfs);
+        return;
+    }
 
     // Loop over boxes
     for ( amrex::MFIter mfi(m_stagingArea); mfi.isValid(); ++mfi ){
 
         // Perform Fourier transform from the staging area to `tmpSpectralField`
-        AnyDST::Execute(m_forward_plan[mfi]);
+        AnyDST::Execute(m_forward_plan[nbatch-1][mfi]);
 
         // Solve Poisson equation in Fourier space:
         // Multiply `tmpSpectralField` by eigenvalue_matrix
         amrex::Array4<amrex::Real> tmp_cmplx_arr = m_tmpSpectralField.array(mfi);
         amrex::Array4<amrex::Real> eigenvalue_matrix = m_eigenvalue_matrix.array(mfi);
 
-        amrex::ParallelFor( m_spectralspace_ba[mfi],
-            [=] AMREX_GPU_DEVICE(int i, int j, int k) noexcept {
-                tmp_cmplx_arr(i,j,k) *= eigenvalue_matrix(i,j,k);
+        amrex::ParallelFor( m_spectralspace_ba[mfi], nbatch,
+            [=] AMREX_GPU_DEVICE(int i, int j, int k, int n) noexcept {
+                tmp_cmplx_arr(i,j,k,n) *= eigenvalue_matrix(i,j,k);
             });
 
         // Perform Fourier transform from `tmpSpectralField` to the staging area
-        AnyDST::Execute(m_backward_plan[mfi]);
+        AnyDST::Execute(m_backward_plan[nbatch-1][mfi]);
 
         // Copy from the staging area to output array (and normalize)
+        for (int n = 0; n < nbatch; ++n) {
+            amrex::Array4<amrex::Real> tmp_real_arr = m_stagingArea.array(mfi, n);
+            amrex::Array4<amrex::Real> lhs_arr = lhs_mfs[n]->array(mfi);
+            amrex::ParallelFor( mfi.validbox(),
+                [=] AMREX_GPU_DEVICE(int i, int j, int k) noexcept {
+                    // Copy and normalize field
+                    lhs_arr(i,j,k) = tmp_real_arr(i,j,k);
+                });
+        }
+
+    }
+}
+
+void
+FFTPoissonSolverDirichlet::SolvePoissonEquationDistributed (
+    amrex::Vector<amrex::MultiFab*> const& lhs_mfs)
+{
+    HIPACE_PROFILE("FFTPoissonSolverDirichlet::SolvePoissonEquationDistributed()");
+
+    const int nbatch = lhs_mfs.size();
+
+    // Transpose the staging area to x-slabs, and perform the DSTs along x
+    m_xslab.ParallelCopy(m_stagingArea, 0, 0, nbatch);
+    for ( amrex::MFIter mfi(m_xslab); mfi.isValid(); ++mfi ){
+        AnyDST::Execute(m_xslab_plan[nbatch-1][mfi]);
+    }
+
+    // Transpose to y-slabs, perform the DSTs along y, multiply by the eigenvalues
+    // and perform the inverse DSTs along y
+    m_tmpSpectralField.ParallelCopy(m_xslab, 0, 0, nbatch);
+    for ( amrex::MFIter mfi(m_tmpSpectralField); mfi.isValid(); ++mfi ){
+        AnyDST::Execute(m_yslab_plan[nbatch-1][mfi]);
+
+        amrex::Array4<amrex::Real> tmp_cmplx_arr = m_tmpSpectralField.array(mfi);
+        amrex::Array4<amrex::Real> eigenvalue_matrix = m_eigenvalue_matrix.array(mfi);
+        amrex::ParallelFor( mfi.validbox(), nbatch,
+            [=] AMREX_GPU_DEVICE(int i, int j, int k, int n) noexcept {
+                tmp_cmplx_arr(i,j,k,n) *= eigenvalue_matrix(i,j,k);
+            });
+
+        AnyDST::Execute(m_yslab_plan[nbatch-1][mfi]);
+    }
+
+    // Transpose back to x-slabs and perform the inverse DSTs along x
+    m_xslab.ParallelCopy(m_tmpSpectralField, 0, 0, nbatch);
+    for ( amrex::MFIter mfi(m_xslab); mfi.isValid(); ++mfi ){
+        AnyDST::Execute(m_xslab_plan[nbatch-1][mfi]);
+    }
+
+    // Copy from the x-slabs to the valid region of the output arrays
+    for (int n = 0; n < nbatch; ++n) lhs_mfs[n]->ParallelCopy(m_xslab, n, 0, 1);
+}
+
+void
+FFTPoissonSolverDirichlet::SolvePoissonEquationGradient (
+    amrex::MultiFab& dx_mf, amrex::MultiFab& dy_mf, const amrex::Real mult_coeff)
+{
+    HIPACE_PROFILE("FFTPoissonSolverDirichlet::SolvePoissonEquationGradient()");
+
+    if (m_is_distributed) {
+        SolvePoissonEquationGradientDistributed(dx_mf, dy_mf, mult_coeff);
+        return;
+    }
+
+    // Centered difference of a sine mode k: cos(...) * sin(pi*k/(n+1))/dx
+    const amrex::Box domain = m_spectralspace_ba.minimalBox();
+    const amrex::Real sine_x_factor = MathConst::pi / ( domain.length(0) + 1 );
+    const amrex::Real sine_y_factor = MathConst::pi / ( domain.length(1) + 1 );
+    const amrex::Real coef_x = mult_coeff / m_dx;
+    const amrex::Real coef_y = mult_coeff / m_dy;
+
+    // Loop over boxes
+    for ( amrex::MFIter mfi(m_stagingArea); mfi.isValid(); ++mfi ){
+
+        // Perform Fourier transform from the staging area to `tmpSpectralField`
+        AnyDST::Execute(m_forward_plan[0][mfi]);
+
+        // Solve Poisson equation in Fourier space, and store the spectrum of the
+        // x-derivative in component 0 and that of the y-derivative in component 1
+        amrex::Array4<amrex::Real> tmp_cmplx_arr = m_tmpSpectralField.array(mfi);
+        amrex::Array4<amrex::Real> eigenvalue_matrix = m_eigenvalue_matrix.array(mfi);
+        amrex::ParallelFor( m_spectralspace_ba[mfi],
+            [=] AMREX_GPU_DEVICE(int i, int j, int k) noexcept {
+                const amrex::Real phi = tmp_cmplx_arr(i,j,k,0) * eigenvalue_matrix(i,j,k);
+                tmp_cmplx_arr(i,j,k,0) = coef_x * sin(( i + 1 ) * sine_x_factor) * phi;
+                tmp_cmplx_arr(i,j,k,1) = coef_y * sin(( j + 1 ) * sine_y_factor) * phi;
+            });
+
+        // Cosine series along the derivative direction, DST along the other one
+        AnyDST::Execute(m_gradient_plan[mfi]);
+
+        // Copy from the staging area to output arrays
         amrex::Array4<amrex::Real> tmp_real_arr = m_stagingArea.array(mfi);
-        amrex::Array4<amrex::Real> lhs_arr = lhs_mf.array(mfi);
+        amrex::Array4<amrex::Real> dx_arr = dx_mf.array(mfi);
+        amrex::Array4<amrex::Real> dy_arr = dy_mf.array(mfi);
+        amrex::ParallelFor( mfi.validbox(),
+            [=] AMREX_GPU_DEVICE(int i, int j, int k) noexcept {
+                dx_arr(i,j,k) = tmp_real_arr(i,j,k,0);
+                dy_arr(i,j,k) = tmp_real_arr(i,j,k,1);
+            });
+    }
+}
+
+void
+FFTPoissonSolverDirichlet::SolvePoissonEquationGradientDistributed (
+    amrex::MultiFab& dx_mf, amrex::MultiFab& dy_mf, const amrex::Real mult_coeff)
+{
+    HIPACE_PROFILE("FFTPoissonSolverDirichlet::SolvePoissonEquationGradientDistributed()");
+
+    const amrex::Box domain = m_spectralspace_ba.minimalBox();
+    const int ilo = domain.smallEnd(0);
+    const int jlo = domain.smallEnd(1);
+    const amrex::Real sine_x_factor = MathConst::pi / ( domain.length(0) + 1 );
+    const amrex::Real sine_y_factor = MathConst::pi / ( domain.length(1) + 1 );
+    const amrex::Real coef_x = mult_coeff / m_dx;
+    const amrex::Real coef_y = mult_coeff / m_dy;
+
+    // Transpose the staging area to x-slabs, and perform the DSTs along x
+    m_xslab.ParallelCopy(m_stagingArea, 0, 0, 1);
+    for ( amrex::MFIter mfi(m_xslab); mfi.isValid(); ++mfi ){
+        AnyDST::Execute(m_xslab_plan[0][mfi]);
+    }
+
+    // Transpose to y-slabs, perform the DSTs along y, compute the spectra of the derivatives
+    // and perform the inverse transforms along y
+    m_tmpSpectralField.ParallelCopy(m_xslab, 0, 0, 1);
+    for ( amrex::MFIter mfi(m_tmpSpectralField); mfi.isValid(); ++mfi ){
+        AnyDST::Execute(m_yslab_plan[0][mfi]);
+
+        amrex::Array4<amrex::Real> tmp_cmplx_arr = m_tmpSpectralField.array(mfi);
+        amrex::Array4<amrex::Real> eigenvalue_matrix = m_eigenvalue_matrix.array(mfi);
         amrex::ParallelFor( mfi.validbox(),
             [=] AMREX_GPU_DEVICE(int i, int j, int k) noexcept {
-                // Copy and normalize field
-                lhs_arr(i,j,k) = tmp_real_arr(i,j,k);
+                const amrex::Real phi = tmp_cmplx_arr(i,j,k,0) * eigenvalue_matrix(i,j,k);
+                tmp_cmplx_arr(i,j,k,0) = coef_x * sin(( i - ilo + 1 ) * sine_x_factor) * phi;
+                tmp_cmplx_arr(i,j,k,1) = coef_y * sin(( j - jlo + 1 ) * sine_y_factor) * phi;
             });
 
+        AnyDST::Execute(m_yslab_plan[0][mfi]);
+        AnyDST::Execute(m_yslab_cosine_plan[mfi]);
+    }
+
+    // Transpose back to x-slabs and perform the inverse transforms along x
+    m_xslab.ParallelCopy(m_tmpSpectralField, 0, 0, 2);
+    for ( amrex::MFIter mfi(m_xslab); mfi.isValid(); ++mfi ){
+        AnyDST::Execute(m_xslab_gradient_plan[0][mfi]);
+        AnyDST::Execute(m_xslab_gradient_plan[1][mfi]);
     }
+
+    // Copy from the x-slabs to the valid region of the output arrays
+    dx_mf.ParallelCopy(m_xslab, 0, 0, 1);
+    dy_mf.ParallelCopy(m_xslab, 1, 0, 1);
 }
@@ -0,0 +1,275 @@
+#include "FFTPoissonSolverOpenBoundary.H"
+#include "utils/Constants.H"
+#include "utils/HipaceProfilerWrapper.H"
+
+#include <cmath>
+
+namespace {
+    /** \brief Antiderivative in x and y of ln(sqrt(x^2+y^2)), i.e., F such that
+     * d^2F/dxdy = ln(r). Computed in double precision, because the integrated Green's function
+     * is a difference of large values far from the origin.
+     *
+     * \param[in] x position in x
+     * \param[in] y position in y
+     */
+    AMREX_GPU_HOST_DEVICE AMREX_FORCE_INLINE
+    double IntegratedLog (const double x, const double y)
+    {
+        double f = 0.;
+        if (x != 0. && y != 0.) f += x*y*(std::log(x*x + y*y) - 3.);
+        if (x != 0.) f += x*x*std::atan(y/x);
+        if (y != 0.) f += y*y*std::atan(x/y);
+        return 0.5*f;
+    }
+
+    /** \brief Green's function of the 2D Laplacian, ln(r)/(2 pi), averaged over the cell
+     * centered on (x, y)
+     *
+     * \param[in] x position of the cell center in x
+     * \param[in] y position of the cell center in y
+     * \param[in] dx cell size in x
+     * \param[in] dy cell size in y
+     */
+    AMREX_GPU_HOST_DEVICE AMREX_FORCE_INLINE
+    double IntegratedGreensFunction (const double x, const double y,
+                                     const double dx, const double dy)
+    {
+        return ( IntegratedLog(x + 0.5*dx, y + 0.5*dy) - IntegratedLog(x - 0.5*dx, y + 0.5*dy)
+               - IntegratedLog(x + 0.5*dx, y - 0.5*dy) + IntegratedLog(x - 0.5*dx, y - 0.5*dy) )
+               / ( 2.*MathConst::pi*dx*dy );
+    }
+}
+
+FFTPoissonSolverOpenBoundary::FFTPoissonSolverOpenBoundary (
+    amrex::BoxArray const& realspace_ba,
+    amrex::DistributionMapping const& dm,
+    amrex::Geometry const& gm )
+{
+    define(realspace_ba, dm, gm);
+}
+
+void
+FFTPoissonSolverOpenBoundary::define ( amrex::BoxArray const& realspace_ba,
+                                       amrex::DistributionMapping const& dm,
+                                       amrex::Geometry const& gm )
+{
+    HIPACE_PROFILE("FFTPoissonSolverOpenBoundary::define()");
+
+    m_is_distributed = realspace_ba.size() > 1;
+    m_dx = gm.CellSize(0);
+    m_dy = gm.CellSize(1);
+
+    // The doubled grid starts at the lower corner of the domain and has twice as many cells
+    // in x and y. The spectral domain of the R2C FFT along x starts at 0.
+    const amrex::Box realspace_domain = realspace_ba.minimalBox();
+    m_ncells = realspace_domain.length();
+    amrex::Box doubled_domain = realspace_domain;
+    doubled_domain.growHi(0, m_ncells[0]);
+    doubled_domain.growHi(1, m_ncells[1]);
+    amrex::IntVect spectral_bx_size = doubled_domain.length();
+    spectral_bx_size[0] = spectral_bx_size[0]/2 + 1;
+    const amrex::Box spectral_domain = amrex::Box( amrex::IntVect::TheZeroVector(),
+                      spectral_bx_size - amrex::IntVect::TheUnitVector() );
+
+    const amrex::DistributionMapping spectral_dm = MakeSlabDistributionMapping(dm);
+    amrex::BoxArray xslab_ba, xslab_spectral_ba, unused_ba;
+    MakeSlabBoxArrays(doubled_domain, spectral_dm.size(), xslab_ba, unused_ba);
+    MakeSlabBoxArrays(spectral_domain, spectral_dm.size(), xslab_spectral_ba, m_spectralspace_ba);
+
+    // Allocate temporary arrays - in real space and spectral space
+    m_stagingArea = amrex::MultiFab(realspace_ba, dm, m_max_batch, 0);
+    m_xslab = amrex::MultiFab(xslab_ba, spectral_dm, m_max_batch, 0);
+    m_xslab_spectral = SpectralField(xslab_spectral_ba, spectral_dm, m_max_batch, 0);
+    m_tmpSpectralField = SpectralField(m_spectralspace_ba, spectral_dm, m_max_batch, 0);
+    m_green = SpectralField(m_spectralspace_ba, spectral_dm, 1, 0);
+    m_stagingArea.setVal(0.0); // this is not required
+
+    // This must be true even for parallel FFT.
+    AMREX_ALWAYS_ASSERT_WITH_MESSAGE(m_stagingArea.local_size() == 1,
+                                     "There should be only one box locally.");
+    AMREX_ALWAYS_ASSERT_WITH_MESSAGE(m_tmpSpectralField.local_size() == 1,
+                                     "There should be only one box locally.");
+
+    // Along x, all components are transformed in one batch (one plan per batch size)
+    for (int nbatch = 1; nbatch <= m_max_batch; ++nbatch) {
+        m_xslab_forward_plan[nbatch-1] = AnyFFT::FFTplans(m_xslab.boxArray(), spectral_dm);
+        m_xslab_backward_plan[nbatch-1] = AnyFFT::FFTplans(m_xslab.boxArray(), spectral_dm);
+        for ( amrex::MFIter mfi(m_xslab); mfi.isValid(); ++mfi ){
+            // Rows along x are contiguous in memory (AMReX FABs are Fortran-order),
+            // and so are the components
+            const amrex::IntVect n = mfi.validbox().length();
+            m_xslab_forward_plan[nbatch-1][mfi] = AnyFFT::CreatePlanMany1D(
+                n[0], n[1]*nbatch, 1, n[0], m_xslab[mfi].dataPtr(),
+                reinterpret_cast<AnyFFT::Complex*>( m_xslab_spectral[mfi].dataPtr()),
+                AnyFFT::direction::R2C);
+            m_xslab_backward_plan[nbatch-1][mfi] = AnyFFT::CreatePlanMany1D(
+                n[0], n[1]*nbatch, 1, n[0], m_xslab[mfi].dataPtr(),
+                reinterpret_cast<AnyFFT::Complex*>( m_xslab_spectral[mfi].dataPtr()),
+                AnyFFT::direction::C2R);
+        }
+    }
+    // Along y, all components are transformed with one plan (one plan per batch size)
+    for (int nbatch = 1; nbatch <= m_max_batch; ++nbatch) {
+        m_forward_plan[nbatch-1] = AnyFFT::FFTplans(m_spectralspace_ba, spectral_dm);
+        m_backward_plan[nbatch-1] = AnyFFT::FFTplans(m_spectralspace_ba, spectral_dm);
+        for ( amrex::MFIter mfi(m_tmpSpectralField); mfi.isValid(); ++mfi ){
+            // Columns along y have a stride of the local number of cells in x
+            const amrex::IntVect n = mfi.validbox().length();
+            const long comp_dist = m_tmpSpectralField[mfi].box().numPts();
+            m_forward_plan[nbatch-1][mfi] = AnyFFT::CreatePlanMany1D(
+                n[1], n[0], n[0], 1, nullptr,
+                reinterpret_cast<AnyFFT::Complex*>( m_tmpSpectralField[mfi].dataPtr()),
+                AnyFFT::direction::C2C_forward, nbatch, comp_dist);
+            m_backward_plan[nbatch-1][mfi] = AnyFFT::CreatePlanMany1D(
+                n[1], n[0], n[0], 1, nullptr,
+                reinterpret_cast<AnyFFT::Complex*>( m_tmpSpectralField[mfi].dataPtr()),
+                AnyFFT::direction::C2C_backward, nbatch, comp_dist);
+        }
+    }
+
+    // The FFT of the Green's function needs a transpose, so it is computed at the first solve,
+    // where the transverse communicator is set.
+    m_green_defined = false;
+}
+
+void
+FFTPoissonSolverOpenBoundary::DefineGreensFunction ()
+{
+    HIPACE_PROFILE("FFTPoissonSolverOpenBoundary::DefineGreensFunction()");
+
+    // Integrated Green's function on the doubled grid. Beyond the middle of the doubled grid,
+    // cells correspond to negative distances, as for the frequencies of an FFT.
+    const amrex::IntVect lo = m_stagingArea.boxArray().minimalBox().smallEnd();
+    const int nx = m_ncells[0];
+    const int ny = m_ncells[1];
+    const double dx = m_dx;
+    const double dy = m_dy;
+    for ( amrex::MFIter mfi(m_xslab); mfi.isValid(); ++mfi ){
+        amrex::Array4<amrex::Real> green_arr = m_xslab.array(mfi);
+        amrex::ParallelFor( mfi.validbox(),
+            [=] AMREX_GPU_DEVICE(int i, int j, int k) noexcept {
+                const int di = (i - lo[0] <= nx) ? i - lo[0] : i - lo[0] - 2*nx;
+                const int dj = (j - lo[1] <= ny) ? j - lo[1] : j - lo[1] - 2*ny;
+                green_arr(i,j,k) = static_cast<amrex::Real>(
+                    IntegratedGreensFunction(di*dx, dj*dy, dx, dy));
+            });
+    }
+    ForwardTransform(1);
+
+    // The convolution is a sum over cells, hence the cell area, and the backward FFT
+    // is not normalized
+    const amrex::Real norm = m_dx*m_dy/(4.*nx*ny);
+    for ( amrex::MFIter mfi(m_green); mfi.isValid(); ++mfi ){
+        amrex::Array4<amrex::GpuComplex<amrex::Real>> green_arr = m_green.array(mfi);
+        amrex::Array4<amrex::GpuComplex<amrex::Real>> tmp_cmplx_arr = m_tmpSpectralField.array(mfi);
+        amrex::ParallelFor( mfi.validbox(),
+            [=] AMREX_GPU_DEVICE(int i, int j, int k) noexcept {
+                green_arr(i,j,k) = norm*tmp_cmplx_arr(i,j,k,0);
+            });
+    }
+    m_green_defined = true;
+}
+
+void
+FFTPoissonSolverOpenBoundary::ForwardTransform (const int ncomp)
+{
+    // Perform the R2C FFTs along x
+    for ( amrex::MFIter mfi(m_xslab); mfi.isValid(); ++mfi ){
+        AnyFFT::Execute(m_xslab_forward_plan[ncomp-1][mfi]);
+    }
+
+    // Transpose to y-slabs, perform the FFTs along y
+    m_tmpSpectralField.ParallelCopy(m_xslab_spectral, 0, 0, ncomp);
+    for ( amrex::MFIter mfi(m_tmpSpectralField); mfi.isValid(); ++mfi ){
+        AnyFFT::Execute(m_forward_plan[ncomp-1][mfi]);
+    }
+}
+
+void
+FFTPoissonSolverOpenBoundary::BackwardTransform (const int ncomp)
+{
+    // Perform the inverse FFTs along y
+    for ( amrex::MFIter mfi(m_tmpSpectralField); mfi.isValid(); ++mfi ){
+        AnyFFT::Execute(m_backward_plan[ncomp-1][mfi]);
+    }
+
+    // Transpose back to x-slabs, perform the C2R FFTs along x
+    m_xslab_spectral.ParallelCopy(m_tmpSpectralField, 0, 0, ncomp);
+    for ( amrex::MFIter mfi(m_xslab); mfi.isValid(); ++mfi ){
+        AnyFFT::Execute(m_xslab_backward_plan[ncomp-1][mfi]);
+    }
+}
+
+void
+FFTPoissonSolverOpenBoundary::SolvePoissonEquationBatch (
+    amrex::Vector<amrex::MultiFab*> const& lhs_mfs)
+{
+    HIPACE_PROFILE("FFTPoissonSolverOpenBoundary::SolvePoissonEquationBatch()");
+
+    const int nbatch = lhs_mfs.size();
+    AMREX_ALWAYS_ASSERT_WITH_MESSAGE(nbatch >= 1 && nbatch <= m_max_batch,
+                                     "Number of Poisson equations solved at once out of range");
+
+    if (!m_green_defined) DefineGreensFunction();
+
+    // Zero-pad the source on the doubled grid and transform it
+    m_xslab.setVal(0., 0, nbatch);
+    m_xslab.ParallelCopy(m_stagingArea, 0, 0, nbatch);
+    ForwardTransform(nbatch);
+
+    // Convolution with the Green's function
+    for ( amrex::MFIter mfi(m_tmpSpectralField); mfi.isValid(); ++mfi ){
+        amrex::Array4<amrex::GpuComplex<amrex::Real>> tmp_cmplx_arr = m_tmpSpectralField.array(mfi);
+        amrex::Array4<amrex::GpuComplex<amrex::Real>> green_arr = m_green.array(mfi);
+        amrex::ParallelFor( mfi.validbox(), nbatch,
+            [=] AMREX_GPU_DEVICE(int i, int j, int k, int n) noexcept {
+                tmp_cmplx_arr(i,j,k,n) *= green_arr(i,j,k);
+            });
+    }
+
+    BackwardTransform(nbatch);
+
+    // Copy the physical domain of the doubled grid to the output arrays
+    for (int n = 0; n < nbatch; ++n) lhs_mfs[n]->ParallelCopy(m_xslab, n, 0, 1);
+}
+
+void
+FFTPoissonSolverOpenBoundary::SolvePoissonEquationGradient (
+    amrex::MultiFab& dx_mf, amrex::MultiFab& dy_mf, const amrex::Real mult_coeff)
+{
+    HIPACE_PROFILE("FFTPoissonSolverOpenBoundary::SolvePoissonEquationGradient()");
+
+    if (!m_green_defined) DefineGreensFunction();
+
+    // Zero-pad the source on the doubled grid and transform it
+    m_xslab.setVal(0., 0, 1);
+    m_xslab.ParallelCopy(m_stagingArea, 0, 0, 1);
+    ForwardTransform(1);
+
+    // Convolution with the Green's function, and centered difference of a Fourier mode k:
+    // i*sin(k*dx)/dx. The doubled grid holds the free-space solution one cell beyond the
+    // domain, so the derivatives are also correct at the domain boundary.
+    const amrex::Real kdx_factor = MathConst::pi/m_ncells[0];
+    const amrex::Real kdy_factor = MathConst::pi/m_ncells[1];
+    const amrex::Real coef_x = mult_coeff/m_dx;
+    const amrex::Real coef_y = mult_coeff/m_dy;
+    for ( amrex::MFIter mfi(m_tmpSpectralField); mfi.isValid(); ++mfi ){
+        amrex::Array4<amrex::GpuComplex<amrex::Real>> tmp_cmplx_arr = m_tmpSpectralField.array(mfi);
+        amrex::Array4<amrex::GpuComplex<amrex::Real>> green_arr = m_green.array(mfi);
+        amrex::ParallelFor( mfi.validbox(),
+            [=] AMREX_GPU_DEVICE(int i, int j, int k) noexcept {
+                const amrex::GpuComplex<amrex::Real> phi =
+                    green_arr(i,j,k)*tmp_cmplx_arr(i,j,k,0);
+                tmp_cmplx_arr(i,j,k,0) = phi*amrex::GpuComplex<amrex::Real>(
+                    0., coef_x*sin(i*kdx_factor));
+                tmp_cmplx_arr(i,j,k,1) = phi*amrex::GpuComplex<amrex::Real>(
+                    0., coef_y*sin(j*kdy_factor));
+            });
+    }
+
+    BackwardTransform(2);
+
+    // Copy the physical domain of the doubled grid to the output arrays
+    dx_mf.ParallelCopy(m_xslab, 0, 0, 1);
+    dy_mf.ParallelCopy(m_xslab, 1, 0, 1);
+}
@@ -18,36 +18,57 @@ FFTPoissonSolverPeriodic::define ( amrex::BoxArray const& realspace_ba,
     using namespace amrex::literals;
 
     HIPACE_PROFILE("FFTPoissonSolverPeriodic::define()");
-    // If we are going to support parallel FFT, the constructor needs to take a communicator.
-    AMREX_ALWAYS_ASSERT_WITH_MESSAGE(realspace_ba.size() == 1, "Parallel FFT not supported yet");
-
-    // Create the box array that corresponds to spectral space
-    amrex::BoxList spectral_bl; // Create empty box list
-    // Loop over boxes and fill the box list
-    for (int i=0; i < realspace_ba.size(); i++ ) {
-        // For local FFTs, boxes in spectral space start at 0 in
-        // each direction and have the same number of points as the
-        // (cell-centered) real space box
-        amrex::Box realspace_bx = realspace_ba[i];
-        amrex::IntVect fft_size = realspace_bx.length();
-        // Because the spectral solver uses real-to-complex FFTs, we only
-        // need the positive k values along the fastest axis
-        // (first axis for AMReX Fortran-order arrays) in spectral space.
-        // This effectively reduces the size of the spectral space by half
-        // see e.g. the FFTW documentation for real-to-complex FFTs
-        amrex::IntVect spectral_bx_size = fft_size;
-        spectral_bx_size[0] = fft_size[0]/2 + 1;
-        // Define the corresponding box
-        amrex::Box spectral_bx = amrex::Box( amrex::IntVect::TheZeroVector(),
+
+    m_is_distributed = realspace_ba.size() > 1;
+    m_dx = gm.CellSize(0);
+    m_dy = gm.CellSize(1);
+
+    amrex::DistributionMapping spectral_dm = dm;
+    if (m_is_distributed) {
+        // Slab decomposition: the 1D R2C/C2R FFTs along x are done on x-slabs,
+        // the 1D C2C FFTs along y on y-slabs, where the spectral data lives.
+        spectral_dm = MakeSlabDistributionMapping(dm);
+        const amrex::Box realspace_domain = realspace_ba.minimalBox();
+        amrex::IntVect spectral_bx_size = realspace_domain.length();
+        spectral_bx_size[0] = spectral_bx_size[0]/2 + 1;
+        const amrex::Box spectral_domain = amrex::Box( amrex::IntVect::TheZeroVector(),
                           spectral_bx_size - amrex::IntVect::TheUnitVector() );
-        spectral_bl.push_back( spectral_bx );
+
+        amrex::BoxArray xslab_ba, xslab_spectral_ba, unused_ba;
+        MakeSlabBoxArrays(realspace_domain, spectral_dm.size(), xslab_ba, unused_ba);
+        MakeSlabBoxArrays(spectral_domain, spectral_dm.size(),
+                          xslab_spectral_ba, m_spectralspace_ba);
+        m_xslab = amrex::MultiFab(xslab_ba, spectral_dm, m_max_batch, 0);
+        m_xslab_spectral = SpectralField(xslab_spectral_ba, spectral_dm, m_max_batch, 0);
+    } else {
+        // Create the box array that corresponds to spectral space
+        amrex::BoxList spectral_bl; // Create empty box list
+        // Loop over boxes and fill the box list
+        for (int i=0; i < realspace_ba.size(); i++ ) {
+            // For local FFTs, boxes in spectral space start at 0 in
+            // each direction and have the same number of points as the
+            // (cell-centered) real space box
+            amrex::Box realspace_bx = realspace_ba[i];
+            amrex::IntVect fft_size = realspace_bx.length();
+            // Because the spectral solver uses real-to-complex FFTs, we only
+            // need the positive k values along the fastest axis
+            // (first axis for AMReX Fortran-order arrays) in spectral space.
+            // This effectively reduces the size of the spectral space by half
+            // see e.g. the FFTW documentation for real-to-complex FFTs
+            amrex::IntVect spectral_bx_size = fft_size;
+            spectral_bx_size[0] = fft_size[0]/2 + 1;
+            // Define the corresponding box
+            amrex::Box spectral_bx = amrex::Box( amrex::IntVect::TheZeroVector(),
+                              spectral_bx_size - amrex::IntVect::TheUnitVector() );
+            spectral_bl.push_back( spectral_bx );
+        }
+        m_spectralspace_ba.define( std::move(spectral_bl) );
     }
-    m_spectralspace_ba.define( std::move(spectral_bl) );
 
     // Allocate temporary arrays - in real space and spectral space
     // These arrays will store the data just before/after the FFT
-    m_stagingArea = amrex::MultiFab(realspace_ba, dm, 1, 0);
-    m_tmpSpectralField = SpectralField(m_spectralspace_ba, dm, 1, 0);
+    m_stagingArea = amrex::MultiFab(realspace_ba, dm, m_max_batch, 0);
+    m_tmpSpectralField = SpectralField(m_spectralspace_ba, spectral_dm, m_max_batch, 0);
 
     // This must be true even for parallel FFT.
     AMREX_ALWAYS_ASSERT_WITH_MESSAGE(m_stagingArea.local_size() == 1,
@@ -58,11 +79,12 @@ FFTPoissonSolverPeriodic::define ( amrex::BoxArray const& realspace_ba,
     // Calculate the array of inv_k2
     amrex::Real dkx = 2*MathConst::pi/gm.ProbLength(0);
     amrex::Real dky = 2*MathConst::pi/gm.ProbLength(1);
-    m_inv_k2 = amrex::MultiFab(m_spectralspace_ba, dm, 1, 0);
+    m_inv_k2 = amrex::MultiFab(m_spectralspace_ba, spectral_dm, 1, 0);
     // Loop over boxes and calculate inv_k2 in each box
     for (amrex::MFIter mfi(m_inv_k2); mfi.isValid(); ++mfi ){
         amrex::Array4<amrex::Real> inv_k2_arr = m_inv_k2.array(mfi);
         amrex::Box const& bx = mfi.validbox();  // The lower corner of the "2D" slice Box is zero.
+        // For the distributed transform, y-slabs have the full extent in y
         int const Ny = bx.length(1);
         int const mid_point_y = (Ny+1)/2;
         amrex::ParallelFor(bx, [=] AMREX_GPU_DEVICE (int i, int j, int /* k */) noexcept
@@ -80,61 +102,261 @@ FFTPoissonSolverPeriodic::define ( amrex::BoxArray const& realspace_ba,
         });
     }
 
-    // Allocate and initialize the FFT plans
-    m_forward_plan = AnyFFT::FFTplans(m_spectralspace_ba, dm);
-    m_backward_plan = AnyFFT::FFTplans(m_spectralspace_ba, dm);
-    // Loop over boxes and allocate the corresponding plan
-    // for each box owned by the local MPI proc
-    for ( amrex::MFIter mfi(m_stagingArea); mfi.isValid(); ++mfi ){
-        // Note: the size of the real-space box and spectral-space box
-        // differ when using real-to-complex FFT. When initializing
-        // the FFT plan, the valid dimensions are those of the real-space box.
-        amrex::IntVect fft_size = mfi.validbox().length();
-        m_forward_plan[mfi] = AnyFFT::CreatePlan(
-            fft_size, m_stagingArea[mfi].dataPtr(),
-            reinterpret_cast<AnyFFT::Complex*>( m_tmpSpectralField[mfi].dataPtr()),
-            AnyFFT::direction::R2C);
-
-        m_backward_plan[mfi] = AnyFFT::CreatePlan(
-            fft_size, m_stagingArea[mfi].dataPtr(),
-            reinterpret_cast<AnyFFT::Complex*>( m_tmpSpectralField[mfi].dataPtr()),
-            AnyFFT::direction::C2R);
+    if (m_is_distributed) {
+        // Along x, all components are transformed in one batch (one plan per batch size)
+        for (int nbatch = 1; nbatch <= m_max_batch; ++nbatch) {
+            m_xslab_forward_plan[nbatch-1] = AnyFFT::FFTplans(m_xslab.boxArray(), spectral_dm);
+            m_xslab_backward_plan[nbatch-1] = AnyFFT::FFTplans(m_xslab.boxArray(), spectral_dm);
+            for ( amrex::MFIter mfi(m_xslab); mfi.isValid(); ++mfi ){
+                // Rows along x are contiguous in memory (AMReX FABs are Fortran-order),
+                // and so are the components
+                const amrex::IntVect n = mfi.validbox().length();
+                m_xslab_forward_plan[nbatch-1][mfi] = AnyFFT::CreatePlanMany1D(
+                    n[0], n[1]*nbatch, 1, n[0], m_xslab[mfi].dataPtr(),
+                    reinterpret_cast<AnyFFT::Complex*>( m_xslab_spectral[mfi].dataPtr()),
+                    AnyFFT::direction::R2C);
+                m_xslab_backward_plan[nbatch-1][mfi] = AnyFFT::CreatePlanMany1D(
+                    n[0], n[1]*nbatch, 1, n[0], m_xslab[mfi].dataPtr(),
+                    reinterpret_cast<AnyFFT::Complex*>( m_xslab_spectral[mfi].dataPtr()),
+                    AnyFFT::direction::C2R);
+            }
+        }
+        // Along y, all components are transformed with one plan (one plan per batch size)
+        for (int nbatch = 1; nbatch <= m_max_batch; ++nbatch) {
+            m_forward_plan[nbatch-1] = AnyFFT::FFTplans(m_spectralspace_ba, spectral_dm);
+            m_backward_plan[nbatch-1] = AnyFFT::FFTplans(m_spectralspace_ba, spectral_dm);
+            for ( amrex::MFIter mfi(m_tmpSpectralField); mfi.isValid(); ++mfi ){
+                // Columns along y have a stride of the local number of cells in x
+                const amrex::IntVect n = mfi.validbox().length();
+                const long comp_dist = m_tmpSpectralField[mfi].box().numPts();
+                m_forward_plan[nbatch-1][mfi] = AnyFFT::CreatePlanMany1D(
+                    n[1], n[0], n[0], 1, nullptr,
+                    reinterpret_cast<AnyFFT::Complex*>( m_tmpSpectralField[mfi].dataPtr()),
+                    AnyFFT::direction::C2C_forward, nbatch, comp_dist);
+                m_backward_plan[nbatch-1][mfi] = AnyFFT::CreatePlanMany1D(
+                    n[1], n[0], n[0], 1, nullptr,
+                    reinterpret_cast<AnyFFT::Complex*>( m_tmpSpectralField[mfi].dataPtr()),
+                    AnyFFT::direction::C2C_backward, nbatch, comp_dist);
+            }
+        }
+        m_inv_N = 1./realspace_ba.minimalBox().numPts();
+        return;
+    }
+
+    // Allocate and initialize the FFT plans, one per batch size
+    for (int nbatch = 1; nbatch <= m_max_batch; ++nbatch) {
+        m_forward_plan[nbatch-1] = AnyFFT::FFTplans(m_spectralspace_ba, dm);
+        m_backward_plan[nbatch-1] = AnyFFT::FFTplans(m_spectralspace_ba, dm);
+        // Loop over boxes and allocate the corresponding plan
+        // for each box owned by the local MPI proc
+        for ( amrex::MFIter mfi(m_stagingArea); mfi.isValid(); ++mfi ){
+            // Note: the size of the real-space box and spectral-space box
+            // differ when using real-to-complex FFT. When initializing
+            // the FFT plan, the valid dimensions are those of the real-space box.
+            amrex::IntVect fft_size = mfi.validbox().length();
+            m_forward_plan[nbatch-1][mfi] = AnyFFT::CreatePlan(
+                fft_size, m_stagingArea[mfi].dataPtr(),
+                reinterpret_cast<AnyFFT::Complex*>( m_tmpSpectralField[mfi].dataPtr()),
+                AnyFFT::direction::R2C, nbatch);
+
+            m_backward_plan[nbatch-1][mfi] = AnyFFT::CreatePlan(
+                fft_size, m_stagingArea[mfi].dataPtr(),
+                reinterpret_cast<AnyFFT::Complex*>( m_tmpSpectralField[mfi].dataPtr()),
+                AnyFFT::direction::C2R, nbatch);
+        }
     }
 }
 
 
 void
-FFTPoissonSolverPeriodic::SolvePoissonEquation (amrex::MultiFab& lhs_mf)
+FFTPoissonSolverPeriodic::SolvePoissonEquationBatch (amrex::Vector<amrex::MultiFab*> const& lhs_mfs)
 {
-    HIPACE_PROFILE("FFTPoissonSolverPeriodic::SolvePoissonEquation()");
+    HIPACE_PROFILE("FFTPoissonSolverPeriodic::SolvePoissonEquationBatch()");
+
+    const int nbatch = lhs_mfs.size();
+    AMREX_ALWAYS_ASSERT_WITH_MESSAGE(nbatch >= 1 && nbatch <= m_max_batch,
+                                     "Number of Poisson equations solved at once out of range");
+
+    if (m_is_distributed) {
+        SolvePoissonEquationDistributed(lhs_mfs);
+        return;
+    }
 
     // Loop over boxes
     for ( amrex::MFIter mfi(m_stagingArea); mfi.isValid(); ++mfi ){
 
         // Perform Fourier transform from the staging area to `tmpSpectralField`
-        AnyFFT::Execute(m_forward_plan[mfi]);
+        AnyFFT::Execute(m_forward_plan[nbatch-1][mfi]);
 
         // Solve Poisson equation in Fourier space:
         // Multiply `tmpSpectralField` by inv_k2
         amrex::Array4<amrex::GpuComplex<amrex::Real>> tmp_cmplx_arr = m_tmpSpectralField.array(mfi);
         amrex::Array4<amrex::Real> inv_k2_arr = m_inv_k2.array(mfi);
+        amrex::ParallelFor( m_spectralspace_ba[mfi], nbatch,
+            [=] AMREX_GPU_DEVICE(int i, int j, int k, int n) noexcept {
+                tmp_cmplx_arr(i,j,k,n) *= -inv_k2_arr(i,j,k);
+            });
+
+        // Perform Fourier transform from `tmpSpectralField` to the staging area
+        AnyFFT::Execute(m_backward_plan[nbatch-1][mfi]);
+
+        // Copy from the staging area to output array (and normalize)
+        const amrex::Real inv_N = 1./mfi.validbox().numPts();
+        for (int n = 0; n < nbatch; ++n) {
+            amrex::Array4<amrex::Real> tmp_real_arr = m_stagingArea.array(mfi, n);
+            amrex::Array4<amrex::Real> lhs_arr = lhs_mfs[n]->array(mfi);
+            amrex::ParallelFor( mfi.validbox(),
+                [=] AMREX_GPU_DEVICE(int i, int j, int k) noexcept {
+                    // Copy and normalize field
+                    lhs_arr(i,j,k) = inv_N*tmp_real_arr(i,j,k);
+                });
+        }
+
+    }
+}
+
+void
+FFTPoissonSolverPeriodic::SolvePoissonEquationDistributed (
+    amrex::Vector<amrex::MultiFab*> const& lhs_mfs)
+{
+    HIPACE_PROFILE("FFTPoissonSolverPeriodic::SolvePoissonEquationDistributed()");
+
+    const int nbatch = lhs_mfs.size();
+
+    // Transpose the staging area to x-slabs, and perform the R2C FFTs along x
+    m_xslab.ParallelCopy(m_stagingArea, 0, 0, nbatch);
+    for ( amrex::MFIter mfi(m_xslab); mfi.isValid(); ++mfi ){
+        AnyFFT::Execute(m_xslab_forward_plan[nbatch-1][mfi]);
+    }
+
+    // Transpose to y-slabs, perform the FFTs along y, multiply by -inv_k2
+    // and perform the inverse FFTs along y
+    m_tmpSpectralField.ParallelCopy(m_xslab_spectral, 0, 0, nbatch);
+    for ( amrex::MFIter mfi(m_tmpSpectralField); mfi.isValid(); ++mfi ){
+        AnyFFT::Execute(m_forward_plan[nbatch-1][mfi]);
+
+        amrex::Array4<amrex::GpuComplex<amrex::Real>> tmp_cmplx_arr = m_tmpSpectralField.array(mfi);
+        amrex::Array4<amrex::Real> inv_k2_arr = m_inv_k2.array(mfi);
+        amrex::ParallelFor( mfi.validbox(), nbatch,
+            [=] AMREX_GPU_DEVICE(int i, int j, int k, int n) noexcept {
+                tmp_cmplx_arr(i,j,k,n) *= -inv_k2_arr(i,j,k);
+            });
+
+        AnyFFT::Execute(m_backward_plan[nbatch-1][mfi]);
+    }
+
+    // Transpose back to x-slabs, perform the C2R FFTs along x and normalize
+    m_xslab_spectral.ParallelCopy(m_tmpSpectralField, 0, 0, nbatch);
+    for ( amrex::MFIter mfi(m_xslab); mfi.isValid(); ++mfi ){
+        AnyFFT::Execute(m_xslab_backward_plan[nbatch-1][mfi]);
+    }
+    m_xslab.mult(m_inv_N, 0, nbatch);
+
+    // Copy from the x-slabs to the valid region of the output arrays
+    for (int n = 0; n < nbatch; ++n) lhs_mfs[n]->ParallelCopy(m_xslab, n, 0, 1);
+}
+
+void
+FFTPoissonSolverPeriodic::SolvePoissonEquationGradient (
+    amrex::MultiFab& dx_mf, amrex::MultiFab& dy_mf, const amrex::Real mult_coeff)
+{
+    HIPACE_PROFILE("FFTPoissonSolverPeriodic::SolvePoissonEquationGradient()");
+
+    if (m_is_distributed) {
+        SolvePoissonEquationGradientDistributed(dx_mf, dy_mf, mult_coeff);
+        return;
+    }
+
+    // Centered difference of a Fourier mode k: i*sin(k*dx)/dx, which vanishes at the Nyquist mode
+    const amrex::IntVect n_real = m_stagingArea.boxArray().minimalBox().length();
+    const amrex::Real kdx_factor = 2*MathConst::pi/n_real[0];
+    const amrex::Real kdy_factor = 2*MathConst::pi/n_real[1];
+    const amrex::Real inv_dx = 1./m_dx;
+    const amrex::Real inv_dy = 1./m_dy;
+
+    // Loop over boxes
+    for ( amrex::MFIter mfi(m_stagingArea); mfi.isValid(); ++mfi ){
+
+        // Perform Fourier transform from the staging area to `tmpSpectralField`
+        AnyFFT::Execute(m_forward_plan[0][mfi]);
+
+        // Solve Poisson equation in Fourier space, and store the spectrum of the
+        // x-derivative in component 0 and that of the y-derivative in component 1
+        amrex::Array4<amrex::GpuComplex<amrex::Real>> tmp_cmplx_arr = m_tmpSpectralField.array(mfi);
+        amrex::Array4<amrex::Real> inv_k2_arr = m_inv_k2.array(mfi);
         amrex::ParallelFor( m_spectralspace_ba[mfi],
             [=] AMREX_GPU_DEVICE(int i, int j, int k) noexcept {
-                tmp_cmplx_arr(i,j,k) *= -inv_k2_arr(i,j,k);
+                const amrex::GpuComplex<amrex::Real> phi =
+                    -inv_k2_arr(i,j,k)*tmp_cmplx_arr(i,j,k,0);
+                tmp_cmplx_arr(i,j,k,0) = phi*amrex::GpuComplex<amrex::Real>(
+                    0., inv_dx*sin(i*kdx_factor));
+                tmp_cmplx_arr(i,j,k,1) = phi*amrex::GpuComplex<amrex::Real>(
+                    0., inv_dy*sin(j*kdy_factor));
             });
 
         // Perform Fourier transform from `tmpSpectralField` to the staging area
-        AnyFFT::Execute(m_backward_plan[mfi]);
+        AnyFFT::Execute(m_backward_plan[1][mfi]);
 
-        // Copy from the staging area to output array (and normalize)
+        // Copy from the staging area to output arrays (and normalize)
+        const amrex::Real fac = mult_coeff/mfi.validbox().numPts();
         amrex::Array4<amrex::Real> tmp_real_arr = m_stagingArea.array(mfi);
-        amrex::Array4<amrex::Real> lhs_arr = lhs_mf.array(mfi);
-        const amrex::Real inv_N = 1./mfi.validbox().numPts();
+        amrex::Array4<amrex::Real> dx_arr = dx_mf.array(mfi);
+        amrex::Array4<amrex::Real> dy_arr = dy_mf.array(mfi);
         amrex::ParallelFor( mfi.validbox(),
             [=] AMREX_GPU_DEVICE(int i, int j, int k) noexcept {
-                // Copy and normalize field
-                lhs_arr(i,j,k) = inv_N*tmp_real_arr(i,j,k);
+                dx_arr(i,j,k) = fac*tmp_real_arr(i,j,k,0);
+                dy_arr(i,j,k) = fac*tmp_real_arr(i,j,k,1);
             });
+    }
+}
+
+void
+FFTPoissonSolverPeriodic::SolvePoissonEquationGradientDistributed (
+    amrex::MultiFab& dx_mf, amrex::MultiFab& dy_mf, const amrex::Real mult_coeff)
+{
+    HIPACE_PROFILE("FFTPoissonSolverPeriodic::SolvePoissonEquationGradientDistributed()");
+
+    const amrex::IntVect n_real = m_stagingArea.boxArray().minimalBox().length();
+    const amrex::Real kdx_factor = 2*MathConst::pi/n_real[0];
+    const amrex::Real kdy_factor = 2*MathConst::pi/n_real[1];
+    const amrex::Real inv_dx = 1./m_dx;
+    const amrex::Real inv_dy = 1./m_dy;
+
+    // Transpose the staging area to x-slabs, and perform the R2C FFTs along x
+    m_xslab.ParallelCopy(m_stagingArea, 0, 0, 1);
+    for ( amrex::MFIter mfi(m_xslab); mfi.isValid(); ++mfi ){
+        AnyFFT::Execute(m_xslab_forward_plan[0][mfi]);
+    }
+
+    // Transpose to y-slabs, perform the FFTs along y, compute the spectra of the derivatives
+    // and perform the inverse FFTs along y
+    m_tmpSpectralField.ParallelCopy(m_xslab_spectral, 0, 0, 1);
+    for ( amrex::MFIter mfi(m_tmpSpectralField); mfi.isValid(); ++mfi ){
+        AnyFFT::Execute(m_forward_plan[0][mfi]);
 
+        amrex::Array4<amrex::GpuComplex<amrex::Real>> tmp_cmplx_arr = m_tmpSpectralField.array(mfi);
+        amrex::Array4<amrex::Real> inv_k2_arr = m_inv_k2.array(mfi);
+        amrex::ParallelFor( mfi.validbox(),
+            [=] AMREX_GPU_DEVICE(int i, int j, int k) noexcept {
+                const amrex::GpuComplex<amrex::Real> phi =
+                    -inv_k2_arr(i,j,k)*tmp_cmplx_arr(i,j,k,0);
+                tmp_cmplx_arr(i,j,k,0) = phi*amrex::GpuComplex<amrex::Real>(
+                    0., inv_dx*sin(i*kdx_factor));
+                tmp_cmplx_arr(i,j,k,1) = phi*amrex::GpuComplex<amrex::Real>(
+                    0., inv_dy*sin(j*kdy_factor));
+            });
+
+        AnyFFT::Execute(m_backward_plan[1][mfi]);
+    }
+
+    // Transpose back to x-slabs, perform the C2R FFTs along x and normalize
+    m_xslab_spectral.ParallelCopy(m_tmpSpectralField, 0, 0, 2);
+    for ( amrex::MFIter mfi(m_xslab); mfi.isValid(); ++mfi ){
+        AnyFFT::Execute(m_xslab_backward_plan[1][mfi]);
     }
+    m_xslab.mult(mult_coeff*m_inv_N, 0, 2);
+
+    // Copy from the x-slabs to the valid region of the output arrays
+    dx_mf.ParallelCopy(m_xslab, 0, 0, 1);
+    dy_mf.ParallelCopy(m_xslab, 1, 0, 1);
 }
@@ -0,0 +1,360 @@
+#include "AnyDST.H"
+#include "utils/Constants.H"
+#include "utils/HipaceProfilerWrapper.H"
+
+#include <algorithm>
+#include <cmath>
+
+namespace AnyDST
+{
+    namespace {
+#ifndef AMREX_USE_CUDA
+#  ifdef AMREX_USE_FLOAT
+        const auto VendorCreatePlanGuruR2R = fftwf_plan_guru64_r2r;
+        using VendorIODim = fftwf_iodim64;
+#  else
+        const auto VendorCreatePlanGuruR2R = fftw_plan_guru64_r2r;
+        using VendorIODim = fftw_iodim64;
+#  endif
+
+        /** \brief Create the native FFTW_RODFT00 plan of a batch of DSTs, with the transforms
+         * and the components as two loop dimensions.
+         *
+         * \param[in] batch batch of transforms
+         * \return the plan, executed with AnyFFT::Execute
+         */
+        AnyFFT::FFTplan CreateNativePlan (DSTbatch const& batch)
+        {
+            const VendorIODim dim {batch.m_n, batch.m_stride, batch.m_stride};
+            const VendorIODim loops[2] = {{batch.m_howmany, batch.m_dist, batch.m_dist},
+                                          {batch.m_ncomp, batch.m_comp_dist, batch.m_comp_dist}};
+            const fftw_r2r_kind kind = FFTW_RODFT00;
+            AnyFFT::FFTplan fft_plan;
+            fft_plan.m_plan = VendorCreatePlanGuruR2R(
+                1, &dim, 2, loops, batch.m_in, batch.m_out, &kind, AnyFFT::VendorPlannerFlag());
+            fft_plan.m_real_array = batch.m_in;
+            fft_plan.m_complex_array = nullptr;
+            fft_plan.m_dir = AnyFFT::direction::R2C;
+            return fft_plan;
+        }
+#endif
+
+        /** \brief Add a batch of 1D DSTs to a plan. The FFT plan is created in FinalizePlan,
+         * once the size of the work arrays is known.
+         *
+         * \param[in,out] dst_plan plan to which the batch is added
+         * \param[in] n size of each 1D transform
+         * \param[in] howmany number of transforms in the batch
+         * \param[in] stride distance between two consecutive elements of one transform
+         * \param[in] dist distance between the first elements of two consecutive transforms
+         * \param[in] in first element of the input of the batch
+         * \param[in] out first element of the output of the batch
+         * \param[in] k kind of transform
+         * \param[in] ncomp number of components, each with howmany transforms
+         * \param[in] comp_dist distance between the first elements of two components
+         */
+        void AddBatch (DSTplan& dst_plan, const int n, const int howmany, const int stride,
+                       const int dist, amrex::Real* in, amrex::Real* out,
+                       const kind k=kind::sine, const int ncomp=1, const long comp_dist=0)
+        {
+            DSTbatch batch;
+            batch.m_in = in;
+            batch.m_out = out;
+            batch.m_n = n;
+            batch.m_howmany = howmany;
+            batch.m_stride = stride;
+            batch.m_dist = dist;
+            batch.m_kind = k;
+            batch.m_ncomp = ncomp;
+            batch.m_comp_dist = comp_dist;
+#ifdef AMREX_USE_CUDA
+            batch.m_native = false;
+#else
+            // FFTW has a native DST-I, but no transform for the cosine series
+            batch.m_native = k == kind::sine;
+#endif
+            dst_plan.m_batches.push_back(batch);
+        }
+
+        /** \brief Allocate the work arrays, large enough for every batch of the plan that uses
+         * the real FFT, and create the FFT plans.
+         *
+         * \param[in,out] dst_plan plan to finalize
+         */
+        void FinalizePlan (DSTplan& dst_plan)
+        {
+            int real_size = 1;
+            int complex_size = 1;
+            for (auto const& batch : dst_plan.m_batches) {
+                if (batch.m_native) continue;
+                const int m = batch.m_n + 1;
+                const int ntransforms = batch.m_howmany*batch.m_ncomp;
+                real_size = std::max(real_size, m*ntransforms);
+                complex_size = std::max(complex_size, (m/2+1)*ntransforms);
+            }
+            const amrex::Box real_box {{0, 0, 0}, {real_size-1, 0, 0}};
+            const amrex::Box complex_box {{0, 0, 0}, {complex_size-1, 0, 0}};
+            dst_plan.m_work_real = std::make_unique<amrex::FArrayBox>(real_box, 1);
+            dst_plan.m_work_complex =
+                std::make_unique<amrex::BaseFab<amrex::GpuComplex<amrex::Real>>>(complex_box, 1);
+
+            for (auto& batch : dst_plan.m_batches) {
+#ifndef AMREX_USE_CUDA
+                if (batch.m_native) {
+                    batch.m_plan = CreateNativePlan(batch);
+                    continue;
+                }
+#endif
+                // The work arrays hold the transforms of all components contiguously
+                batch.m_plan = AnyFFT::CreatePlanMany1D(
+                    batch.m_n + 1, batch.m_howmany*batch.m_ncomp, 1, batch.m_n + 1,
+                    dst_plan.m_work_real->dataPtr(),
+                    reinterpret_cast<AnyFFT::Complex*>(dst_plan.m_work_complex->dataPtr()),
+                    AnyFFT::direction::R2C);
+            }
+        }
+
+        /** \brief Pre-twiddle: y_j = sin(pi*j/m)*(f_j + f_{m-j}) + (f_j - f_{m-j})/2 for the
+         * DST and y_j = (f_j + f_{m-j})/2 - sin(pi*j/m)*(f_j - f_{m-j}) for the cosine series,
+         * for j in [0, m), where m = n+1, f_j is element j-1 of the input and f_0 = f_m = 0.
+         *
+         * \param[in] batch batch of transforms
+         */
+        void PreTwiddle (DSTbatch const& batch)
+        {
+            HIPACE_PROFILE("AnyDST::PreTwiddle()");
+            using namespace amrex::literals;
+
+            const int n = batch.m_n;
+            const int m = n + 1;
+            const int stride = batch.m_stride;
+            const int dist = batch.m_dist;
+            const int howmany = batch.m_howmany;
+            const long comp_dist = batch.m_comp_dist;
+            amrex::Real const * const AMREX_RESTRICT in = batch.m_in;
+            amrex::Real * const AMREX_RESTRICT work = batch.m_plan.m_real_array;
+            const bool is_sine = batch.m_kind == kind::sine;
+
+            amrex::ParallelFor(
+                amrex::Box({0, 0, 0}, {m-1, howmany-1, batch.m_ncomp-1}),
+                [=] AMREX_GPU_DEVICE(int j, int b, int c)
+                {
+                    amrex::Real const * const f = in + b*dist + c*comp_dist;
+                    const amrex::Real fj = (j > 0) ? f[(j-1)*stride] : 0._rt;
+                    const amrex::Real fmj = (j > 0) ? f[(n-j)*stride] : 0._rt;
+                    const amrex::Real sj = std::sin(MathConst::pi*j/m);
+                    work[(c*howmany + b)*m + j] = is_sine ? sj*(fj + fmj) + 0.5_rt*(fj - fmj)
+                                                          : 0.5_rt*(fj + fmj) - sj*(fj - fmj);
+                }
+                );
+        }
+
+        /** \brief Post-twiddle: with Y_k the real FFT of the pre-twiddled data, the DST output
+         * is -2*Im(Y_k) for even output indices 2k, and a running sum of 2*Re(Y_k) for odd ones.
+         * The cosine series is 2*Re(Y_k) for even output indices, and for odd ones a running
+         * sum of -2*Im(Y_k) starting from the first output, computed directly.
+         *
+         * The running sums are parallel prefix sums over chunks of about sqrt(n) terms: the
+         * chunks are summed in parallel, the chunk sums are scanned for each transform, and
+         * each chunk is then scanned from its offset. The real work array, no longer needed
+         * after the FFT, holds the chunk sums.
+         *
+         * \param[in] batch batch of transforms
+         */
+        void PostTwiddle (DSTbatch const& batch)
+        {
+            HIPACE_PROFILE("AnyDST::PostTwiddle()");
+            using namespace amrex::literals;
+
+            const int n = batch.m_n;
+            const int m = n + 1;
+            const int mc = m/2 + 1;
+            const int howmany = batch.m_howmany;
+            const int ntransforms = howmany*batch.m_ncomp;
+            const int stride = batch.m_stride;
+            const int dist = batch.m_dist;
+            const long comp_dist = batch.m_comp_dist;
+            const bool is_sine = batch.m_kind == kind::sine;
+            amrex::GpuComplex<amrex::Real> const * const AMREX_RESTRICT work =
+                reinterpret_cast<amrex::GpuComplex<amrex::Real>*>(batch.m_plan.m_complex_array);
+            amrex::Real * const AMREX_RESTRICT chunk_sum = batch.m_plan.m_real_array;
+            // For the cosine series, the input is read again, so out must not be restricted
+            amrex::Real const * const in = batch.m_in;
+            amrex::Real * const out = batch.m_out;
+
+            // Output 2k-1 (0-based) is direct for k in [1, n/2], output 2k is the running sum
+            // up to term k, for k in [1, nsum]
+            const int nsum = (n-1)/2;
+            const int chunk = std::max(1, static_cast<int>(std::sqrt(amrex::Real(n))));
+            const int nchunks = (n/2 + chunk - 1)/chunk;
+            const int nsum_chunks = (nsum + chunk - 1)/chunk;
+            // Chunks of the direct sum giving the first output of the cosine series
+            const int nfirst_chunks = is_sine ? 0 : (n + chunk - 1)/chunk;
+            AMREX_ASSERT(nsum_chunks + nfirst_chunks <= m);
+
+            // Sum each chunk. This reads the input of the cosine series before it is overwritten.
+            if (nsum_chunks + nfirst_chunks > 0) {
+                amrex::ParallelFor(
+                    amrex::Box({0, 0, 0}, {nsum_chunks + nfirst_chunks - 1, ntransforms-1, 0}),
+                    [=] AMREX_GPU_DEVICE(int c, int b, int)
+                    {
+                        amrex::Real sum = 0._rt;
+                        if (c < nsum_chunks) {
+                            const int kstop = std::min((c+1)*chunk, nsum);
+                            for (int k = c*chunk + 1; k <= kstop; ++k) {
+                                sum += is_sine ? 2._rt*work[b*mc + k].real()
+                                               : -2._rt*work[b*mc + k].imag();
+                            }
+                        } else {
+                            amrex::Real const * const f =
+                                in + (b%howmany)*dist + (b/howmany)*comp_dist;
+                            const int jstart = (c - nsum_chunks)*chunk;
+                            const int jstop = std::min(jstart + chunk, n);
+                            for (int j = jstart; j < jstop; ++j) {
+                                sum += 2._rt*f[j*stride]
+                                    *std::cos(MathConst::pi*(j+1)/(n+1));
+                            }
+                        }
+                        chunk_sum[b*m + c] = sum;
+                    }
+                    );
+            }
+
+            // Write the first output, and replace the chunk sums by their exclusive prefix sum
+            // starting from it
+            amrex::ParallelFor(
+                ntransforms,
+                [=] AMREX_GPU_DEVICE(int b)
+                {
+                    amrex::Real * const cs = chunk_sum + b*m;
+                    amrex::Real running = 0._rt;
+                    if (is_sine) {
+                        running = work[b*mc].real();
+                    } else {
+                        for (int c = 0; c < nfirst_chunks; ++c) running += cs[nsum_chunks + c];
+                    }
+                    out[(b%howmany)*dist + (b/howmany)*comp_dist] = running;
+                    for (int c = 0; c < nsum_chunks; ++c) {
+                        const amrex::Real s = cs[c];
+                        cs[c] = running;
+                        running += s;
+                    }
+                }
+                );
+
+            // Scan each chunk from its offset, and write the direct outputs
+            if (nchunks > 0) {
+                amrex::ParallelFor(
+                    amrex::Box({0, 0, 0}, {nchunks-1, ntransforms-1, 0}),
+                    [=] AMREX_GPU_DEVICE(int c, int b, int)
+                    {
+                        amrex::GpuComplex<amrex::Real> const * const y = work + b*mc;
+                        amrex::Real * const o = out + (b%howmany)*dist + (b/howmany)*comp_dist;
+                        amrex::Real running = (c < nsum_chunks) ? chunk_sum[b*m + c] : 0._rt;
+                        const int kstop = std::min((c+1)*chunk, n/2);
+                        for (int k = c*chunk + 1; k <= kstop; ++k) {
+                            o[(2*k-1)*stride] = is_sine ? -2._rt*y[k].imag() : 2._rt*y[k].real();
+                            if (k <= nsum) {
+                                running += is_sine ? 2._rt*y[k].real() : -2._rt*y[k].imag();
+                                o[2*k*stride] = running;
+                            }
+                        }
+                    }
+                    );
+            }
+        }
+    }
+
+    DSTplan CreatePlan (const amrex::IntVect& real_size, amrex::FArrayBox* position_array,
+                        amrex::FArrayBox* fourier_array, const int ncomp)
+    {
+        HIPACE_PROFILE("AnyDST::CreatePlan()");
+        DSTplan dst_plan;
+        const int nx = real_size[0];
+        const int ny = real_size[1];
+
+        // Along x: rows are contiguous, and so are the components
+        AddBatch(dst_plan, nx, ny*ncomp, 1, nx,
+                 position_array->dataPtr(), fourier_array->dataPtr());
+        // Along y, in place on the Fourier array, one batch for all components
+        AddBatch(dst_plan, ny, nx, nx, 1, fourier_array->dataPtr(), fourier_array->dataPtr(),
+                 kind::sine, ncomp, fourier_array->box().numPts());
+        FinalizePlan(dst_plan);
+
+        // Store meta-data in dst_plan
+        dst_plan.m_position_array = position_array;
+        dst_plan.m_fourier_array = fourier_array;
+
+        return dst_plan;
+    }
+
+    DSTplan CreateGradientPlan (const amrex::IntVect& real_size, amrex::FArrayBox* fourier_array,
+                                amrex::FArrayBox* position_array)
+    {
+        HIPACE_PROFILE("AnyDST::CreateGradientPlan()");
+        DSTplan dst_plan;
+        const int nx = real_size[0];
+        const int ny = real_size[1];
+
+        // Along x: cosine series for the x-derivative (component 0), DST for component 1
+        AddBatch(dst_plan, nx, ny, 1, nx, fourier_array->dataPtr(0),
+                 position_array->dataPtr(0), kind::cosine);
+        AddBatch(dst_plan, nx, ny, 1, nx, fourier_array->dataPtr(1),
+                 position_array->dataPtr(1), kind::sine);
+        // Along y, in place on the position array
+        AddBatch(dst_plan, ny, nx, nx, 1, position_array->dataPtr(0),
+                 position_array->dataPtr(0), kind::sine);
+        AddBatch(dst_plan, ny, nx, nx, 1, position_array->dataPtr(1),
+                 position_array->dataPtr(1), kind::cosine);
+        FinalizePlan(dst_plan);
+
+        // Store meta-data in dst_plan
+        dst_plan.m_position_array = position_array;
+        dst_plan.m_fourier_array = fourier_array;
+
+        return dst_plan;
+    }
+
+    DSTplan CreatePlanMany1D (const int n, const int howmany, const int stride, const int dist,
+                              amrex::FArrayBox* position_array, amrex::FArrayBox* fourier_array,
+                              const int comp, const kind k, const int ncomp)
+    {
+        HIPACE_PROFILE("AnyDST::CreatePlanMany1D()");
+        DSTplan dst_plan;
+        AMREX_ALWAYS_ASSERT_WITH_MESSAGE(
+            ncomp == 1 || position_array->box().numPts() == fourier_array->box().numPts(),
+            "position and Fourier arrays must have the same box for several components");
+
+        AddBatch(dst_plan, n, howmany, stride, dist,
+                 position_array->dataPtr(comp), fourier_array->dataPtr(comp), k,
+                 ncomp, fourier_array->box().numPts());
+        FinalizePlan(dst_plan);
+
+        // Store meta-data in dst_plan
+        dst_plan.m_position_array = position_array;
+        dst_plan.m_fourier_array = fourier_array;
+
+        return dst_plan;
+    }
+
+    void DestroyPlan (DSTplan& dst_plan)
+    {
+        for (auto& batch : dst_plan.m_batches) {
+            AnyFFT::DestroyPlan(batch.m_plan);
+        }
+    }
+
+    void Execute (DSTplan& dst_plan){
+        HIPACE_PROFILE("AnyDST::Execute()");
+
+        for (auto& batch : dst_plan.m_batches) {
+            if (batch.m_native) {
+                AnyFFT::Execute(batch.m_plan);
+                continue;
+            }
+            PreTwiddle(batch);
+            AnyFFT::Execute(batch.m_plan);
+            PostTwiddle(batch);
+        }
+    }
+}
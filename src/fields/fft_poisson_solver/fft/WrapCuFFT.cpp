@@ -14,24 +14,28 @@ namespace AnyFFT
 #ifdef AMREX_USE_FLOAT
     cufftType VendorR2C = CUFFT_R2C;
     cufftType VendorC2R = CUFFT_C2R;
+    cufftType VendorC2C = CUFFT_C2C;
 #else
     cufftType VendorR2C = CUFFT_D2Z;
     cufftType VendorC2R = CUFFT_Z2D;
+    cufftType VendorC2C = CUFFT_Z2Z;
 #endif
 
     FFTplan CreatePlan (const amrex::IntVect& real_size, amrex::Real * const real_array,
-                        Complex * const complex_array, const direction dir)
+                        Complex * const complex_array, const direction dir, const int ncomp)
     {
         FFTplan fft_plan;
 
         // Initialize fft_plan.m_plan with the vendor fft plan.
+        // Components are contiguous in memory, so they are transformed as one batch.
+        int n[2] = {real_size[1], real_size[0]};
         cufftResult result;
         if (dir == direction::R2C){
-            result = cufftPlan2d(
-                &(fft_plan.m_plan), real_size[1], real_size[0], VendorR2C);
+            result = cufftPlanMany(
+                &(fft_plan.m_plan), 2, n, nullptr, 1, 0, nullptr, 1, 0, VendorR2C, ncomp);
         } else {
-            result = cufftPlan2d(
-                &(fft_plan.m_plan), real_size[1], real_size[0], VendorC2R);
+            result = cufftPlanMany(
+                &(fft_plan.m_plan), 2, n, nullptr, 1, 0, nullptr, 1, 0, VendorC2R, ncomp);
         }
 
         if ( result != CUFFT_SUCCESS ) {
@@ -47,6 +51,65 @@ namespace AnyFFT
         return fft_plan;
     }
 
+    FFTplan CreatePlanMany1D (const int n, const int howmany, const int stride, const int dist,
+                              amrex::Real * const real_array, Complex * const complex_array,
+                              const direction dir, const int ncomp, const long comp_dist)
+    {
+        AMREX_ALWAYS_ASSERT_WITH_MESSAGE(ncomp == 1 || dir == direction::C2C_forward ||
+                                         dir == direction::C2C_backward,
+                                         "only C2C batched FFTs can have several components");
+        FFTplan fft_plan;
+        int nn = n;
+        int n_real = n;
+        int n_complex = n/2 + 1;
+
+        // Initialize fft_plan.m_plan with the vendor fft plan.
+        // The embed arrays must be given for cuFFT to take stride and dist into account.
+        cufftResult result;
+        if (dir == direction::R2C){
+            AMREX_ALWAYS_ASSERT_WITH_MESSAGE(stride == 1, "R2C batched FFT must be contiguous");
+            result = cufftPlanMany(&(fft_plan.m_plan), 1, &nn, &n_real, 1, n_real,
+                                   &n_complex, 1, n_complex, VendorR2C, howmany);
+        } else if (dir == direction::C2R){
+            AMREX_ALWAYS_ASSERT_WITH_MESSAGE(stride == 1, "C2R batched FFT must be contiguous");
+            result = cufftPlanMany(&(fft_plan.m_plan), 1, &nn, &n_complex, 1, n_complex,
+                                   &n_real, 1, n_real, VendorC2R, howmany);
+        } else {
+            result = cufftPlanMany(&(fft_plan.m_plan), 1, &nn, &nn, stride, dist,
+                                   &nn, stride, dist, VendorC2C, howmany);
+        }
+
+        if ( result != CUFFT_SUCCESS ) {
+            amrex::Print() << " cufftplan failed! Error: " <<
+                CuFFTUtils::cufftErrorToString(result) << "\n";
+        }
+
+        // Store meta-data in fft_plan
+        fft_plan.m_real_array = real_array;
+        fft_plan.m_complex_array = complex_array;
+        fft_plan.m_dir = dir;
+        // cuFFT has a single batch dimension, so Execute launches the plan once per component
+        fft_plan.m_ncomp = ncomp;
+        fft_plan.m_comp_dist = comp_dist;
+
+        return fft_plan;
+    }
+
+    void SetPlanner (const planner /*plan_rigor*/)
+    {
+        // cuFFT has no planning rigor, nothing to do
+    }
+
+    void ImportWisdom (const std::string& /*filename*/)
+    {
+        // cuFFT has no wisdom, nothing to do
+    }
+
+    void ExportWisdom (const std::string& /*filename*/)
+    {
+        // cuFFT has no wisdom, nothing to do
+    }
+
     void DestroyPlan (FFTplan& fft_plan)
     {
         cufftDestroy( fft_plan.m_plan );
@@ -70,8 +133,21 @@ namespace AnyFFT
 #else
             result = cufftExecZ2D(fft_plan.m_plan, fft_plan.m_complex_array, fft_plan.m_real_array);
 #endif
+        } else if (fft_plan.m_dir == direction::C2C_forward ||
+                   fft_plan.m_dir == direction::C2C_backward){
+            const int sign = (fft_plan.m_dir == direction::C2C_forward) ?
+                CUFFT_FORWARD : CUFFT_INVERSE;
+            for (int icomp = 0; icomp < fft_plan.m_ncomp; ++icomp) {
+                Complex * const array = fft_plan.m_complex_array + icomp*fft_plan.m_comp_dist;
+#ifdef AMREX_USE_FLOAT
+                result = cufftExecC2C(fft_plan.m_plan, array, array, sign);
+#else
+                result = cufftExecZ2Z(fft_plan.m_plan, array, array, sign);
+#endif
+                if ( result != CUFFT_SUCCESS ) break;
+            }
         } else {
-            amrex::Abort("direction must be AnyFFT::direction::R2C or AnyFFT::direction::C2R");
+            amrex::Abort("direction must be AnyFFT::direction::R2C, C2R, C2C_forward or C2C_backward");
         }
         if ( result != CUFFT_SUCCESS ) {
             amrex::Print() << " forward transform using cufftExec failed ! Error: " <<
@@ -7,6 +7,11 @@
 #include "AnyFFT.H"
 #include "utils/HipaceProfilerWrapper.H"
 
+#include <AMReX_ParallelDescriptor.H>
+#include <AMReX_Print.H>
+
+#include <fstream>
+
 namespace AnyFFT
 {
 #ifdef AMREX_USE_FLOAT
@@ -14,26 +19,157 @@ namespace AnyFFT
     const auto VendorCreatePlanC2R3D = fftwf_plan_dft_c2r_3d;
     const auto VendorCreatePlanR2C2D = fftwf_plan_dft_r2c_2d;
     const auto VendorCreatePlanC2R2D = fftwf_plan_dft_c2r_2d;
+    const auto VendorCreatePlanManyR2C = fftwf_plan_many_dft_r2c;
+    const auto VendorCreatePlanManyC2R = fftwf_plan_many_dft_c2r;
+    const auto VendorCreatePlanManyC2C = fftwf_plan_many_dft;
+    const auto VendorCreatePlanGuruC2C = fftwf_plan_guru64_dft;
+    using VendorIODim = fftwf_iodim64;
 #else
     const auto VendorCreatePlanR2C3D = fftw_plan_dft_r2c_3d;
     const auto VendorCreatePlanC2R3D = fftw_plan_dft_c2r_3d;
     const auto VendorCreatePlanR2C2D = fftw_plan_dft_r2c_2d;
     const auto VendorCreatePlanC2R2D = fftw_plan_dft_c2r_2d;
+    const auto VendorCreatePlanManyR2C = fftw_plan_many_dft_r2c;
+    const auto VendorCreatePlanManyC2R = fftw_plan_many_dft_c2r;
+    const auto VendorCreatePlanManyC2C = fftw_plan_many_dft;
+    const auto VendorCreatePlanGuruC2C = fftw_plan_guru64_dft;
+    using VendorIODim = fftw_iodim64;
 #endif
 
+    namespace {
+        /** Planning rigor for all plans, set with SetPlanner */
+        planner s_planner = planner::estimate;
+    }
+
+    void SetPlanner (const planner plan_rigor)
+    {
+        s_planner = plan_rigor;
+    }
+
+    unsigned VendorPlannerFlag ()
+    {
+        switch (s_planner) {
+        case planner::measure:
+            return FFTW_MEASURE;
+        case planner::patient:
+            return FFTW_PATIENT;
+        default:
+            return FFTW_ESTIMATE;
+        }
+    }
+
+    void ImportWisdom (const std::string& filename)
+    {
+        // Only the I/O processor touches the file system, the content is broadcast.
+        int exists = 0;
+        if (amrex::ParallelDescriptor::IOProcessor()) {
+            exists = static_cast<bool>(std::ifstream(filename));
+        }
+        amrex::ParallelDescriptor::Bcast(&exists, 1,
+                                         amrex::ParallelDescriptor::IOProcessorNumber());
+        if (!exists) return;
+
+        amrex::Vector<char> wisdom;
+        amrex::ParallelDescriptor::ReadAndBcastFile(filename, wisdom);
+#  ifdef AMREX_USE_FLOAT
+        const int success = fftwf_import_wisdom_from_string(wisdom.dataPtr());
+#  else
+        const int success = fftw_import_wisdom_from_string(wisdom.dataPtr());
+#  endif
+        if (!success) {
+            amrex::Print() << "WARNING: could not import FFTW wisdom from " << filename << "\n";
+        }
+    }
+
+    void ExportWisdom (const std::string& filename)
+    {
+        if (!amrex::ParallelDescriptor::IOProcessor()) return;
+#  ifdef AMREX_USE_FLOAT
+        const int success = fftwf_export_wisdom_to_filename(filename.c_str());
+#  else
+        const int success = fftw_export_wisdom_to_filename(filename.c_str());
+#  endif
+        if (!success) {
+            amrex::Print() << "WARNING: could not export FFTW wisdom to " << filename << "\n";
+        }
+    }
+
     FFTplan CreatePlan (const amrex::IntVect& real_size, amrex::Real * const real_array,
-                        Complex * const complex_array, const direction dir)
+                        Complex * const complex_array, const direction dir, const int ncomp)
     {
         FFTplan fft_plan;
 
         // Initialize fft_plan.m_plan with the vendor fft plan.
         // Swap dimensions: AMReX FAB are Fortran-order but FFTW is C-order
-        if (dir == direction::R2C){
-            fft_plan.m_plan = VendorCreatePlanR2C2D(
-                    real_size[1], real_size[0], real_array, complex_array, FFTW_ESTIMATE);
+        if (ncomp == 1) {
+            if (dir == direction::R2C){
+                fft_plan.m_plan = VendorCreatePlanR2C2D(
+                    real_size[1], real_size[0], real_array, complex_array,
+                    VendorPlannerFlag());
+            } else if (dir == direction::C2R){
+                fft_plan.m_plan = VendorCreatePlanC2R2D(
+                    real_size[1], real_size[0], complex_array, real_array,
+                    VendorPlannerFlag());
+            }
+        } else {
+            // Components are contiguous in memory, so they are transformed as one batch.
+            const int n[2] = {real_size[1], real_size[0]};
+            const int real_dist = real_size[0]*real_size[1];
+            const int complex_dist = (real_size[0]/2+1)*real_size[1];
+            if (dir == direction::R2C){
+                fft_plan.m_plan = VendorCreatePlanManyR2C(
+                    2, n, ncomp, real_array, nullptr, 1, real_dist,
+                    complex_array, nullptr, 1, complex_dist, VendorPlannerFlag());
+            } else if (dir == direction::C2R){
+                fft_plan.m_plan = VendorCreatePlanManyC2R(
+                    2, n, ncomp, complex_array, nullptr, 1, complex_dist,
+                    real_array, nullptr, 1, real_dist, VendorPlannerFlag());
+            }
+        }
+
+        // Store meta-data in fft_plan
+        fft_plan.m_real_array = real_array;
+        fft_plan.m_complex_array = complex_array;
+        fft_plan.m_dir = dir;
+
+        return fft_plan;
+    }
+
+    FFTplan CreatePlanMany1D (const int n, const int howmany, const int stride, const int dist,
+                              amrex::Real * const real_array, Complex * const complex_array,
+                              const direction dir, const int ncomp, const long comp_dist)
+    {
+        FFTplan fft_plan;
+        const int nc = n/2 + 1;
+        AMREX_ALWAYS_ASSERT_WITH_MESSAGE(ncomp == 1 || dir == direction::C2C_forward ||
+                                         dir == direction::C2C_backward,
+                                         "only C2C batched FFTs can have several components");
+
+        // Initialize fft_plan.m_plan with the vendor fft plan.
+        if (ncomp > 1){
+            // The guru interface loops over the transforms and the components in one plan
+            const int sign = (dir == direction::C2C_forward) ? FFTW_FORWARD : FFTW_BACKWARD;
+            const VendorIODim dims[1] = {{n, stride, stride}};
+            const VendorIODim howmany_dims[2] = {{howmany, dist, dist},
+                                                 {ncomp, comp_dist, comp_dist}};
+            fft_plan.m_plan = VendorCreatePlanGuruC2C(
+                1, dims, 2, howmany_dims, complex_array, complex_array, sign,
+                VendorPlannerFlag());
+        } else if (dir == direction::R2C){
+            AMREX_ALWAYS_ASSERT_WITH_MESSAGE(stride == 1, "R2C batched FFT must be contiguous");
+            fft_plan.m_plan = VendorCreatePlanManyR2C(
+                1, &n, howmany, real_array, nullptr, 1, n,
+                complex_array, nullptr, 1, nc, VendorPlannerFlag());
         } else if (dir == direction::C2R){
-            fft_plan.m_plan = VendorCreatePlanC2R2D(
-                    real_size[1], real_size[0], complex_array, real_array, FFTW_ESTIMATE);
+            AMREX_ALWAYS_ASSERT_WITH_MESSAGE(stride == 1, "C2R batched FFT must be contiguous");
+            fft_plan.m_plan = VendorCreatePlanManyC2R(
+                1, &n, howmany, complex_array, nullptr, 1, nc,
+                real_array, nullptr, 1, n, VendorPlannerFlag());
+        } else {
+            const int sign = (dir == direction::C2C_forward) ? FFTW_FORWARD : FFTW_BACKWARD;
+            fft_plan.m_plan = VendorCreatePlanManyC2C(
+                1, &n, howmany, complex_array, nullptr, stride, dist,
+                complex_array, nullptr, stride, dist, sign, VendorPlannerFlag());
         }
 
         // Store meta-data in fft_plan
@@ -3,6 +3,9 @@
 #include "Hipace.H"
 #include "utils/HipaceProfilerWrapper.H"
 
+#include <algorithm>
+#include <cmath>
+
 void
 BeamParticleContainer::ReadParameters ()
 {
@@ -17,6 +20,20 @@ BeamParticleContainer::ReadParameters ()
     pp.query("dy_per_dzeta", m_dy_per_dzeta);
     pp.query("duz_per_uz0_dzeta", m_duz_per_uz0_dzeta);
     pp.query("do_z_push", m_do_z_push);
+    pp.query("max_substeps", m_max_substeps);
+    AMREX_ALWAYS_ASSERT_WITH_MESSAGE(m_max_substeps >= 1,
+        "The maximum number of sub-steps of the beam push must be at least 1");
+    pp.query("lazy_generation", m_lazy_generation);
+    if (m_lazy_generation) {
+        AMREX_ALWAYS_ASSERT_WITH_MESSAGE(
+            m_injection_type == "fixed_ppc" || m_injection_type == "fixed_weight",
+            "Generating the beam per box is only implemented for fixed_ppc and fixed_weight beams");
+        // FNV-1a hash of the name, so that each beam has its own random numbers
+        m_lazy_seed = 14695981039346656037ULL;
+        for (const char c : m_name) {
+            m_lazy_seed = (m_lazy_seed ^ static_cast<unsigned char>(c)) * 1099511628211ULL;
+        }
+    }
     if (m_injection_type == "fixed_ppc" || m_injection_type == "from_file"){
         AMREX_ALWAYS_ASSERT_WITH_MESSAGE( (m_dx_per_dzeta == 0.) && (m_dy_per_dzeta == 0.)
                                            && (m_duz_per_uz0_dzeta == 0.),
@@ -37,9 +54,19 @@ BeamParticleContainer::InitData (const amrex::Geometry& geom)
         pp.get("radius", m_radius);
         pp.query("min_density", m_min_density);
         const GetInitialDensity get_density(m_name);
+        if (m_lazy_generation) {
+            // The particles are generated per box, see InitDataDownToBox
+            m_total_num_particles = CountBeamFixedPPC(m_ppc, get_density, geom, m_zmin,
+                                                      m_zmax, m_radius, m_min_density);
+            const amrex::Real first_slice = std::floor(
+                (m_zmin - geom.ProbLo(Direction::z))/geom.CellSize(Direction::z));
+            m_lazy_first_slice = static_cast<int>(std::max(
+                first_slice, amrex::Real(geom.Domain().smallEnd(Direction::z))));
+            return;
+        }
         const GetInitialMomentum get_momentum(m_name);
         InitBeamFixedPPC(m_ppc, get_density, get_momentum, geom, m_zmin,
-                         m_zmax, m_radius, m_min_density);
+                         m_zmax, m_radius, m_min_density, geom.Domain());
 
     } else if (m_injection_type == "fixed_weight") {
 
@@ -72,6 +99,13 @@ BeamParticleContainer::InitData (const amrex::Geometry& geom)
             m_total_charge /= dx[0]*dx[1]*dx[2];
         }
 
+        if (m_lazy_generation) {
+            // The particles are generated per box, see InitDataDownToBox
+            m_total_num_particles = CountBeamFixedWeight(m_num_particles, m_position_mean,
+                                                         m_position_std, m_do_symmetrize, geom,
+                                                         m_lazy_first_slice);
+            return;
+        }
         const GetInitialMomentum get_momentum(m_name);
         InitBeamFixedWeight(m_num_particles, get_momentum, m_position_mean,
                             m_position_std, m_total_charge, m_do_symmetrize, m_dx_per_dzeta,
@@ -110,6 +144,30 @@ BeamParticleContainer::InitData (const amrex::Geometry& geom)
 
 }
 
+void
+BeamParticleContainer::InitDataDownToBox (const int ibox, const amrex::BoxArray& ba,
+                                          const amrex::Geometry& geom)
+{
+    if (!m_lazy_generation || !Hipace::HeadRank()) return;
+
+    // Boxes are reached from head to tail, so all boxes above m_lazy_lowest_box are generated
+    const int num_boxes = ba.size();
+    for (int jbox = std::min(m_lazy_lowest_box, num_boxes)-1; jbox >= ibox; --jbox) {
+        if (m_injection_type == "fixed_ppc") {
+            const GetInitialDensity get_density(m_name);
+            const GetInitialMomentum get_momentum(m_name);
+            InitBeamFixedPPC(m_ppc, get_density, get_momentum, geom, m_zmin,
+                             m_zmax, m_radius, m_min_density, ba[jbox], true);
+        } else {
+            const GetInitialMomentum get_momentum(m_name);
+            InitBeamFixedWeightSlices(m_num_particles, get_momentum, m_position_mean,
+                                      m_position_std, m_total_charge, m_do_symmetrize,
+                                      m_dx_per_dzeta, m_dy_per_dzeta, geom, ba[jbox]);
+        }
+    }
+    m_lazy_lowest_box = std::min(m_lazy_lowest_box, ibox);
+}
+
 amrex::Long BeamParticleContainer::TotalNumberOfParticles (bool only_valid, bool only_local) const
 {
     amrex::Long nparticles = 0;
@@ -118,13 +176,12 @@ amrex::Long BeamParticleContainer::TotalNumberOfParticles (bool only_valid, bool
         amrex::ReduceData<unsigned long long> reduce_data(reduce_op);
         using ReduceTuple = typename decltype(reduce_data)::Type;
 
-        auto const& ptaos = this->GetArrayOfStructs();
-        ParticleType const* pp = ptaos().data();
+        int const * const idp = m_soa.GetIntData(BeamIdx::id).data();
 
-        reduce_op.eval(ptaos.numParticles(), reduce_data,
+        reduce_op.eval(numParticles(), reduce_data,
                        [=] AMREX_GPU_DEVICE (int i) -> ReduceTuple
                        {
-                           return (pp[i].id() > 0) ? 1 : 0;
+                           return (idp[i] > 0) ? 1 : 0;
                        });
         nparticles = static_cast<amrex::Long>(amrex::get<0>(reduce_data.value()));
     }
@@ -138,3 +195,47 @@ amrex::Long BeamParticleContainer::TotalNumberOfParticles (bool only_valid, bool
 
     return nparticles;
 }
+
+void
+BeamParticleContainer::PackParticles (char* buffer, const int np, const int offset,
+                                      unsigned int const* indices)
+{
+    HIPACE_PROFILE("BeamParticleContainer::PackParticles()");
+
+    const BeamTileData ptd = getBeamTileData();
+    amrex::ParticleReal * const AMREX_RESTRICT rbuf = (amrex::ParticleReal*) buffer;
+    int * const AMREX_RESTRICT ibuf = (int*) (rbuf + BeamIdx::real_nattribs*np);
+
+    // Consecutive particles are read and written contiguously, for each attribute
+    amrex::ParallelFor(np, [=] AMREX_GPU_DEVICE (long i) {
+        const int ip = offset + (indices ? indices[i] : i);
+        for (int n = 0; n < BeamIdx::real_nattribs; ++n) {
+            rbuf[n*np+i] = ptd.m_rdata[n][ip];
+        }
+        for (int n = 0; n < BeamIdx::int_nattribs; ++n) {
+            ibuf[n*np+i] = ptd.m_idata[n][ip];
+        }
+    });
+}
+
+void
+BeamParticleContainer::UnpackParticles (char const* buffer, const int np)
+{
+    HIPACE_PROFILE("BeamParticleContainer::UnpackParticles()");
+
+    const int old_size = numParticles();
+    resize(old_size + np);
+
+    const BeamTileData ptd = getBeamTileData();
+    amrex::ParticleReal const * const AMREX_RESTRICT rbuf = (amrex::ParticleReal const*) buffer;
+    int const * const AMREX_RESTRICT ibuf = (int const*) (rbuf + BeamIdx::real_nattribs*np);
+
+    amrex::ParallelFor(np, [=] AMREX_GPU_DEVICE (long i) {
+        for (int n = 0; n < BeamIdx::real_nattribs; ++n) {
+            ptd.m_rdata[n][old_size+i] = rbuf[n*np+i];
+        }
+        for (int n = 0; n < BeamIdx::int_nattribs; ++n) {
+            ptd.m_idata[n][old_size+i] = ibuf[n*np+i];
+        }
+    });
+}
@@ -5,6 +5,8 @@
 #include "utils/HipaceProfilerWrapper.H"
 #include <AMReX_REAL.H>
 
+#include <cmath>
+
 #ifdef HIPACE_USE_OPENPMD
 #include <openPMD/openPMD.hpp>
 #include <iostream> // std::cout
@@ -17,8 +19,7 @@ namespace
 {
     /** \brief Adds a single beam particle
      *
-     * \param[in,out] pstruct array with AoS beam data
-     * \param[in,out] arrdata array with SoA beam data
+     * \param[in,out] ptd pointers to the beam data
      * \param[in] x position in x
      * \param[in] y position in y
      * \param[in] z position in z
@@ -27,31 +28,84 @@ namespace
      * \param[in] uz momentum in z
      * \param[in] weight weight of the single particle
      * \param[in] pid particle ID to be assigned to the particle
-     * \param[in] procID processor ID to be assigned to the particle
      * \param[in] ip index of the particle
      * \param[in] speed_of_light speed of light in SI units
      */
     AMREX_GPU_HOST_DEVICE AMREX_FORCE_INLINE
     void AddOneBeamParticle (
-        BeamParticleContainer::ParticleType* pstruct,
-        amrex::GpuArray<amrex::ParticleReal*, BeamIdx::nattribs> arrdata, const amrex::Real& x,
+        const BeamTileData& ptd, const amrex::Real& x,
         const amrex::Real& y, const amrex::Real& z, const amrex::Real& ux, const amrex::Real& uy,
-        const amrex::Real& uz, const amrex::Real& weight, const int& pid, const int& procID,
+        const amrex::Real& uz, const amrex::Real& weight, const int& pid,
         const int& ip, const amrex::Real& speed_of_light) noexcept
     {
-        BeamParticleContainer::ParticleType& p = pstruct[ip];
-        // Set particle AoS
-        p.id()   = pid + ip;
-        p.cpu()  = procID;
-        p.pos(0) = x;
-        p.pos(1) = y;
-        p.pos(2) = z;
-
-        // Set particle SoA
-        arrdata[BeamIdx::ux  ][ip] = ux * speed_of_light;
-        arrdata[BeamIdx::uy  ][ip] = uy * speed_of_light;
-        arrdata[BeamIdx::uz  ][ip] = uz * speed_of_light;
-        arrdata[BeamIdx::w][ip] = weight;
+        ptd.m_idata[BeamIdx::id][ip] = pid + ip;
+        ptd.m_rdata[BeamIdx::x ][ip] = x;
+        ptd.m_rdata[BeamIdx::y ][ip] = y;
+        ptd.m_rdata[BeamIdx::z ][ip] = z;
+        ptd.m_rdata[BeamIdx::ux][ip] = ux * speed_of_light;
+        ptd.m_rdata[BeamIdx::uy][ip] = uy * speed_of_light;
+        ptd.m_rdata[BeamIdx::uz][ip] = uz * speed_of_light;
+        ptd.m_rdata[BeamIdx::w ][ip] = weight;
+    }
+
+    /** \brief Position of particle i_part of cell (i,j,k) of a beam with a fix number of
+     * particles per cell, and whether this particle is injected
+     *
+     * \param[out] x position in x
+     * \param[out] y position in y
+     * \param[out] z position in z
+     * \param[out] density beam density at the particle position
+     * \param[in] i cell index in x
+     * \param[in] j cell index in y
+     * \param[in] k cell index in z
+     * \param[in] i_part index of the particle in the cell
+     * \param[in] ppc_cr number of particles per cell in each direction
+     * \param[in] plo lower corner of the domain
+     * \param[in] dx cell size
+     * \param[in] zmin minimum z position of the particles
+     * \param[in] zmax maximum z position of the particles
+     * \param[in] radius maximum transverse distance of the particles to the axis
+     * \param[in] get_density density profile of the beam
+     * \param[in] min_density minimum density at which particles are injected
+     */
+    AMREX_GPU_HOST_DEVICE AMREX_FORCE_INLINE
+    bool FixedPPCParticle (
+        amrex::Real& x, amrex::Real& y, amrex::Real& z, amrex::Real& density,
+        const int i, const int j, const int k, const int i_part, const amrex::IntVect& ppc_cr,
+        const amrex::GpuArray<amrex::Real, AMREX_SPACEDIM>& plo,
+        const amrex::GpuArray<amrex::Real, AMREX_SPACEDIM>& dx, const amrex::Real zmin,
+        const amrex::Real zmax, const amrex::Real radius, const GetInitialDensity& get_density,
+        const amrex::Real min_density) noexcept
+    {
+        amrex::Real r[3] = {0.,0.,0.};
+
+        ParticleUtil::get_position_unit_cell(r, ppc_cr, i_part);
+
+        density = 0.;
+        x = plo[0] + (i + r[0])*dx[0];
+        y = plo[1] + (j + r[1])*dx[1];
+        z = plo[2] + (k + r[2])*dx[2];
+
+        if (z >= zmax || z < zmin || (x*x+y*y) > radius*radius) return false;
+
+        density = get_density(x, y, z);
+        return density >= min_density;
+    }
+
+    /** \brief Number of particles of a fixed-weight Gaussian beam below z, rounded down.
+     * The difference between two values is the number of particles in between.
+     *
+     * \param[in] num_particles total number of particles
+     * \param[in] mean mean position in z
+     * \param[in] std width in z
+     * \param[in] z position in z
+     */
+    amrex::Long NumFixedWeightParticlesBelow (const int num_particles, const amrex::Real mean,
+                                              const amrex::Real std, const amrex::Real z)
+    {
+        const double cdf = std == 0. ? (z > mean ? 1. : 0.)
+                                     : 0.5*(1. + std::erf((z - mean)/(std*std::sqrt(2.))));
+        return static_cast<amrex::Long>(std::floor(num_particles*cdf));
     }
 }
 
@@ -64,7 +118,9 @@ InitBeamFixedPPC (const amrex::IntVect& a_num_particles_per_cell,
                   const amrex::Real a_zmin,
                   const amrex::Real a_zmax,
                   const amrex::Real a_radius,
-                  const amrex::Real a_min_density)
+                  const amrex::Real a_min_density,
+                  const amrex::Box& a_slices,
+                  const bool a_counter_rng)
 {
     HIPACE_PROFILE("BeamParticleContainer::InitParticles");
 
@@ -96,8 +152,10 @@ InitBeamFixedPPC (const amrex::IntVect& a_num_particles_per_cell,
     const amrex::Real scale_fac = Hipace::m_normalized_units ?
         1./num_ppc*cr[0]*cr[1]*cr[2] : dx[0]*dx[1]*dx[2]/num_ppc;
 
-    // First: loop over all cells, and count the particles effectively injected.
+    // First: loop over all cells of the slices, and count the particles effectively injected.
     amrex::Box domain_box = a_geom.Domain();
+    domain_box.setRange(Direction::z, a_slices.smallEnd(Direction::z),
+                        a_slices.length(Direction::z));
     domain_box.coarsen(cr);
     const auto lo = amrex::lbound(domain_box);
     const auto hi = amrex::ubound(domain_box);
@@ -113,19 +171,11 @@ InitBeamFixedPPC (const amrex::IntVect& a_num_particles_per_cell,
         {
             for (int i_part=0; i_part<num_ppc;i_part++)
             {
-                amrex::Real r[3];
-
-                ParticleUtil::get_position_unit_cell(r, ppc_cr, i_part);
-
-                amrex::Real x = plo[0] + (i + r[0])*dx[0];
-                amrex::Real y = plo[1] + (j + r[1])*dx[1];
-                amrex::Real z = plo[2] + (k + r[2])*dx[2];
-
-                if (z >= a_zmax || z < a_zmin ||
-                    (x*x+y*y) > a_radius*a_radius) continue;
-
-                const amrex::Real density = get_density(x, y, z);
-                if (density < a_min_density) continue;
+                amrex::Real x, y, z, density;
+                if (!FixedPPCParticle(x, y, z, density, i, j, k, i_part, ppc_cr, plo, dx,
+                                      a_zmin, a_zmax, a_radius, get_density, a_min_density)) {
+                    continue;
+                }
 
                 int ix = i - lo.x;
                 int iy = j - lo.y;
@@ -146,23 +196,20 @@ InitBeamFixedPPC (const amrex::IntVect& a_num_particles_per_cell,
         // Second: allocate the memory for these particles
         auto& particle_tile = *this;
 
-        auto old_size = particle_tile.GetArrayOfStructs().size();
+        auto old_size = particle_tile.numParticles();
         auto new_size = old_size + num_to_add;
         particle_tile.resize(new_size);
 
         if (num_to_add == 0) return;
 
         // Third: Actually initialize the particles at the right locations
-        ParticleType* pstruct = particle_tile.GetArrayOfStructs()().data();
-
-        amrex::GpuArray<amrex::ParticleReal*, BeamIdx::nattribs> arrdata =
-            particle_tile.GetStructOfArrays().realarray();
+        const BeamTileData ptd = particle_tile.getBeamTileData(old_size);
 
-        int procID = amrex::ParallelDescriptor::MyProc();
-        int pid = ParticleType::NextID();
-        ParticleType::NextID(pid + num_to_add);
+        int pid = amrex::Particle<0,0>::NextID();
+        amrex::Particle<0,0>::NextID(pid + num_to_add);
 
         PhysConst phys_const = get_phys_const();
+        const std::uint64_t seed = m_lazy_seed;
 
         amrex::ParallelFor(domain_box,
         [=] AMREX_GPU_DEVICE (int i, int j, int k) noexcept
@@ -180,32 +227,81 @@ InitBeamFixedPPC (const amrex::IntVect& a_num_particles_per_cell,
 
             int pidx = int(poffset[cellid] - poffset[0]);
 
+            // One random stream per slice, one key per particle of the slice
+            const std::uint64_t slice_key = ParticleUtil::hash_combine(seed, k);
+            const std::uint64_t cell_index = (uix * ny + uiy) * std::uint64_t(num_ppc);
+
             for (int i_part=0; i_part<num_ppc;i_part++)
             {
-                amrex::Real r[3] = {0.,0.,0.};
+                amrex::Real x, y, z, density;
+                if (!FixedPPCParticle(x, y, z, density, i, j, k, i_part, ppc_cr, plo, dx,
+                                      a_zmin, a_zmax, a_radius, get_density, a_min_density)) {
+                    continue;
+                }
 
-                ParticleUtil::get_position_unit_cell(r, ppc_cr, i_part);
+                amrex::Real u[3] = {0.,0.,0.};
+                if (a_counter_rng) {
+                    const std::uint64_t key =
+                        ParticleUtil::hash_combine(slice_key, cell_index + i_part);
+                    get_momentum(u[0],u[1],u[2], key, 0, 0., 0.);
+                } else {
+                    get_momentum(u[0],u[1],u[2]);
+                }
 
-                amrex::Real x = plo[0] + (i + r[0])*dx[0];
-                amrex::Real y = plo[1] + (j + r[1])*dx[1];
-                amrex::Real z = plo[2] + (k + r[2])*dx[2];
+                const amrex::Real weight = density * scale_fac;
+                AddOneBeamParticle(ptd, x, y, z, u[0], u[1], u[2], weight,
+                                   pid, pidx, phys_const.c);
 
-                if (z >= a_zmax || z < a_zmin ||
-                    (x*x+y*y) > a_radius*a_radius) continue;
+                ++pidx;
+            }
+        });
+}
 
-                const amrex::Real density = get_density(x, y, z);
-                if (density < a_min_density) continue;
+amrex::Long
+BeamParticleContainer::
+CountBeamFixedPPC (const amrex::IntVect& a_num_particles_per_cell,
+                   const GetInitialDensity& get_density,
+                   const amrex::Geometry& a_geom,
+                   const amrex::Real a_zmin,
+                   const amrex::Real a_zmax,
+                   const amrex::Real a_radius,
+                   const amrex::Real a_min_density)
+{
+    HIPACE_PROFILE("BeamParticleContainer::CountBeamFixedPPC()");
 
-                amrex::Real u[3] = {0.,0.,0.};
-                get_momentum(u[0],u[1],u[2]);
+    // Same coarsened grid as in InitBeamFixedPPC
+    amrex::IntVect cr {Hipace::m_beam_injection_cr,Hipace::m_beam_injection_cr,1};
+    auto dx = a_geom.CellSizeArray();
+    for (int i=0; i<AMREX_SPACEDIM; i++) dx[i] *= cr[i];
+    const auto plo = a_geom.ProbLoArray();
 
-                const amrex::Real weight = density * scale_fac;
-                AddOneBeamParticle(pstruct, arrdata, x, y, z, u[0], u[1], u[2], weight,
-                                   pid, procID, pidx, phys_const.c);
+    amrex::IntVect ppc_cr = a_num_particles_per_cell;
+    for (int i=0; i<AMREX_SPACEDIM; i++) ppc_cr[i] *= cr[i];
 
-                ++pidx;
+    const int num_ppc = AMREX_D_TERM( ppc_cr[0], *ppc_cr[1], *ppc_cr[2]);
+
+    amrex::Box domain_box = a_geom.Domain();
+    domain_box.coarsen(cr);
+
+    amrex::ReduceOps<amrex::ReduceOpSum> reduce_op;
+    amrex::ReduceData<unsigned long long> reduce_data(reduce_op);
+    using ReduceTuple = typename decltype(reduce_data)::Type;
+
+    reduce_op.eval(domain_box, reduce_data,
+        [=] AMREX_GPU_DEVICE (int i, int j, int k) -> ReduceTuple
+        {
+            unsigned long long count = 0;
+            for (int i_part=0; i_part<num_ppc;i_part++)
+            {
+                amrex::Real x, y, z, density;
+                if (FixedPPCParticle(x, y, z, density, i, j, k, i_part, ppc_cr, plo, dx,
+                                     a_zmin, a_zmax, a_radius, get_density, a_min_density)) {
+                    ++count;
+                }
             }
+            return count;
         });
+    return static_cast<amrex::Long>(amrex::get<0>(reduce_data.value()));
 }
 
 void
@@ -229,18 +325,15 @@ InitBeamFixedWeight (int num_to_add,
     if (Hipace::HeadRank()) {
 
         auto& particle_tile = *this;
-        auto old_size = particle_tile.GetArrayOfStructs().size();
+        auto old_size = particle_tile.numParticles();
         auto new_size = do_symmetrize? old_size + 4*num_to_add : old_size + num_to_add;
         particle_tile.resize(new_size);
 
-        // Access particles' AoS and SoA
-        ParticleType* pstruct = particle_tile.GetArrayOfStructs()().data();
-        amrex::GpuArray<amrex::ParticleReal*, BeamIdx::nattribs> arrdata =
-            particle_tile.GetStructOfArrays().realarray();
+        // Access particles' SoA
+        const BeamTileData ptd = particle_tile.getBeamTileData();
 
-        const int procID = amrex::ParallelDescriptor::MyProc();
-        const int pid = ParticleType::NextID();
-        ParticleType::NextID(pid + num_to_add);
+        const int pid = amrex::Particle<0,0>::NextID();
+        amrex::Particle<0,0>::NextID(pid + num_to_add);
 
         const amrex::Real duz_per_uz0_dzeta = m_duz_per_uz0_dzeta;
         amrex::ParallelFor(
@@ -259,23 +352,23 @@ InitBeamFixedWeight (int num_to_add,
                 amrex::Real weight = total_charge / num_to_add / phys_const.q_e;
                 if (!do_symmetrize)
                 {
-                    AddOneBeamParticle(pstruct, arrdata, cental_x_pos+x, cental_y_pos+y,
+                    AddOneBeamParticle(ptd, cental_x_pos+x, cental_y_pos+y,
                                        pos_mean[2]+z, u[0], u[1], u[2], weight,
-                                       pid, procID, i, phys_const.c);
+                                       pid, i, phys_const.c);
                 } else {
                     weight /= 4;
-                    AddOneBeamParticle(pstruct, arrdata, cental_x_pos+x, cental_y_pos+y,
+                    AddOneBeamParticle(ptd, cental_x_pos+x, cental_y_pos+y,
                                        pos_mean[2]+z, u[0], u[1], u[2], weight,
-                                       pid, procID, 4*i, phys_const.c);
-                    AddOneBeamParticle(pstruct, arrdata, cental_x_pos-x, cental_y_pos+y,
+                                       pid, 4*i, phys_const.c);
+                    AddOneBeamParticle(ptd, cental_x_pos-x, cental_y_pos+y,
                                        pos_mean[2]+z, -u[0], u[1], u[2], weight,
-                                       pid, procID, 4*i+1, phys_const.c);
-                    AddOneBeamParticle(pstruct, arrdata, cental_x_pos+x, cental_y_pos-y,
+                                       pid, 4*i+1, phys_const.c);
+                    AddOneBeamParticle(ptd, cental_x_pos+x, cental_y_pos-y,
                                        pos_mean[2]+z, u[0], -u[1], u[2], weight,
-                                       pid, procID, 4*i+2, phys_const.c);
-                    AddOneBeamParticle(pstruct, arrdata, cental_x_pos-x, cental_y_pos-y,
+                                       pid, 4*i+2, phys_const.c);
+                    AddOneBeamParticle(ptd, cental_x_pos-x, cental_y_pos-y,
                                        pos_mean[2]+z, -u[0], -u[1], u[2], weight,
-                                       pid, procID, 4*i+3, phys_const.c);
+                                       pid, 4*i+3, phys_const.c);
                 }
             });
     }
@@ -283,6 +376,177 @@ InitBeamFixedWeight (int num_to_add,
     return;
 }
 
+void
+BeamParticleContainer::
+InitBeamFixedWeightSlices (int num_to_add,
+                           const GetInitialMomentum& get_momentum,
+                           const amrex::RealVect pos_mean,
+                           const amrex::RealVect pos_std,
+                           const amrex::Real total_charge,
+                           const bool do_symmetrize,
+                           const amrex::Real dx_per_dzeta,
+                           const amrex::Real dy_per_dzeta,
+                           const amrex::Geometry& a_geom,
+                           const amrex::Box& a_slices)
+{
+    HIPACE_PROFILE("BeamParticleContainer::InitParticles");
+    using namespace amrex::literals;
+
+    if (num_to_add == 0 || !Hipace::HeadRank()) return;
+    if (do_symmetrize) num_to_add /=4;
+
+    // Number of particles (groups of 4 particles if symmetrized) in each slice, from the
+    // cumulative distribution of the Gaussian profile in z
+    const int slice_lo = a_slices.smallEnd(Direction::z);
+    const int nslices = a_slices.length(Direction::z);
+    const amrex::Real plo_z = a_geom.ProbLo(Direction::z);
+    const amrex::Real dz = a_geom.CellSize(Direction::z);
+    amrex::Vector<int> h_slice_offsets(nslices+1);
+    const amrex::Long num_below = NumFixedWeightParticlesBelow(num_to_add, pos_mean[2],
+                                                               pos_std[2], plo_z + slice_lo*dz);
+    for (int islice = 0; islice <= nslices; ++islice) {
+        h_slice_offsets[islice] = static_cast<int>(NumFixedWeightParticlesBelow(
+            num_to_add, pos_mean[2], pos_std[2], plo_z + (slice_lo+islice)*dz) - num_below);
+    }
+    const int num_in_slices = h_slice_offsets[nslices];
+    if (num_in_slices == 0) return;
+
+    amrex::Gpu::DeviceVector<int> slice_offsets(nslices+1);
+    amrex::Gpu::copyAsync(amrex::Gpu::hostToDevice, h_slice_offsets.begin(),
+                          h_slice_offsets.end(), slice_offsets.begin());
+    const int* const p_slice_offsets = slice_offsets.dataPtr();
+
+    auto& particle_tile = *this;
+    auto old_size = particle_tile.numParticles();
+    const int nsym = do_symmetrize ? 4 : 1;
+    particle_tile.resize(old_size + nsym*num_in_slices);
+
+    const BeamTileData ptd = particle_tile.getBeamTileData(old_size);
+
+    const int pid = amrex::Particle<0,0>::NextID();
+    amrex::Particle<0,0>::NextID(pid + nsym*num_in_slices);
+
+    PhysConst phys_const = get_phys_const();
+    const std::uint64_t seed = m_lazy_seed;
+    const amrex::Real duz_per_uz0_dzeta = m_duz_per_uz0_dzeta;
+    const amrex::Real weight = total_charge / num_to_add / phys_const.q_e / nsym;
+
+    amrex::ParallelFor(
+        num_in_slices,
+        [=] AMREX_GPU_DEVICE (int i) noexcept
+        {
+            // Find the slice of particle i, and its index in this slice
+            int islice = 0;
+            int ihi = nslices;
+            while (ihi - islice > 1) {
+                const int imid = (islice + ihi)/2;
+                if (p_slice_offsets[imid] <= i) islice = imid; else ihi = imid;
+            }
+            // One random stream per slice, one key per particle of the slice
+            const std::uint64_t key = ParticleUtil::hash_combine(
+                ParticleUtil::hash_combine(seed, slice_lo + islice), i - p_slice_offsets[islice]);
+
+            // Normal random numbers 0 and 1 are x and y, 2 to 4 the momentum. z is drawn in the
+            // slice by rejection sampling, with the uniform random numbers from 10 onwards.
+            const amrex::Real zlo = plo_z + (slice_lo + islice)*dz - pos_mean[2];
+            amrex::Real z = 0.;
+            if (pos_std[2] > 0.) {
+                const amrex::Real zpeak = amrex::min(amrex::max(0._rt, zlo), zlo + dz);
+                constexpr int max_tries = 32;
+                bool accepted = false;
+                for (int itry = 0; itry < max_tries && !accepted; ++itry) {
+                    z = zlo + dz*(1._rt - ParticleUtil::counter_random_uniform(key, 10+2*itry));
+                    const amrex::Real ratio = std::exp(
+                        (zpeak*zpeak - z*z)/(2._rt*pos_std[2]*pos_std[2]));
+                    accepted = ParticleUtil::counter_random_uniform(key, 11+2*itry) <= ratio;
+                }
+                if (!accepted) {
+                    // Fall back to the inverse of the cumulative distribution, by bisection.
+                    // Slices above the peak are mirrored below it, where the cumulative
+                    // distribution 0.5*erfc(-t/(std*sqrt(2))) is accurate in the tail.
+                    const bool mirror = zlo > 0._rt;
+                    const amrex::Real a = mirror ? -(zlo + dz) : zlo;
+                    const amrex::Real inv_norm = 1._rt/(pos_std[2]*std::sqrt(2._rt));
+                    const amrex::Real cdf_a = 0.5_rt*std::erfc(-a*inv_norm);
+                    const amrex::Real cdf_b = 0.5_rt*std::erfc(-(a + dz)*inv_norm);
+                    const amrex::Real u =
+                        ParticleUtil::counter_random_uniform(key, 10+2*max_tries);
+                    amrex::Real t = a + dz*u;
+                    if (cdf_b > cdf_a) {
+                        const amrex::Real target = cdf_a + (cdf_b - cdf_a)*u;
+                        amrex::Real tlo = a;
+                        amrex::Real thi = a + dz;
+                        for (int it = 0; it < 50; ++it) {
+                            t = 0.5_rt*(tlo + thi);
+                            if (0.5_rt*std::erfc(-t*inv_norm) < target) tlo = t; else thi = t;
+                        }
+                    }
+                    z = mirror ? -t : t;
+                }
+            }
+            const amrex::Real x = ParticleUtil::counter_random_normal(key, 0, 0., pos_std[0]);
+            const amrex::Real y = ParticleUtil::counter_random_normal(key, 1, 0., pos_std[1]);
+            amrex::Real u[3] = {0.,0.,0.};
+            get_momentum(u[0],u[1],u[2], key, 2, z, duz_per_uz0_dzeta);
+
+            const amrex::Real cental_x_pos = pos_mean[0] + z*dx_per_dzeta;
+            const amrex::Real cental_y_pos = pos_mean[1] + z*dy_per_dzeta;
+
+            if (!do_symmetrize)
+            {
+                AddOneBeamParticle(ptd, cental_x_pos+x, cental_y_pos+y,
+                                   pos_mean[2]+z, u[0], u[1], u[2], weight,
+                                   pid, i, phys_const.c);
+            } else {
+                AddOneBeamParticle(ptd, cental_x_pos+x, cental_y_pos+y,
+                                   pos_mean[2]+z, u[0], u[1], u[2], weight,
+                                   pid, 4*i, phys_const.c);
+                AddOneBeamParticle(ptd, cental_x_pos-x, cental_y_pos+y,
+                                   pos_mean[2]+z, -u[0], u[1], u[2], weight,
+                                   pid, 4*i+1, phys_const.c);
+                AddOneBeamParticle(ptd, cental_x_pos+x, cental_y_pos-y,
+                                   pos_mean[2]+z, u[0], -u[1], u[2], weight,
+                                   pid, 4*i+2, phys_const.c);
+                AddOneBeamParticle(ptd, cental_x_pos-x, cental_y_pos-y,
+                                   pos_mean[2]+z, -u[0], -u[1], u[2], weight,
+                                   pid, 4*i+3, phys_const.c);
+            }
+        });
+    amrex::Gpu::streamSynchronize();
+}
+
+amrex::Long
+BeamParticleContainer::
+CountBeamFixedWeight (int num_to_add,
+                      const amrex::RealVect pos_mean,
+                      const amrex::RealVect pos_std,
+                      const bool do_symmetrize,
+                      const amrex::Geometry& a_geom,
+                      int& a_first_slice)
+{
+    if (do_symmetrize) num_to_add /=4;
+
+    const amrex::Box& domain = a_geom.Domain();
+    const amrex::Real plo_z = a_geom.ProbLo(Direction::z);
+    const amrex::Real dz = a_geom.CellSize(Direction::z);
+    auto num_below = [&] (const int islice) {
+        return NumFixedWeightParticlesBelow(num_to_add, pos_mean[2], pos_std[2],
+                                            plo_z + islice*dz);
+    };
+
+    a_first_slice = std::numeric_limits<int>::max();
+    for (int islice = domain.smallEnd(Direction::z); islice <= domain.bigEnd(Direction::z);
+         ++islice) {
+        if (num_below(islice+1) > num_below(islice)) {
+            a_first_slice = islice;
+            break;
+        }
+    }
+    const amrex::Long num_in_domain = num_below(domain.bigEnd(Direction::z)+1)
+                                      - num_below(domain.smallEnd(Direction::z));
+    return do_symmetrize ? 4*num_in_domain : num_in_domain;
+}
+
 #ifdef HIPACE_USE_OPENPMD
 void
 BeamParticleContainer::
@@ -645,19 +909,16 @@ InitBeamFromFile (const std::string input_file,
     if (Hipace::HeadRank()) {
 
         auto& particle_tile = *this;
-        auto old_size = particle_tile.GetArrayOfStructs().size();
+        auto old_size = particle_tile.numParticles();
         auto new_size = old_size + num_to_add;
         particle_tile.resize(new_size);
-        ParticleType* pstruct = particle_tile.GetArrayOfStructs()().data();
-        amrex::GpuArray<amrex::ParticleReal*, BeamIdx::nattribs> arrdata =
-            particle_tile.GetStructOfArrays().realarray();
-        const int procID = amrex::ParallelDescriptor::MyProc();
-        const int pid = ParticleType::NextID();
-        ParticleType::NextID(pid + num_to_add);
+        const BeamTileData ptd = particle_tile.getBeamTileData();
+        const int pid = amrex::Particle<0,0>::NextID();
+        amrex::Particle<0,0>::NextID(pid + num_to_add);
 
         for( int i=0; i < num_to_add; ++i)
         {
-            AddOneBeamParticle(pstruct, arrdata,
+            AddOneBeamParticle(ptd,
                                (amrex::Real)(r_x_data.get()[i] * unit_rx),
                                (amrex::Real)(r_y_data.get()[i] * unit_ry),
                                (amrex::Real)(r_z_data.get()[i] * unit_rz),
@@ -665,7 +926,7 @@ InitBeamFromFile (const std::string input_file,
                                (amrex::Real)(u_y_data.get()[i] * unit_uy),
                                (amrex::Real)(u_z_data.get()[i] * unit_uz),
                                (amrex::Real)(w_w_data.get()[i] * unit_ww),
-                               pid, procID, i, phys_const.c);
+                               pid, i, phys_const.c);
         }
     }
 
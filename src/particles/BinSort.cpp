@@ -14,9 +14,9 @@ findParticlesInEachSlice (
     const int np = a_box_sorter.boxCountsPtr()[ibox];
     const int offset = a_box_sorter.boxOffsetsPtr()[ibox];
 
-    // Extract particle structures for this tile
-    BeamParticleContainer::ParticleType const* particle_ptr = beam.GetArrayOfStructs()().data();
-    particle_ptr += offset;
+    // Extract the longitudinal particle positions for this box
+    amrex::ParticleReal const* zp = beam.GetStructOfArrays().GetRealData(BeamIdx::z).data();
+    zp += offset;
 
     // Extract box properties
     const auto lo = lbound(cbx);
@@ -26,13 +26,13 @@ findParticlesInEachSlice (
     // Find the particles that are in each slice and return collections of indices per slice.
     BeamBins bins;
     bins.build(
-        np, particle_ptr, cbx,
+        np, zp, cbx,
         // Pass lambda function that returns the slice index
-        [=] AMREX_GPU_HOST_DEVICE (const BeamParticleContainer::ParticleType& p)
+        [=] AMREX_GPU_HOST_DEVICE (const amrex::ParticleReal& z)
         noexcept -> amrex::IntVect
         {
             return amrex::IntVect(
-                AMREX_D_DECL(0, 0, static_cast<int>((p.pos(2)-plo[2])*dxi[2]-lo.z)));
+                AMREX_D_DECL(0, 0, static_cast<int>((z-plo[2])*dxi[2]-lo.z)));
         });
 
     return bins;
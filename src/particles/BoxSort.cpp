@@ -1,57 +1,122 @@
 #include "BoxSort.H"
 
-#include <AMReX_ParticleTransformation.H>
+#include <AMReX_GpuMemory.H>
+#include <AMReX_ParticleLocator.H>
 
-void BoxSorter::sortParticlesByBox (BeamParticleContainer& a_beam,
-                                    const amrex::BoxArray a_ba, const amrex::Geometry& a_geom)
+int BoxSorter::sortParticlesByBox (BeamParticleContainer& a_beam,
+                                   const amrex::BoxArray a_ba, const amrex::Geometry& a_geom,
+                                   const bool remove_invalid, const int first_box)
 {
     if (! m_particle_locator.isValid(a_ba)) m_particle_locator.build(a_ba, a_geom);
     auto assign_grid = m_particle_locator.getGridAssignor();
 
     int const np = a_beam.numParticles();
-    BeamParticleContainer::ParticleType* particle_ptr = a_beam.GetArrayOfStructs()().data();
+    auto& soa = a_beam.GetStructOfArrays();
+    amrex::ParticleReal const * const xp = soa.GetRealData(BeamIdx::x).data();
+    amrex::ParticleReal const * const yp = soa.GetRealData(BeamIdx::y).data();
+    amrex::ParticleReal const * const zp = soa.GetRealData(BeamIdx::z).data();
+    int * const idp = soa.GetIntData(BeamIdx::id).data();
+    // The particle locator needs a particle type, only its position is used
+    auto box_of_particle = [=] AMREX_GPU_HOST_DEVICE (const int ip) noexcept {
+        amrex::Particle<0,0> p;
+        p.pos(0) = xp[ip];
+        p.pos(1) = yp[ip];
+        p.pos(2) = zp[ip];
+        return assign_grid(p);
+    };
 
     constexpr unsigned int max_unsigned_int = std::numeric_limits<unsigned int>::max();
 
     int num_boxes = a_ba.size();
-    m_box_counts.resize(0);
-    m_box_offsets.resize(0);
-    m_box_counts.resize(num_boxes+1, 0);
-    m_box_offsets.resize(num_boxes+1);
 
-    amrex::Gpu::DeviceVector<unsigned int> dst_indices(np);
+    // The particles in the boxes below first_box are kept where the previous sort put them,
+    // provided it sorted into the same boxes and they were not deleted since
+    const bool incremental = first_box > 0 && !remove_invalid
+        && m_box_offsets.size() == static_cast<std::size_t>(num_boxes+1)
+        && static_cast<int>(m_box_offsets[first_box]) <= np;
+    // Particles [ip_start, np) are sorted
+    const int ip_start = incremental ? m_box_offsets[first_box] : 0;
+    const int nsort = np - ip_start;
 
     auto p_box_counts = m_box_counts.dataPtr();
+    if (incremental) {
+        amrex::ParallelFor(num_boxes+1-first_box, [=] AMREX_GPU_DEVICE (int ibox) {
+            p_box_counts[first_box+ibox] = 0;
+        });
+    } else {
+        m_box_counts.resize(0);
+        m_box_offsets.resize(0);
+        m_box_counts.resize(num_boxes+1, 0);
+        m_box_offsets.resize(num_boxes+1);
+        p_box_counts = m_box_counts.dataPtr();
+    }
+
+    amrex::Gpu::DeviceVector<unsigned int> dst_indices(nsort);
+    // Number of sorted particles in a box below first_box
+    amrex::Gpu::DeviceScalar<int> num_misplaced(0);
+
     auto p_dst_indices = dst_indices.dataPtr();
-    AMREX_FOR_1D ( np, i,
+    auto p_num_misplaced = num_misplaced.dataPtr();
+    AMREX_FOR_1D ( nsort, i,
     {
-        int dst_box = assign_grid(particle_ptr[i]);
+        const int ip = ip_start + i;
+        int dst_box = box_of_particle(ip);
         if (dst_box < 0) {
             // particle has left domain transversely, stick it at the end and invalidate
             dst_box = num_boxes;
-            particle_ptr[i].id() = -std::abs(particle_ptr[i].id());
+            idp[ip] = -std::abs(idp[ip]);
+        } else if (remove_invalid && idp[ip] < 0) {
+            dst_box = num_boxes;
+        } else if (dst_box < first_box) {
+            amrex::Gpu::Atomic::Add(p_num_misplaced, 1);
         }
         unsigned int index = amrex::Gpu::Atomic::Inc(
             &p_box_counts[dst_box], max_unsigned_int);
         p_dst_indices[i] = index;
     });
 
-    amrex::Gpu::exclusive_scan(m_box_counts.begin(), m_box_counts.end(), m_box_offsets.begin());
+    // The counts of the kept boxes were modified, start over with a full sort
+    if (incremental && num_misplaced.dataValue() > 0) {
+        return sortParticlesByBox(a_beam, a_ba, a_geom, remove_invalid, 0);
+    }
 
-    BeamParticleContainer tmp(a_beam.get_name());
-    tmp.resize(np);
+    // The offsets of the kept boxes are unchanged, and the offset of first_box is ip_start
+    amrex::Gpu::exclusive_scan(m_box_counts.begin(), m_box_counts.end(), m_box_offsets.begin());
 
     auto p_box_offsets = m_box_offsets.dataPtr();
-    AMREX_FOR_1D ( np, i,
+    AMREX_FOR_1D ( nsort, i,
     {
-        int dst_box = assign_grid(particle_ptr[i]);
-        if (dst_box < 0) dst_box = num_boxes;
-        p_dst_indices[i] += p_box_offsets[dst_box];
+        const int ip = ip_start + i;
+        int dst_box = box_of_particle(ip);
+        if (dst_box < 0 || (remove_invalid && idp[ip] < 0)) dst_box = num_boxes;
+        p_dst_indices[i] += p_box_offsets[dst_box] - ip_start;
     });
 
-    amrex::scatterParticles(tmp, a_beam, np, dst_indices.dataPtr());
+    BeamParticleContainer tmp(a_beam.get_name());
+    tmp.resize(nsort);
+
+    const BeamTileData src_data = a_beam.getBeamTileData();
+    const BeamTileData dst_data = tmp.getBeamTileData();
+    amrex::ParallelFor(nsort, [=] AMREX_GPU_DEVICE (int i) {
+        dst_data.copyParticle(src_data, ip_start+i, p_dst_indices[i]);
+    });
+
+    if (incremental) {
+        amrex::ParallelFor(nsort, [=] AMREX_GPU_DEVICE (int i) {
+            src_data.copyParticle(dst_data, i, ip_start+i);
+        });
+        amrex::Gpu::streamSynchronize();
+    } else {
+        a_beam.swap(tmp);
+    }
+
+    if (!remove_invalid) return 0;
 
-    a_beam.swap(tmp);
+    // All invalid particles are after the last box, delete them
+    const index_type num_valid = m_box_offsets[num_boxes];
+    a_beam.resize(num_valid);
+    m_box_counts[num_boxes] = 0;
+    return np - num_valid;
 }
 
 int
@@ -4,11 +4,16 @@
 #include "pusher/BeamParticleAdvance.H"
 #include "utils/HipaceProfilerWrapper.H"
 
+#include <algorithm>
+#include <limits>
+
 MultiBeam::MultiBeam (amrex::AmrCore* /*amr_core*/)
 {
 
     amrex::ParmParse pp("beams");
     pp.getarr("names", m_names);
+    pp.query("compaction_interval", m_compaction_interval);
+    pp.query("incremental_sort", m_incremental_sort);
     if (m_names[0] == "no_beam") return;
     m_nbeams = m_names.size();
     for (int i = 0; i < m_nbeams; ++i) {
@@ -25,6 +30,35 @@ MultiBeam::InitData (const amrex::Geometry& geom)
     }
 }
 
+void
+MultiBeam::InitDataDownToBox (const int ibox, const amrex::BoxArray& ba,
+                              const amrex::Geometry& geom)
+{
+    for (auto& beam : m_all_beams) {
+        beam.InitDataDownToBox(ibox, ba, geom);
+    }
+}
+
+bool
+MultiBeam::AnyLazyGeneration () const
+{
+    return std::any_of(m_all_beams.begin(), m_all_beams.end(),
+                       [] (const BeamParticleContainer& beam) { return beam.LazyGeneration(); });
+}
+
+int
+MultiBeam::LazyLeftmostBox (const amrex::BoxArray& ba) const
+{
+    int first_slice = std::numeric_limits<int>::max();
+    for (auto const& beam : m_all_beams) {
+        if (beam.LazyGeneration()) first_slice = std::min(first_slice, beam.LazyFirstSlice());
+    }
+    for (int ibox = 0; ibox < ba.size(); ++ibox) {
+        if (ba[ibox].bigEnd(Direction::z) >= first_slice) return ibox;
+    }
+    return ba.size();
+}
+
 void
 MultiBeam::DepositCurrentSlice (
     Fields& fields, const amrex::Geometry& geom, const int lev, int islice, const amrex::Box bx,
@@ -52,55 +86,45 @@ MultiBeam::findParticlesInEachSlice (int lev, int ibox, amrex::Box bx, amrex::Ge
     return bins;
 }
 
-void
+int
+MultiBeam::MaxSubsteps () const
+{
+    int max_substeps = std::numeric_limits<int>::max();
+    for (auto const& beam : m_all_beams) {
+        max_substeps = std::min(max_substeps, beam.m_max_substeps);
+    }
+    return m_nbeams > 0 ? max_substeps : 1;
+}
+
+int
 MultiBeam::sortParticlesByBox (
             amrex::Vector<BoxSorter>& a_box_sorter_vec,
-            const amrex::BoxArray a_ba, const amrex::Geometry& a_geom)
+            const amrex::BoxArray a_ba, const amrex::Geometry& a_geom,
+            const bool remove_invalid, const int first_box)
 {
     a_box_sorter_vec.resize(m_nbeams);
+    int num_removed = 0;
     for (int i=0; i<m_nbeams; i++) {
-        a_box_sorter_vec[i].sortParticlesByBox(m_all_beams[i], a_ba, a_geom);
+        num_removed += a_box_sorter_vec[i].sortParticlesByBox(
+            m_all_beams[i], a_ba, a_geom, remove_invalid, m_incremental_sort ? first_box : 0);
     }
+    return num_removed;
 }
 
 void
 MultiBeam::AdvanceBeamParticlesSlice (
     Fields& fields, amrex::Geometry const& gm, int const lev, const int islice, const amrex::Box bx,
     amrex::Vector<BeamBins>& bins,
-    const amrex::Vector<BoxSorter>& a_box_sorter_vec, const int ibox)
+    const amrex::Vector<BoxSorter>& a_box_sorter_vec, const int ibox,
+    const amrex::Real dt_betatron_coeff)
 {
     for (int i=0; i<m_nbeams; i++) {
         ::AdvanceBeamParticlesSlice(m_all_beams[i], fields, gm, lev, islice, bx,
-                                    a_box_sorter_vec[i].boxOffsetsPtr()[ibox], bins[i]);
+                                    a_box_sorter_vec[i].boxOffsetsPtr()[ibox], bins[i],
+                                    dt_betatron_coeff);
     }
 }
 
-int
-MultiBeam::NumRealComps ()
-{
-    int comps = 0;
-    if (get_nbeams() > 0){
-        comps = m_all_beams[0].NumRealComps();
-        for (auto& beam : m_all_beams) {
-            AMREX_ALWAYS_ASSERT(beam.NumRealComps() == comps);
-        }
-    }
-    return comps;
-}
-
-int
-MultiBeam::NumIntComps ()
-{
-    int comps = 0;
-    if (get_nbeams() > 0){
-        comps = m_all_beams[0].NumIntComps();
-        for (auto& beam : m_all_beams) {
-            AMREX_ALWAYS_ASSERT(beam.NumIntComps() == comps);
-        }
-    }
-    return comps;
-}
-
 void
 MultiBeam::StoreNRealParticles ()
 {
@@ -143,32 +167,11 @@ MultiBeam::PackLocalGhostParticles (int it, const amrex::Vector<BoxSorter>& box_
         ptile.resize(new_size);
 
         // Copy particles in box it to ghost particles
-        // Access AoS particle data
-        auto& aos = ptile.GetArrayOfStructs();
-        const auto& pos_structs_src = aos.begin() + offset_box_left;
-        const auto& pos_structs_dst = aos.begin() + old_size;
-        // Access SoA particle data
-        auto& soa = ptile.GetStructOfArrays(); // For momenta and weights
-        const auto  wp_src = soa.GetRealData(BeamIdx::w).data()  + offset_box_left;
-        const auto uxp_src = soa.GetRealData(BeamIdx::ux).data() + offset_box_left;
-        const auto uyp_src = soa.GetRealData(BeamIdx::uy).data() + offset_box_left;
-        const auto uzp_src = soa.GetRealData(BeamIdx::uz).data() + offset_box_left;
-        const auto  wp_dst = soa.GetRealData(BeamIdx::w).data()  + old_size;
-        const auto uxp_dst = soa.GetRealData(BeamIdx::ux).data() + old_size;
-        const auto uyp_dst = soa.GetRealData(BeamIdx::uy).data() + old_size;
-        const auto uzp_dst = soa.GetRealData(BeamIdx::uz).data() + old_size;
-
+        const BeamTileData ptd = ptile.getBeamTileData();
         amrex::ParallelFor(
             nghost,
             [=] AMREX_GPU_DEVICE (long idx) {
-                pos_structs_dst[idx].id() = pos_structs_src[idx].id();
-                pos_structs_dst[idx].pos(0) = pos_structs_src[idx].pos(0);
-                pos_structs_dst[idx].pos(1) = pos_structs_src[idx].pos(1);
-                pos_structs_dst[idx].pos(2) = pos_structs_src[idx].pos(2);
-                wp_dst[idx] = wp_src[idx];
-                uxp_dst[idx] = uxp_src[idx];
-                uyp_dst[idx] = uyp_src[idx];
-                uzp_dst[idx] = uzp_src[idx];
+                ptd.copyParticle(ptd, offset_box_left+idx, old_size+idx);
             }
             );
     }
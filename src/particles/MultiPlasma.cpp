@@ -8,6 +8,17 @@ MultiPlasma::MultiPlasma (amrex::AmrCore* amr_core)
     amrex::ParmParse pp("plasmas");
     pp.getarr("names", m_names);
     pp.query("adaptive_density", m_adaptive_density);
+    pp.query("sort_interval", m_sort_interval);
+    pp.query("sort_disorder_threshold", m_sort_disorder_threshold);
+    pp.query("sort_disorder_check_interval", m_sort_disorder_check_interval);
+    AMREX_ALWAYS_ASSERT_WITH_MESSAGE(m_sort_disorder_check_interval > 0,
+                                     "plasmas.sort_disorder_check_interval must be positive");
+    pp.query("compaction_interval", m_compaction_interval);
+    pp.query("do_tiling", m_do_tiling);
+    pp.queryarr("tile_size", m_tile_size);
+    pp.query("gather_in_batches", m_gather_in_batches);
+    AMREX_ALWAYS_ASSERT_WITH_MESSAGE(m_tile_size.size() == 2,
+                                     "plasmas.tile_size must contain 2 integers (x and y)");
     if (m_names[0] == "no_plasma") return;
     m_nplasmas = m_names.size();
     for (int i = 0; i < m_nplasmas; ++i) {
@@ -20,6 +31,12 @@ MultiPlasma::InitData (int lev, amrex::BoxArray slice_ba,
                        amrex::DistributionMapping slice_dm, amrex::Geometry slice_gm,
                        amrex::Geometry gm)
 {
+    // Tiling is a static property of amrex::ParticleContainer, so it is the same for all species,
+    // and the ionization products have the same tiles as the ions
+    PlasmaParticleContainer::do_tiling = m_do_tiling;
+    PlasmaParticleContainer::tile_size = amrex::IntVect(m_tile_size[0], m_tile_size[1], 1);
+    PlasmaParticleContainer::m_gather_in_batches = m_gather_in_batches;
+
     for (auto& plasma : m_all_plasmas) {
         plasma.SetParticleBoxArray(lev, slice_ba);
         plasma.SetParticleDistributionMap(lev, slice_dm);
@@ -71,6 +88,15 @@ MultiPlasma::AdvanceParticles (
     }
 }
 
+void
+MultiPlasma::PushAndDepositParticles (
+    Fields & fields, amrex::Geometry const& gm, bool do_update, bool do_shift, int lev)
+{
+    for (auto& plasma : m_all_plasmas) {
+        PushAndDepositPlasmaParticles(plasma, fields, gm, do_update, do_shift, lev);
+    }
+}
+
 void
 MultiPlasma::ResetParticles (int lev, bool initial)
 {
@@ -102,6 +128,49 @@ MultiPlasma::DoFieldIonization (
 
 }
 
+void
+MultiPlasma::SortParticles (const amrex::Geometry& geom, const int lev)
+{
+    if (m_sort_interval <= 0 && m_sort_disorder_threshold <= 0.) return;
+
+    // Count each slice once, independently of the number of levels
+    if (lev == 0) {
+        ++m_nslices_since_sort;
+        ++m_nslices_since_disorder_check;
+    }
+    const bool periodic_sort = m_sort_interval > 0 && m_nslices_since_sort >= m_sort_interval;
+    if (periodic_sort) m_nslices_since_sort = 0;
+    // The disorder costs a pass over the particles, so it is only evaluated every
+    // m_sort_disorder_check_interval slices, and not when the particles are sorted anyway
+    const bool check_disorder = !periodic_sort && m_sort_disorder_threshold > 0. &&
+        m_nslices_since_disorder_check >= m_sort_disorder_check_interval;
+    if (check_disorder || periodic_sort) m_nslices_since_disorder_check = 0;
+
+    for (auto& plasma : m_all_plasmas) {
+        if (periodic_sort || (check_disorder &&
+                              plasma.CellDisorder(geom, lev) > m_sort_disorder_threshold)) {
+            plasma.SortParticlesByCell(geom, lev);
+        }
+    }
+}
+
+int
+MultiPlasma::RemoveInvalidParticles (const int lev)
+{
+    if (m_compaction_interval <= 0) return 0;
+
+    // Count each slice once, independently of the number of levels
+    if (lev == 0) ++m_nslices_since_compaction;
+    if (m_nslices_since_compaction < m_compaction_interval) return 0;
+    m_nslices_since_compaction = 0;
+
+    int num_removed = 0;
+    for (auto& plasma : m_all_plasmas) {
+        num_removed += plasma.RemoveInvalidParticles(lev);
+    }
+    return num_removed;
+}
+
 bool
 MultiPlasma::AllSpeciesNeutralizeBackground () const
 {
@@ -5,7 +5,15 @@
 #include "pusher/BeamParticleAdvance.H"
 #include "pusher/FieldGather.H"
 #include "pusher/GetAndSetPosition.H"
+
+#include <AMReX_GpuContainers.H>
+#include <AMReX_Scan.H>
+
 #include <cmath>
+#include <map>
+#include <utility>
+
+bool PlasmaParticleContainer::m_gather_in_batches = false;
 
 void
 PlasmaParticleContainer::ReadParameters ()
@@ -112,10 +120,35 @@ IonizationModule (const int lev,
     amrex::Real const * AMREX_RESTRICT dx = geom.CellSize();
     const PhysConst phys_const = make_constants_SI();
 
-    // Loop over particle boxes with both ion and electron Particle Containers at the same time
+    // Extract the fields
+    const amrex::MultiFab& S = fields.getSlices(lev, WhichSlice::This);
+    const amrex::MultiFab exmby(S, amrex::make_alias, Comps[WhichSlice::This]["ExmBy"], 1);
+    const amrex::MultiFab eypbx(S, amrex::make_alias, Comps[WhichSlice::This]["EypBx"], 1);
+    const amrex::MultiFab ez(S, amrex::make_alias, Comps[WhichSlice::This]["Ez"], 1);
+    const amrex::MultiFab bx(S, amrex::make_alias, Comps[WhichSlice::This]["Bx"], 1);
+    const amrex::MultiFab by(S, amrex::make_alias, Comps[WhichSlice::This]["By"], 1);
+    const amrex::MultiFab bz(S, amrex::make_alias, Comps[WhichSlice::This]["Bz"], 1);
+
+    // The electron tiles are created before the threaded loops, which only look them up. Each
+    // tile gets a slot for its ion mask and its count of ionized ions.
+    std::map<std::pair<int, int>, int> tile_slots;
+    for (amrex::MFIter mfi_ion = MakeMFIter(lev); mfi_ion.isValid(); ++mfi_ion) {
+        m_product_pc->DefineAndReturnParticleTile(lev, mfi_ion.index(), mfi_ion.LocalTileIndex());
+        const int slot = tile_slots.size();
+        tile_slots[std::make_pair(mfi_ion.index(), mfi_ion.LocalTileIndex())] = slot;
+    }
+    const int num_tiles = tile_slots.size();
+    amrex::Vector<amrex::Gpu::DeviceVector<uint8_t>> ion_masks(num_tiles);
+    amrex::Gpu::DeviceVector<int> num_new_electrons_d(num_tiles, 0);
+
+    // First pass: ionize the ions and count the new electrons of each tile on the device.
+    // With tiling on CPU, the tiles are distributed among the threads.
+#ifdef AMREX_USE_OMP
+#pragma omp parallel if (TilesOnThreads())
+#endif
     for (amrex::MFIter mfi_ion = MakeMFIter(lev); mfi_ion.isValid(); ++mfi_ion)
     {
-        // Extract properties associated with the extent of the current box
+        // Extract properties associated with the extent of the current tile
         // Grow to capture the extent of the particle shape
         amrex::Box tilebox = mfi_ion.tilebox().grow(
             {Hipace::m_depos_order_xy, Hipace::m_depos_order_xy, 0});
@@ -124,14 +157,6 @@ IonizationModule (const int lev,
         amrex::Real const * AMREX_RESTRICT xyzmin = grid_box.lo();
         amrex::Dim3 const lo = amrex::lbound(tilebox);
 
-        // Extract the fields
-        const amrex::MultiFab& S = fields.getSlices(lev, WhichSlice::This);
-        const amrex::MultiFab exmby(S, amrex::make_alias, Comps[WhichSlice::This]["ExmBy"], 1);
-        const amrex::MultiFab eypbx(S, amrex::make_alias, Comps[WhichSlice::This]["EypBx"], 1);
-        const amrex::MultiFab ez(S, amrex::make_alias, Comps[WhichSlice::This]["Ez"], 1);
-        const amrex::MultiFab bx(S, amrex::make_alias, Comps[WhichSlice::This]["Bx"], 1);
-        const amrex::MultiFab by(S, amrex::make_alias, Comps[WhichSlice::This]["By"], 1);
-        const amrex::MultiFab bz(S, amrex::make_alias, Comps[WhichSlice::This]["Bz"], 1);
         // Extract FabArray for this box
         const amrex::FArrayBox& exmby_fab = exmby[mfi_ion];
         const amrex::FArrayBox& eypbx_fab = eypbx[mfi_ion];
@@ -154,8 +179,6 @@ IonizationModule (const int lev,
         auto& plevel_ion = GetParticles(lev);
         auto index = std::make_pair(mfi_ion.index(), mfi_ion.LocalTileIndex());
         if(plevel_ion.find(index) == plevel_ion.end()) continue;
-        auto& ptile_elec = m_product_pc->DefineAndReturnParticleTile(lev,
-            mfi_ion.index(), mfi_ion.LocalTileIndex());
         auto& ptile_ion = plevel_ion.at(index);
 
         auto& soa_ion = ptile_ion.GetStructOfArrays(); // For momenta and weights
@@ -171,14 +194,19 @@ IonizationModule (const int lev,
         const amrex::Real * const psip = soa_ion.GetRealData(PlasmaIdx::psi).data();
 
         // Make Ion Mask and load ADK prefactors
-        // Ion Mask is necessary to only resize electron particle tile once
-        amrex::Gpu::DeviceVector<uint8_t> ion_mask(ptile_ion.numParticles(), 0);
-        uint8_t* AMREX_RESTRICT p_ion_mask = ion_mask.data();
-        amrex::Gpu::DeviceScalar<uint32_t> num_new_electrons(0);
-        uint32_t* AMREX_RESTRICT p_num_new_electrons = num_new_electrons.dataPtr();
+        // The Ion Mask is set for every ion by the rate evaluation, and scanned in the second
+        // pass to place the new electrons in the order of the ions
+        const int slot = tile_slots.at(index);
+        ion_masks[slot].resize(ptile_ion.numParticles());
+        uint8_t* AMREX_RESTRICT p_ion_mask = ion_masks[slot].data();
+        int* AMREX_RESTRICT p_num_new_electrons = num_new_electrons_d.data() + slot;
         amrex::Real* AMREX_RESTRICT adk_prefactor = m_adk_prefactor.data();
         amrex::Real* AMREX_RESTRICT adk_exp_prefactor = m_adk_exp_prefactor.data();
         amrex::Real* AMREX_RESTRICT adk_power = m_adk_power.data();
+        amrex::Real* AMREX_RESTRICT adk_field_threshold = m_adk_field_threshold.data();
+        amrex::Real* AMREX_RESTRICT adk_log_rate_table = m_adk_log_rate_table.data();
+        constexpr int table_size = m_adk_table_size;
+        const amrex::Real inv_dlog_field = m_adk_table_points_per_decade/std::log(10._rt);
 
         long num_ions = ptile_ion.numParticles();
 
@@ -189,6 +217,7 @@ IonizationModule (const int lev,
             int pid;
             getPosition(ip, xp, yp, zp, pid);
 
+            p_ion_mask[ip] = 0;
             if (pid < 0) return;
 
             // define field at particle position reals
@@ -204,17 +233,30 @@ IonizationModule (const int lev,
             const amrex::ParticleReal Eyp = EypBxp - Bxp * phys_const.c;
             const amrex::ParticleReal Ep = std::sqrt( Exp*Exp + Eyp*Eyp + Ezp*Ezp );
 
+            // Below the threshold, the probability of ionization rounds to 0
+            const int ion_lev_loc = ion_lev[ip];
+            if (Ep < adk_field_threshold[ion_lev_loc]) return;
+
             // Compute probability of ionization p
             const amrex::Real psi_1 = ( psip[ip] *
                 phys_const.q_e / (phys_const.m_e * phys_const.c * phys_const.c) ) + 1._rt;
             const amrex::Real gammap = (1.0_rt + uxp[ip] * uxp[ip] * clightsq
                                                + uyp[ip] * uyp[ip] * clightsq
                                                + psi_1 * psi_1 ) / ( 2.0_rt * psi_1 );
-            const int ion_lev_loc = ion_lev[ip];
+            // Interpolate the log of the rate in the table, or use the formula above its range
+            const amrex::Real u = std::log(Ep/adk_field_threshold[ion_lev_loc])*inv_dlog_field;
+            const int itab = static_cast<int>(u);
+            amrex::Real rate;
+            if (itab < table_size-1) {
+                const amrex::Real* const log_rate = adk_log_rate_table + ion_lev_loc*table_size;
+                const amrex::Real f = u - itab;
+                rate = std::exp( (1._rt-f)*log_rate[itab] + f*log_rate[itab+1] );
+            } else {
+                rate = adk_prefactor[ion_lev_loc] * std::pow(Ep, adk_power[ion_lev_loc]) *
+                    std::exp( adk_exp_prefactor[ion_lev_loc]/Ep );
+            }
             // gamma / (psi + 1) to complete dt for QSA
-            amrex::Real w_dtau = gammap / psi_1 * adk_prefactor[ion_lev_loc] *
-                std::pow(Ep, adk_power[ion_lev_loc]) *
-                std::exp( adk_exp_prefactor[ion_lev_loc]/Ep );
+            amrex::Real w_dtau = gammap / psi_1 * rate;
             amrex::Real p = 1._rt - std::exp( - w_dtau );
 
             amrex::Real random_draw = amrex::Random();
@@ -222,51 +264,67 @@ IonizationModule (const int lev,
             {
                 ion_lev[ip] += 1;
                 p_ion_mask[ip] = 1;
-                amrex::Gpu::Atomic::Add( p_num_new_electrons, 1u );
+                amrex::Gpu::Atomic::Add(p_num_new_electrons, 1);
             }
         });
-        amrex::Gpu::synchronize();
-
-        if (num_new_electrons.dataValue() == 0) continue;
+    }
 
-        if(Hipace::m_verbose >= 3) {
-            amrex::Print() << "Number of ionized Plasma Particles: "
-            << num_new_electrons.dataValue() << "\n";
-        }
+    // A single copy gives the number of new electrons of all tiles, so that each electron tile
+    // is resized once to its exact size
+    amrex::Vector<int> num_new_electrons(num_tiles);
+    amrex::Gpu::copy(amrex::Gpu::deviceToHost, num_new_electrons_d.begin(),
+                     num_new_electrons_d.end(), num_new_electrons.begin());
+    unsigned long num_ionized = 0;
+    for (int num_new : num_new_electrons) num_ionized += num_new;
+    if (num_ionized == 0) return;
+
+    // Second pass: write the new electrons at the end of the electron tiles
+#ifdef AMREX_USE_OMP
+#pragma omp parallel if (TilesOnThreads())
+#endif
+    for (amrex::MFIter mfi_ion = MakeMFIter(lev); mfi_ion.isValid(); ++mfi_ion)
+    {
+        auto& plevel_ion = GetParticles(lev);
+        auto index = std::make_pair(mfi_ion.index(), mfi_ion.LocalTileIndex());
+        if(plevel_ion.find(index) == plevel_ion.end()) continue;
+        const int slot = tile_slots.at(index);
+        const int num_new = num_new_electrons[slot];
+        if (num_new == 0) continue;
+        auto& ptile_elec = m_product_pc->GetParticles(lev).at(index);
+        auto& ptile_ion = plevel_ion.at(index);
 
+        using PTileType = PlasmaParticleContainer::ParticleTileType;
+        const auto getPosition = GetParticlePosition<PTileType>(ptile_ion);
+        const uint8_t* AMREX_RESTRICT p_ion_mask = ion_masks[slot].data();
+        const long num_ions = ptile_ion.numParticles();
 
-        // resize electron particle tile
         const auto old_size = ptile_elec.numParticles();
-        const auto new_size = old_size + num_new_electrons.dataValue();
-        ptile_elec.resize(new_size);
+        ptile_elec.resize(old_size + num_new);
 
         // Load electron soa and aos after resize
         ParticleType* pstruct_elec = ptile_elec.GetArrayOfStructs()().data();
         const int procID = amrex::ParallelDescriptor::MyProc();
-        const long pid_start = ParticleType::NextID();
-        ParticleType::NextID(pid_start + num_new_electrons.dataValue());
 
         auto arrdata_ion = ptile_ion.GetStructOfArrays().realarray();
         auto arrdata_elec = ptile_elec.GetStructOfArrays().realarray();
         auto int_arrdata_elec = ptile_elec.GetStructOfArrays().intarray();
+        auto force_elec = GetAllPlasmaForceData(ptile_elec.GetStructOfArrays());
 
         const int init_ion_lev = m_product_pc->m_init_ion_lev;
 
-        amrex::Gpu::DeviceScalar<uint32_t> ip_elec(0);
-        uint32_t * AMREX_RESTRICT p_ip_elec = ip_elec.dataPtr();
-
-        amrex::ParallelFor(num_ions,
-            [=] AMREX_GPU_DEVICE (long ip) {
+        // The exclusive prefix sum of the mask is the index of the new electron of each
+        // ionized ion, so the electrons are in the same order as their ions
+        amrex::Scan::PrefixSum<int>(num_ions,
+            [=] AMREX_GPU_DEVICE (int ip) -> int { return p_ion_mask[ip]; },
+            [=] AMREX_GPU_DEVICE (int ip, int const& ie) {
 
             if(p_ion_mask[ip] != 0) {
-                const long pid = amrex::Gpu::Atomic::Add( p_ip_elec, 1u );
-                const long pidx = pid + old_size;
+                const long pidx = ie + old_size;
 
                 // Copy ion data to new electron
                 amrex::ParticleReal xp, yp, zp;
                 getPosition(ip, xp, yp, zp);
 
-                pstruct_elec[pidx].id()   = pid_start + pid;
                 pstruct_elec[pidx].cpu()  = procID;
                 pstruct_elec[pidx].pos(0) = xp;
                 pstruct_elec[pidx].pos(1) = yp;
@@ -279,39 +337,254 @@ IonizationModule (const int lev,
                 arrdata_elec[PlasmaIdx::psi     ][pidx] = 0._rt;
                 arrdata_elec[PlasmaIdx::x_prev  ][pidx] = arrdata_ion[PlasmaIdx::x_prev][ip];
                 arrdata_elec[PlasmaIdx::y_prev  ][pidx] = arrdata_ion[PlasmaIdx::y_prev][ip];
-                arrdata_elec[PlasmaIdx::ux_temp ][pidx] = 0._rt;
-                arrdata_elec[PlasmaIdx::uy_temp ][pidx] = 0._rt;
-                arrdata_elec[PlasmaIdx::psi_temp][pidx] = 0._rt;
-                arrdata_elec[PlasmaIdx::Fx1     ][pidx] = 0._rt;
-                arrdata_elec[PlasmaIdx::Fx2     ][pidx] = 0._rt;
-                arrdata_elec[PlasmaIdx::Fx3     ][pidx] = 0._rt;
-                arrdata_elec[PlasmaIdx::Fx4     ][pidx] = 0._rt;
-                arrdata_elec[PlasmaIdx::Fx5     ][pidx] = 0._rt;
-                arrdata_elec[PlasmaIdx::Fy1     ][pidx] = 0._rt;
-                arrdata_elec[PlasmaIdx::Fy2     ][pidx] = 0._rt;
-                arrdata_elec[PlasmaIdx::Fy3     ][pidx] = 0._rt;
-                arrdata_elec[PlasmaIdx::Fy4     ][pidx] = 0._rt;
-                arrdata_elec[PlasmaIdx::Fy5     ][pidx] = 0._rt;
-                arrdata_elec[PlasmaIdx::Fux1    ][pidx] = 0._rt;
-                arrdata_elec[PlasmaIdx::Fux2    ][pidx] = 0._rt;
-                arrdata_elec[PlasmaIdx::Fux3    ][pidx] = 0._rt;
-                arrdata_elec[PlasmaIdx::Fux4    ][pidx] = 0._rt;
-                arrdata_elec[PlasmaIdx::Fux5    ][pidx] = 0._rt;
-                arrdata_elec[PlasmaIdx::Fuy1    ][pidx] = 0._rt;
-                arrdata_elec[PlasmaIdx::Fuy2    ][pidx] = 0._rt;
-                arrdata_elec[PlasmaIdx::Fuy3    ][pidx] = 0._rt;
-                arrdata_elec[PlasmaIdx::Fuy4    ][pidx] = 0._rt;
-                arrdata_elec[PlasmaIdx::Fuy5    ][pidx] = 0._rt;
-                arrdata_elec[PlasmaIdx::Fpsi1   ][pidx] = 0._rt;
-                arrdata_elec[PlasmaIdx::Fpsi2   ][pidx] = 0._rt;
-                arrdata_elec[PlasmaIdx::Fpsi3   ][pidx] = 0._rt;
-                arrdata_elec[PlasmaIdx::Fpsi4   ][pidx] = 0._rt;
-                arrdata_elec[PlasmaIdx::Fpsi5   ][pidx] = 0._rt;
+                for (int i = 0; i < PlasmaNForceAttribs; ++i) force_elec[i][pidx] = 0._rt;
                 arrdata_elec[PlasmaIdx::x0      ][pidx] = arrdata_ion[PlasmaIdx::x0    ][ip];
                 arrdata_elec[PlasmaIdx::y0      ][pidx] = arrdata_ion[PlasmaIdx::y0    ][ip];
                 int_arrdata_elec[PlasmaIdx::ion_lev][pidx] = init_ion_lev;
             }
+        },
+        amrex::Scan::Type::exclusive, amrex::Scan::noRetSum);
+
+        // The ids only depend on the order of the new electrons
+        long pid_start;
+#ifdef AMREX_USE_OMP
+#pragma omp critical (plasma_ionization_nextid)
+#endif
+        {
+            pid_start = ParticleType::NextID();
+            ParticleType::NextID(pid_start + num_new);
+        }
+        amrex::ParallelFor(num_new,
+            [=] AMREX_GPU_DEVICE (int ie) {
+                pstruct_elec[old_size + ie].id() = pid_start + ie;
+            });
+    }
+
+    if(Hipace::m_verbose >= 3) {
+        amrex::Print() << "Number of ionized Plasma Particles: " << num_ionized << "\n";
+    }
+}
+
+namespace
+{
+    /** \brief Functor returning the transverse cell of a plasma particle, relative to the lower
+     * corner of the domain and clamped to the domain, as needed by amrex::DenseBins.
+     */
+    struct PlasmaCellIndex
+    {
+        amrex::GpuArray<amrex::Real, AMREX_SPACEDIM> m_plo;
+        amrex::GpuArray<amrex::Real, AMREX_SPACEDIM> m_dxi;
+        amrex::IntVect m_ncells;
+
+        /** Constructor
+         * \param[in] geom Geometry of the simulation
+         */
+        PlasmaCellIndex (const amrex::Geometry& geom)
+            : m_plo(geom.ProbLoArray()), m_dxi(geom.InvCellSizeArray()),
+              m_ncells(geom.Domain().length())
+        {}
+
+        /** \brief Cell of particle p
+         * \param[in] p particle
+         */
+        AMREX_GPU_HOST_DEVICE AMREX_FORCE_INLINE
+        amrex::IntVect operator() (const PlasmaParticleContainer::ParticleType& p) const noexcept
+        {
+            const int i = static_cast<int>(amrex::Math::floor((p.pos(0) - m_plo[0])*m_dxi[0]));
+            const int j = static_cast<int>(amrex::Math::floor((p.pos(1) - m_plo[1])*m_dxi[1]));
+            return amrex::IntVect(amrex::min(m_ncells[0]-1, amrex::max(0, i)),
+                                  amrex::min(m_ncells[1]-1, amrex::max(0, j)), 0);
+        }
+
+        /** \brief Linear index of the cell of particle p, x fastest as in the box used to sort
+         * the particles, so that sorted particles have increasing indices
+         * \param[in] p particle
+         */
+        AMREX_GPU_HOST_DEVICE AMREX_FORCE_INLINE
+        int linear (const PlasmaParticleContainer::ParticleType& p) const noexcept
+        {
+            const amrex::IntVect iv = (*this)(p);
+            return iv[1]*m_ncells[0] + iv[0];
+        }
+    };
+
+    /** \brief Sort particles [begin, begin+np) of a tile by transverse cell
+     *
+     * \param[in,out] ptile particle tile
+     * \param[in] begin index of the first particle to sort
+     * \param[in] np number of particles to sort
+     * \param[in] cell_index functor returning the cell of a particle
+     */
+    void SortParticleRange (PlasmaParticleContainer::ParticleTileType& ptile, const int begin,
+                            const int np, const PlasmaCellIndex& cell_index)
+    {
+        if (np <= 1) return;
+        using ParticleType = PlasmaParticleContainer::ParticleType;
+
+        ParticleType* pstruct = ptile.GetArrayOfStructs()().dataPtr() + begin;
+        const amrex::Box cbx({0, 0, 0}, {cell_index.m_ncells[0]-1, cell_index.m_ncells[1]-1, 0});
+        amrex::DenseBins<ParticleType> bins;
+        bins.build(np, pstruct, cbx, cell_index);
+        auto const * const AMREX_RESTRICT perm = bins.permutationPtr();
+
+        // Gather every attribute in the sorted order into a buffer, and copy it back
+        amrex::Gpu::DeviceVector<ParticleType> tmp_structs(np);
+        ParticleType* const p_tmp_structs = tmp_structs.dataPtr();
+        amrex::ParallelFor(np, [=] AMREX_GPU_DEVICE (int i) {
+            p_tmp_structs[i] = pstruct[perm[i]];
+        });
+        amrex::Gpu::copyAsync(amrex::Gpu::deviceToDevice,
+                              tmp_structs.begin(), tmp_structs.end(), pstruct);
+
+        auto& soa = ptile.GetStructOfArrays();
+        amrex::Gpu::DeviceVector<amrex::ParticleReal> tmp_real(np);
+        amrex::ParticleReal* const p_tmp_real = tmp_real.dataPtr();
+        for (int icomp = 0; icomp < PlasmaIdx::nattribs; ++icomp) {
+            amrex::ParticleReal* const data = soa.GetRealData(icomp).dataPtr() + begin;
+            amrex::ParallelFor(np, [=] AMREX_GPU_DEVICE (int i) {
+                p_tmp_real[i] = data[perm[i]];
+            });
+            amrex::Gpu::copyAsync(amrex::Gpu::deviceToDevice,
+                                  tmp_real.begin(), tmp_real.end(), data);
+        }
+
+        amrex::Gpu::DeviceVector<int> tmp_int(np);
+        int* const p_tmp_int = tmp_int.dataPtr();
+        for (int icomp = 0; icomp < PlasmaIdx::int_nattribs; ++icomp) {
+            int* const data = soa.GetIntData(icomp).dataPtr() + begin;
+            amrex::ParallelFor(np, [=] AMREX_GPU_DEVICE (int i) {
+                p_tmp_int[i] = data[perm[i]];
+            });
+            amrex::Gpu::copyAsync(amrex::Gpu::deviceToDevice,
+                                  tmp_int.begin(), tmp_int.end(), data);
+        }
+        amrex::Gpu::streamSynchronize();
+    }
+
+    /** \brief Append the valid (or invalid) particles among [begin, begin+np) of a tile to
+     * another tile, in the same order. The destination indices are computed with a prefix sum.
+     *
+     * \param[in,out] dst destination tile, resized to hold the copied particles
+     * \param[in] src source tile
+     * \param[in] begin index of the first particle to consider in src
+     * \param[in] np number of particles to consider in src
+     * \param[in] keep_valid whether to copy the valid (id >= 0) or the invalid particles
+     * \return number of particles copied
+     */
+    int CompactParticleRange (PlasmaParticleContainer::ParticleTileType& dst,
+                              const PlasmaParticleContainer::ParticleTileType& src,
+                              const int begin, const int np, const bool keep_valid)
+    {
+        if (np <= 0) return 0;
+
+        const auto* const pstruct = src.GetArrayOfStructs()().dataPtr() + begin;
+        amrex::Gpu::DeviceVector<int> offsets(np);
+        int* const p_offsets = offsets.dataPtr();
+        const int ncopy = amrex::Scan::PrefixSum<int>(np,
+            [=] AMREX_GPU_DEVICE (int i) -> int { return (pstruct[i].id() >= 0) == keep_valid; },
+            [=] AMREX_GPU_DEVICE (int i, int const& x) { p_offsets[i] = x; },
+            amrex::Scan::Type::exclusive, amrex::Scan::retSum);
+        if (ncopy == 0) return 0;
+
+        const int dst_start = dst.numParticles();
+        dst.resize(dst_start + ncopy);
+        const auto src_data = src.getConstParticleTileData();
+        auto dst_data = dst.getParticleTileData();
+        amrex::ParallelFor(np, [=] AMREX_GPU_DEVICE (int i) {
+            if ((pstruct[i].id() >= 0) == keep_valid) {
+                amrex::copyParticle(dst_data, src_data, begin + i, dst_start + p_offsets[i]);
+            }
         });
-        amrex::Gpu::synchronize();
+        amrex::Gpu::streamSynchronize();
+        return ncopy;
+    }
+}
+
+amrex::Real
+PlasmaParticleContainer::CellDisorder (const amrex::Geometry& geom, const int lev)
+{
+    HIPACE_PROFILE("PlasmaParticleContainer::CellDisorder()");
+    const PlasmaCellIndex cell_index(geom);
+
+    amrex::Long n_descents = 0;
+    amrex::Long n_total = 0;
+    for (PlasmaParticleIterator pti(*this, lev); pti.isValid(); ++pti)
+    {
+        const int np = pti.numParticles();
+        if (np <= 1) continue;
+        ParticleType const * const pstruct = pti.GetArrayOfStructs()().dataPtr();
+
+        amrex::ReduceOps<amrex::ReduceOpSum> reduce_op;
+        amrex::ReduceData<int> reduce_data(reduce_op);
+        using ReduceTuple = typename decltype(reduce_data)::Type;
+        reduce_op.eval(np-1, reduce_data,
+                       [=] AMREX_GPU_DEVICE (int i) -> ReduceTuple
+                       {
+                           return cell_index.linear(pstruct[i+1]) < cell_index.linear(pstruct[i]);
+                       });
+        n_descents += amrex::get<0>(reduce_data.value());
+        n_total += np-1;
+    }
+    return n_total > 0 ? static_cast<amrex::Real>(n_descents)/n_total : 0.;
+}
+
+void
+PlasmaParticleContainer::SortParticlesByCell (const amrex::Geometry& geom, const int lev)
+{
+    HIPACE_PROFILE("PlasmaParticleContainer::SortParticlesByCell()");
+    const PlasmaCellIndex cell_index(geom);
+
+    for (PlasmaParticleIterator pti(*this, lev); pti.isValid(); ++pti)
+    {
+        const int np = pti.numParticles();
+        const int np_init = amrex::min(np, static_cast<int>(m_init_num_par[pti.tileIndex()]));
+        SortParticleRange(pti.GetParticleTile(), 0, np_init, cell_index);
+        SortParticleRange(pti.GetParticleTile(), np_init, np-np_init, cell_index);
+    }
+}
+
+int
+PlasmaParticleContainer::RemoveInvalidParticles (const int lev)
+{
+    HIPACE_PROFILE("PlasmaParticleContainer::RemoveInvalidParticles()");
+
+    int num_removed = 0;
+    for (PlasmaParticleIterator pti(*this, lev); pti.isValid(); ++pti)
+    {
+        auto& ptile = pti.GetParticleTile();
+        const int np = pti.numParticles();
+        const int np_init = amrex::min(np, static_cast<int>(m_init_num_par[pti.tileIndex()]));
+
+        // Valid initial particles first, then valid particles added by ionization
+        ParticleTileType compacted;
+        const int np_init_valid = CompactParticleRange(compacted, ptile, 0, np_init, true);
+        const int np_valid = np_init_valid +
+            CompactParticleRange(compacted, ptile, np_init, np-np_init, true);
+        if (np_valid == np) continue;
+
+        CompactParticleRange(m_removed_particles[pti.tileIndex()], ptile, 0, np_init, false);
+        std::swap(ptile, compacted);
+        m_init_num_par[pti.tileIndex()] = np_init_valid;
+        num_removed += np - np_valid;
     }
+    return num_removed;
+}
+
+void
+PlasmaParticleContainer::RestoreRemovedParticles (ParticleTileType& ptile, const int tile_index)
+{
+    const int np_init = m_init_num_par[tile_index];
+    ptile.resize(np_init);
+
+    // The stash is not erased, so that tiles can be restored concurrently
+    auto found = m_removed_particles.find(tile_index);
+    if (found == m_removed_particles.end()) return;
+    ParticleTileType& removed = found->second;
+    const int num_removed = removed.numParticles();
+    if (num_removed == 0) return;
+    ptile.resize(np_init + num_removed);
+    amrex::copyParticles(ptile, removed, 0, np_init, num_removed);
+    amrex::Gpu::streamSynchronize();
+    m_init_num_par[tile_index] = np_init + num_removed;
+    removed.resize(0);
 }
@@ -5,6 +5,7 @@
 #include "utils/HipaceProfilerWrapper.H"
 #include "utils/IonizationEnergiesTable.H"
 #include <cmath>
+#include <limits>
 
 void
 PlasmaParticleContainer::
@@ -91,6 +92,7 @@ InitParticles (const amrex::IntVect& a_num_particles_per_cell,
 
         auto arrdata = particle_tile.GetStructOfArrays().realarray();
         auto int_arrdata = particle_tile.GetStructOfArrays().intarray();
+        auto force_data = GetAllPlasmaForceData(particle_tile.GetStructOfArrays());
 
         int procID = amrex::ParallelDescriptor::MyProc();
         int pid = ParticleType::NextID();
@@ -155,34 +157,9 @@ InitParticles (const amrex::IntVect& a_num_particles_per_cell,
                 arrdata[PlasmaIdx::psi      ][pidx] = 0.;
                 arrdata[PlasmaIdx::x_prev   ][pidx] = 0.;
                 arrdata[PlasmaIdx::y_prev   ][pidx] = 0.;
-                arrdata[PlasmaIdx::ux_temp  ][pidx] = u[0] * phys_const.c;
-                arrdata[PlasmaIdx::uy_temp  ][pidx] = u[1] * phys_const.c;
-                arrdata[PlasmaIdx::psi_temp ][pidx] = 0.;
-                arrdata[PlasmaIdx::Fx1      ][pidx] = 0.;
-                arrdata[PlasmaIdx::Fx2      ][pidx] = 0.;
-                arrdata[PlasmaIdx::Fx3      ][pidx] = 0.;
-                arrdata[PlasmaIdx::Fx4      ][pidx] = 0.;
-                arrdata[PlasmaIdx::Fx5      ][pidx] = 0.;
-                arrdata[PlasmaIdx::Fy1      ][pidx] = 0.;
-                arrdata[PlasmaIdx::Fy2      ][pidx] = 0.;
-                arrdata[PlasmaIdx::Fy3      ][pidx] = 0.;
-                arrdata[PlasmaIdx::Fy4      ][pidx] = 0.;
-                arrdata[PlasmaIdx::Fy5      ][pidx] = 0.;
-                arrdata[PlasmaIdx::Fux1     ][pidx] = 0.;
-                arrdata[PlasmaIdx::Fux2     ][pidx] = 0.;
-                arrdata[PlasmaIdx::Fux3     ][pidx] = 0.;
-                arrdata[PlasmaIdx::Fux4     ][pidx] = 0.;
-                arrdata[PlasmaIdx::Fux5     ][pidx] = 0.;
-                arrdata[PlasmaIdx::Fuy1     ][pidx] = 0.;
-                arrdata[PlasmaIdx::Fuy2     ][pidx] = 0.;
-                arrdata[PlasmaIdx::Fuy3     ][pidx] = 0.;
-                arrdata[PlasmaIdx::Fuy4     ][pidx] = 0.;
-                arrdata[PlasmaIdx::Fuy5     ][pidx] = 0.;
-                arrdata[PlasmaIdx::Fpsi1    ][pidx] = 0.;
-                arrdata[PlasmaIdx::Fpsi2    ][pidx] = 0.;
-                arrdata[PlasmaIdx::Fpsi3    ][pidx] = 0.;
-                arrdata[PlasmaIdx::Fpsi4    ][pidx] = 0.;
-                arrdata[PlasmaIdx::Fpsi5    ][pidx] = 0.;
+                for (int i = 0; i < PlasmaNForceAttribs; ++i) force_data[i][pidx] = 0.;
+                force_data[0][pidx] = u[0] * phys_const.c; // ux_temp
+                force_data[1][pidx] = u[1] * phys_const.c; // uy_temp
                 arrdata[PlasmaIdx::x0       ][pidx] = x;
                 arrdata[PlasmaIdx::y0       ][pidx] = y;
                 int_arrdata[PlasmaIdx::ion_lev][pidx] = init_ion_lev;
@@ -256,4 +233,49 @@ InitIonizationModule (const amrex::Geometry& geom,
             * std::pow(2*std::pow((Uion/UH),3./2)*Ea,2*n_eff - 1);
         p_adk_exp_prefactor[i] = -2./3 * std::pow( Uion/UH,3./2) * Ea;
     }
+
+    // Tabulate the log of the rate w_dtau/(gamma/(psi+1)) = prefactor*E^power*exp(exp_prefactor/E)
+    // on a log-spaced grid of E. Below a threshold field, the probability 1-exp(-w_dtau) rounds
+    // to 0 even for the largest gamma/(psi+1) allowed by the QSA, so the rate is not evaluated.
+    const int table_size = m_adk_table_size;
+    const double dlog_field = std::log(10.)/m_adk_table_points_per_decade;
+    const double log_min_rate = std::log(0.5*std::numeric_limits<amrex::Real>::epsilon()
+                                         / m_max_qsa_weighting_factor);
+    amrex::Vector<amrex::Real> h_field_threshold(ion_atomic_number+1,
+                                                 std::numeric_limits<amrex::Real>::max());
+    amrex::Vector<amrex::Real> h_log_rate_table(ion_atomic_number*table_size, 0._rt);
+    for (int i=0; i<ion_atomic_number; ++i)
+    {
+        const double log_prefactor = std::log(static_cast<double>(p_adk_prefactor[i]));
+        const double power = p_adk_power[i];
+        const double exp_prefactor = p_adk_exp_prefactor[i];
+        auto log_rate = [=] (double log_field) {
+            return log_prefactor + power*log_field + exp_prefactor*std::exp(-log_field);
+        };
+        // The rate increases up to the field -exp_prefactor/(-power), where it is the largest
+        const double log_field_max = std::log(exp_prefactor/power);
+        if (log_rate(log_field_max) < log_min_rate) continue;
+        // Bisection for the threshold on the increasing part of the rate
+        double log_field_lo = log_field_max - 50.;
+        double log_field_hi = log_field_max;
+        for (int iter=0; iter<100; ++iter) {
+            const double log_field_mid = 0.5*(log_field_lo + log_field_hi);
+            if (log_rate(log_field_mid) < log_min_rate) {
+                log_field_lo = log_field_mid;
+            } else {
+                log_field_hi = log_field_mid;
+            }
+        }
+        h_field_threshold[i] = static_cast<amrex::Real>(std::exp(log_field_lo));
+        for (int j=0; j<table_size; ++j) {
+            h_log_rate_table[i*table_size + j] = log_rate(log_field_lo + j*dlog_field);
+        }
+    }
+    m_adk_field_threshold.resize(h_field_threshold.size());
+    m_adk_log_rate_table.resize(h_log_rate_table.size());
+    amrex::Gpu::copyAsync(amrex::Gpu::hostToDevice, h_field_threshold.begin(),
+                          h_field_threshold.end(), m_adk_field_threshold.begin());
+    amrex::Gpu::copyAsync(amrex::Gpu::hostToDevice, h_log_rate_table.begin(),
+                          h_log_rate_table.end(), m_adk_log_rate_table.begin());
+    amrex::Gpu::streamSynchronize();
 }
@@ -39,6 +39,11 @@ DepositCurrentSlice (BeamParticleContainer& beam, Fields& fields, amrex::Geometr
     amrex::Real const * AMREX_RESTRICT xyzmin = grid_box.lo();
     amrex::Dim3 const lo = amrex::lbound(tilebox);
 
+    // On the coarsest level, all particles in the box deposit. On a refined level, only those
+    // in the valid region of the patch deposit, so their shape stays in the guard cells.
+    amrex::RealBox const patch = (lev == 0) ? grid_box : amrex::RealBox{
+        fields.getSlices(lev, which_slice).boxArray()[0], gm.CellSize(), gm.ProbLo()};
+
     // Extract the fields currents
     amrex::MultiFab& S = fields.getSlices(lev, which_slice);
     // we deposit to the beam currents, because the explicit solver
@@ -60,16 +65,20 @@ DepositCurrentSlice (BeamParticleContainer& beam, Fields& fields, amrex::Geometr
     // Call deposition function in each box
     if        (Hipace::m_depos_order_xy == 0){
         doDepositionShapeN<0, 0>( beam, jxb_fab, jyb_fab, jzb_fab, dx, xyzmin, lo, q, islice_local,
-                                  bins, offset, do_beam_jx_jy_deposition, which_slice, nghost);
+                                  bins, offset, do_beam_jx_jy_deposition, which_slice, patch,
+                                  nghost);
     } else if (Hipace::m_depos_order_xy == 1){
         doDepositionShapeN<1, 0>( beam, jxb_fab, jyb_fab, jzb_fab, dx, xyzmin, lo, q, islice_local,
-                                  bins, offset, do_beam_jx_jy_deposition, which_slice, nghost);
+                                  bins, offset, do_beam_jx_jy_deposition, which_slice, patch,
+                                  nghost);
     } else if (Hipace::m_depos_order_xy == 2){
         doDepositionShapeN<2, 0>( beam, jxb_fab, jyb_fab, jzb_fab, dx, xyzmin, lo, q, islice_local,
-                                  bins, offset, do_beam_jx_jy_deposition, which_slice, nghost);
+                                  bins, offset, do_beam_jx_jy_deposition, which_slice, patch,
+                                  nghost);
     } else if (Hipace::m_depos_order_xy == 3){
         doDepositionShapeN<3, 0>( beam, jxb_fab, jyb_fab, jzb_fab, dx, xyzmin, lo, q, islice_local,
-                                  bins, offset, do_beam_jx_jy_deposition, which_slice, nghost);
+                                  bins, offset, do_beam_jx_jy_deposition, which_slice, patch,
+                                  nghost);
     } else {
         amrex::Abort("unknown deposition order");
     }
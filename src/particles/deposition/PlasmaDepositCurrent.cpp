@@ -7,6 +7,102 @@
 #include "Hipace.H"
 #include "utils/HipaceProfilerWrapper.H"
 
+namespace
+{
+    /** \brief Call doDepositionShapeN with the charge multiplied by ion_lev or not
+     *
+     * \tparam depos_order_xy Order of the transverse shape factor for the deposition
+     * \tparam temp_slice if true, the temporary data (x_temp, ...) is used
+     * \tparam deposit_jx_jy if true, deposit to jx and jy
+     * \tparam deposit_jz if true, deposit to jz
+     * \tparam deposit_rho if true, deposit to rho
+     * \tparam deposit_j_squared if true, deposit jxx, jxy and jyy
+     * \param[in] pti particle iterator, contains data of all particles in a tile
+     * \param[in,out] arrs arrays of jx, jy, jz, rho, jxx, jxy and jyy
+     * \param[in,out] rows rows of arrs deposited to, see DepositionRows
+     * \param[in] dx cell size in each dimension
+     * \param[in] xyzmin lower corner of the box, in physical space
+     * \param[in] lo lower corner of the box, in index space
+     * \param[in] q charge of a particle
+     * \param[in] can_ionize whether charge needs to be multiplied by ion_lev
+     * \param[in] max_qsa_weighting_factor maximum allowed weighting factor gamma/(Psi+1)
+     * \return number of particles violating the quasi-static approximation
+     */
+    template <int depos_order_xy, bool temp_slice, bool deposit_jx_jy, bool deposit_jz,
+              bool deposit_rho, bool deposit_j_squared>
+    int DepositWithIonization (const PlasmaParticleIterator& pti,
+                               amrex::GpuArray<amrex::Array4<amrex::Real>, 7> const& arrs,
+                               DepositionRows& rows,
+                               amrex::Real const * const AMREX_RESTRICT dx,
+                               amrex::Real const * const AMREX_RESTRICT xyzmin,
+                               amrex::Dim3 const lo, amrex::Real const q, const bool can_ionize,
+                               const amrex::Real max_qsa_weighting_factor)
+    {
+        if (can_ionize) {
+            return doDepositionShapeN<depos_order_xy, 0, true, temp_slice, deposit_jx_jy,
+                                      deposit_jz, deposit_rho, deposit_j_squared>(
+                pti, arrs, rows, dx, xyzmin, lo, q, max_qsa_weighting_factor);
+        } else {
+            return doDepositionShapeN<depos_order_xy, 0, false, temp_slice, deposit_jx_jy,
+                                      deposit_jz, deposit_rho, deposit_j_squared>(
+                pti, arrs, rows, dx, xyzmin, lo, q, max_qsa_weighting_factor);
+        }
+    }
+
+    /** \brief Turn the deposition flags into template parameters, for the combinations used in
+     * the solver: the current and density of this slice (with or without the j squared terms),
+     * the ion background density and the transverse currents of the next slice.
+     *
+     * \tparam depos_order_xy Order of the transverse shape factor for the deposition
+     * \param[in] pti particle iterator, contains data of all particles in a tile
+     * \param[in,out] arrs arrays of jx, jy, jz, rho, jxx, jxy and jyy
+     * \param[in,out] rows rows of arrs deposited to, see DepositionRows
+     * \param[in] dx cell size in each dimension
+     * \param[in] xyzmin lower corner of the box, in physical space
+     * \param[in] lo lower corner of the box, in index space
+     * \param[in] q charge of a particle
+     * \param[in] can_ionize whether charge needs to be multiplied by ion_lev
+     * \param[in] temp_slice if true, the temporary data (x_temp, ...) is used
+     * \param[in] deposit_jx_jy if true, deposit to jx and jy
+     * \param[in] deposit_jz if true, deposit to jz
+     * \param[in] deposit_rho if true, deposit to rho
+     * \param[in] deposit_j_squared if true, deposit jxx, jxy and jyy
+     * \param[in] max_qsa_weighting_factor maximum allowed weighting factor gamma/(Psi+1)
+     * \return number of particles violating the quasi-static approximation
+     */
+    template <int depos_order_xy>
+    int DepositWithFlags (const PlasmaParticleIterator& pti,
+                          amrex::GpuArray<amrex::Array4<amrex::Real>, 7> const& arrs,
+                          DepositionRows& rows,
+                          amrex::Real const * const AMREX_RESTRICT dx,
+                          amrex::Real const * const AMREX_RESTRICT xyzmin,
+                          amrex::Dim3 const lo, amrex::Real const q, const bool can_ionize,
+                          const bool temp_slice, const bool deposit_jx_jy, const bool deposit_jz,
+                          const bool deposit_rho, const bool deposit_j_squared,
+                          const amrex::Real max_qsa_weighting_factor)
+    {
+        if (!temp_slice && deposit_jx_jy && deposit_jz && deposit_rho && deposit_j_squared) {
+            return DepositWithIonization<depos_order_xy, false, true, true, true, true>(
+                pti, arrs, rows, dx, xyzmin, lo, q, can_ionize, max_qsa_weighting_factor);
+        } else if (!temp_slice && deposit_jx_jy && deposit_jz && deposit_rho) {
+            return DepositWithIonization<depos_order_xy, false, true, true, true, false>(
+                pti, arrs, rows, dx, xyzmin, lo, q, can_ionize, max_qsa_weighting_factor);
+        } else if (!temp_slice && !deposit_jx_jy && !deposit_jz && deposit_rho &&
+                   !deposit_j_squared) {
+            return DepositWithIonization<depos_order_xy, false, false, false, true, false>(
+                pti, arrs, rows, dx, xyzmin, lo, q, can_ionize, max_qsa_weighting_factor);
+        } else if (temp_slice && deposit_jx_jy && !deposit_jz && !deposit_rho &&
+                   !deposit_j_squared) {
+            return DepositWithIonization<depos_order_xy, true, true, false, false, false>(
+                pti, arrs, rows, dx, xyzmin, lo, q, can_ionize, max_qsa_weighting_factor);
+        } else {
+            amrex::Abort("This combination of plasma deposition flags is not instantiated, "
+                         "add it to DepositWithFlags");
+        }
+        return 0;
+    }
+}
+
 void
 DepositCurrent (PlasmaParticleContainer& plasma, Fields & fields,
                 const int which_slice, const bool temp_slice,
@@ -28,62 +124,72 @@ DepositCurrent (PlasmaParticleContainer& plasma, Fields & fields,
     const amrex::Real q = (which_slice == WhichSlice::RhoIons) ? -plasma.m_charge : plasma.m_charge;
     const bool can_ionize = plasma.m_can_ionize;
 
-    // Loop over particle boxes
-    for (PlasmaParticleIterator pti(plasma, lev); pti.isValid(); ++pti)
+    // Extract the fields currents
+    amrex::MultiFab& S = fields.getSlices(lev, which_slice);
+    AMREX_ALWAYS_ASSERT_WITH_MESSAGE(S.ixType().cellCentered(),
+        "jx, jy, jz, and rho must be nodal in all directions.");
+
+    int n_qsa_violation = 0;
+
+    // Loop over the boxes of the slice. All particle tiles of a box deposit into its arrays.
+    for (amrex::MFIter mfi(S); mfi.isValid(); ++mfi)
     {
-        // Extract properties associated with the extent of the current box
-        amrex::Box tilebox = pti.tilebox().grow(
-            {Hipace::m_depos_order_xy, Hipace::m_depos_order_xy, 0});
-
-        amrex::RealBox const grid_box{tilebox, gm.CellSize(), gm.ProbLo()};
-        amrex::Real const * AMREX_RESTRICT xyzmin = grid_box.lo();
-        amrex::Dim3 const lo = amrex::lbound(tilebox);
-
-        // Extract the fields currents
-        amrex::MultiFab& S = fields.getSlices(lev, which_slice);
-        amrex::MultiFab jx(S, amrex::make_alias, Comps[which_slice]["jx"], 1);
-        amrex::MultiFab jy(S, amrex::make_alias, Comps[which_slice]["jy"], 1);
-        amrex::MultiFab jz(S, amrex::make_alias, Comps[which_slice]["jz"], 1);
-        amrex::MultiFab rho(S, amrex::make_alias, Comps[which_slice]["rho"], 1);
-        amrex::MultiFab jxx(S, amrex::make_alias, Comps[which_slice]["jxx"], 1);
-        amrex::MultiFab jxy(S, amrex::make_alias, Comps[which_slice]["jxy"], 1);
-        amrex::MultiFab jyy(S, amrex::make_alias, Comps[which_slice]["jyy"], 1);
-
-        // Extract FabArray for this box
-        amrex::FArrayBox& jx_fab = jx[pti];
-        amrex::FArrayBox& jy_fab = jy[pti];
-        amrex::FArrayBox& jz_fab = jz[pti];
-        amrex::FArrayBox& rho_fab = rho[pti];
-        amrex::FArrayBox& jxx_fab = jxx[pti];
-        amrex::FArrayBox& jxy_fab = jxy[pti];
-        amrex::FArrayBox& jyy_fab = jyy[pti];
-
-        if        (Hipace::m_depos_order_xy == 0){
-                doDepositionShapeN<0, 0>( pti, jx_fab, jy_fab, jz_fab, rho_fab,
-                                          jxx_fab, jxy_fab, jyy_fab,
-                                          dx, xyzmin, lo, q, can_ionize, temp_slice,
-                                          deposit_jx_jy, deposit_jz, deposit_rho,
-                                          deposit_j_squared, max_qsa_weighting_factor);
-        } else if (Hipace::m_depos_order_xy == 1){
-                doDepositionShapeN<1, 0>( pti, jx_fab, jy_fab, jz_fab, rho_fab,
-                                          jxx_fab, jxy_fab, jyy_fab,
-                                          dx, xyzmin, lo, q, can_ionize, temp_slice,
-                                          deposit_jx_jy, deposit_jz, deposit_rho,
-                                          deposit_j_squared, max_qsa_weighting_factor);
-        } else if (Hipace::m_depos_order_xy == 2){
-                doDepositionShapeN<2, 0>( pti, jx_fab, jy_fab, jz_fab, rho_fab,
-                                          jxx_fab, jxy_fab, jyy_fab,
-                                          dx, xyzmin, lo, q, can_ionize, temp_slice,
-                                          deposit_jx_jy, deposit_jz, deposit_rho,
-                                          deposit_j_squared, max_qsa_weighting_factor);
-        } else if (Hipace::m_depos_order_xy == 3){
-                doDepositionShapeN<3, 0>( pti, jx_fab, jy_fab, jz_fab, rho_fab,
-                                          jxx_fab, jxy_fab, jyy_fab,
-                                          dx, xyzmin, lo, q, can_ionize, temp_slice,
-                                          deposit_jx_jy, deposit_jz, deposit_rho,
-                                          deposit_j_squared, max_qsa_weighting_factor);
-        } else {
-            amrex::Abort("unknow deposition order");
-        }
+        amrex::FArrayBox& fab = S[mfi];
+        const amrex::GpuArray<amrex::Array4<amrex::Real>, 7> arrs {
+            fab.array(Comps[which_slice]["jx"]), fab.array(Comps[which_slice]["jy"]),
+            fab.array(Comps[which_slice]["jz"]), fab.array(Comps[which_slice]["rho"]),
+            fab.array(Comps[which_slice]["jxx"]), fab.array(Comps[which_slice]["jxy"]),
+            fab.array(Comps[which_slice]["jyy"])};
+        const amrex::GpuArray<bool, 7> active {deposit_jx_jy, deposit_jx_jy, deposit_jz,
+            deposit_rho, deposit_j_squared, deposit_j_squared, deposit_j_squared};
+
+        auto deposit_tiles = [&] (amrex::GpuArray<amrex::Array4<amrex::Real>, 7> const& depos,
+                                  DepositionRows& rows)
+        {
+            // Loop over particle tiles
+            for (PlasmaParticleIterator pti(plasma, lev); pti.isValid(); ++pti)
+            {
+                if (pti.index() != mfi.index()) continue;
+
+                // Extract properties associated with the extent of the current tile
+                amrex::Box tilebox = pti.tilebox().grow(
+                    {Hipace::m_depos_order_xy, Hipace::m_depos_order_xy, 0});
+
+                amrex::RealBox const grid_box{tilebox, gm.CellSize(), gm.ProbLo()};
+                amrex::Real const * AMREX_RESTRICT xyzmin = grid_box.lo();
+                amrex::Dim3 const lo = amrex::lbound(tilebox);
+
+                int n_tile = 0;
+                if        (Hipace::m_depos_order_xy == 0){
+                    n_tile = DepositWithFlags<0>(pti, depos, rows, dx, xyzmin, lo, q,
+                        can_ionize, temp_slice, deposit_jx_jy, deposit_jz, deposit_rho,
+                        deposit_j_squared, max_qsa_weighting_factor);
+                } else if (Hipace::m_depos_order_xy == 1){
+                    n_tile = DepositWithFlags<1>(pti, depos, rows, dx, xyzmin, lo, q,
+                        can_ionize, temp_slice, deposit_jx_jy, deposit_jz, deposit_rho,
+                        deposit_j_squared, max_qsa_weighting_factor);
+                } else if (Hipace::m_depos_order_xy == 2){
+                    n_tile = DepositWithFlags<2>(pti, depos, rows, dx, xyzmin, lo, q,
+                        can_ionize, temp_slice, deposit_jx_jy, deposit_jz, deposit_rho,
+                        deposit_j_squared, max_qsa_weighting_factor);
+                } else if (Hipace::m_depos_order_xy == 3){
+                    n_tile = DepositWithFlags<3>(pti, depos, rows, dx, xyzmin, lo, q,
+                        can_ionize, temp_slice, deposit_jx_jy, deposit_jz, deposit_rho,
+                        deposit_j_squared, max_qsa_weighting_factor);
+                } else {
+                    amrex::Abort("unknow deposition order");
+                }
+                amrex::HostDevice::Atomic::Add(&n_qsa_violation, n_tile);
+            }
+        };
+
+        // On CPU, the tiles are distributed among the threads, and each thread deposits its
+        // tiles into a private copy of the arrays
+        ThreadPrivateDeposition<7>(fab.box(), arrs, active, Hipace::m_depos_order_xy + 1,
+                                   deposit_tiles);
     }
+
+    if (n_qsa_violation > 0 && (Hipace::m_verbose >= 3))
+        amrex::Print()<< "number of QSA violating particles on this slice: "
+                      << n_qsa_violation << "\n";
 }
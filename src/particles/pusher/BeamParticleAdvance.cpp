@@ -5,163 +5,266 @@
 #include "GetAndSetPosition.H"
 #include "utils/HipaceProfilerWrapper.H"
 
+namespace
+{
+    /** \brief Implementation of AdvanceBeamParticlesSlice for a given deposition order
+     *
+     * \tparam depos_order_xy Order of the transverse shape factor for the field gather
+     * \param[in,out] beam species of which the current is deposited
+     * \param[in] fields the general field class, modified by this function
+     * \param[in] gm Geometry of the simulation, to get the cell size etc.
+     * \param[in] lev MR level
+     * \param[in] islice index of the slice on which the beam particles are pushed
+     * \param[in] box current box to calculate in loop over longutidinal boxes
+     * \param[in] offset offset to the current box
+     * \param[in] bins beam particle container bins, to push only the beam particles on slice islice
+     * \param[in] dt_betatron_coeff coefficient of the time step resolving the betatron period,
+     *            0 to disable sub-cycling
+     */
+    template <int depos_order_xy>
+    void AdvanceBeamParticlesSliceImpl (BeamParticleContainer& beam, Fields& fields,
+                                        amrex::Geometry const& gm, int const lev,
+                                        const int islice, const amrex::Box box, const int offset,
+                                        BeamBins& bins, const amrex::Real dt_betatron_coeff)
+    {
+        using namespace amrex::literals;
+
+        // Extract properties associated with physical size of the box
+        amrex::Real const * AMREX_RESTRICT dx = gm.CellSize();
+        const PhysConst phys_const = get_phys_const();
+
+        const bool do_z_push = beam.m_do_z_push;
+
+        const amrex::Real dt = Hipace::m_dt;
+
+        // Assumes '2' == 'z' == 'the long dimension'.
+        int islice_local = islice - box.smallEnd(2);
+
+        // Extract properties associated with the extent of the current box
+        amrex::Box tilebox = box;
+        tilebox.grow({depos_order_xy, depos_order_xy, Hipace::m_depos_order_z});
+
+        amrex::RealBox const grid_box{tilebox, gm.CellSize(), gm.ProbLo()};
+        amrex::Real const * AMREX_RESTRICT xyzmin = grid_box.lo();
+        amrex::Dim3 const lo = amrex::lbound(tilebox);
+
+        // Extract the fields
+        const amrex::MultiFab& S = fields.getSlices(lev, WhichSlice::This);
+        const amrex::MultiFab exmby(S, amrex::make_alias, Comps[WhichSlice::This]["ExmBy"], 1);
+        const amrex::MultiFab eypbx(S, amrex::make_alias, Comps[WhichSlice::This]["EypBx"], 1);
+        const amrex::MultiFab ez(S, amrex::make_alias, Comps[WhichSlice::This]["Ez"], 1);
+        const amrex::MultiFab bx(S, amrex::make_alias, Comps[WhichSlice::This]["Bx"], 1);
+        const amrex::MultiFab by(S, amrex::make_alias, Comps[WhichSlice::This]["By"], 1);
+        const amrex::MultiFab bz(S, amrex::make_alias, Comps[WhichSlice::This]["Bz"], 1);
+
+        // Extract field array from FabArrays in MultiFabs.
+        // (because there is currently no transverse parallelization, the index
+        // we want in the slice multifab is always 0. Fix later.
+        amrex::Array4<const amrex::Real> const& exmby_arr = exmby[0].array();
+        amrex::Array4<const amrex::Real> const& eypbx_arr = eypbx[0].array();
+        amrex::Array4<const amrex::Real> const& ez_arr = ez[0].array();
+        amrex::Array4<const amrex::Real> const& bx_arr = bx[0].array();
+        amrex::Array4<const amrex::Real> const& by_arr = by[0].array();
+        amrex::Array4<const amrex::Real> const& bz_arr = bz[0].array();
+
+        const amrex::GpuArray<amrex::Real, 3> dx_arr = {dx[0], dx[1], dx[2]};
+        const amrex::GpuArray<amrex::Real, 3> xyzmin_arr = {xyzmin[0], xyzmin[1], xyzmin[2]};
+
+        // With mesh refinement, particles in the valid region of the refined patch gather the
+        // fields of level lev+1. Without, the patch is empty and the fine arrays are not used.
+        Hipace const& hipace = Hipace::GetInstance();
+        const bool has_patch = lev < hipace.maxLevel();
+        const int lev_fine = has_patch ? lev+1 : lev;
+        const amrex::Geometry& gm_fine = hipace.Geom(lev_fine);
+        const amrex::FArrayBox& fine_fab = fields.getSlices(lev_fine, WhichSlice::This)[0];
+        amrex::Box tilebox_fine = fields.getSlices(lev_fine, WhichSlice::This).boxArray()[0];
+        const amrex::RealBox patch = has_patch ?
+            amrex::RealBox{tilebox_fine, gm_fine.CellSize(), gm_fine.ProbLo()} : amrex::RealBox{};
+        tilebox_fine.setSmall(Direction::z, tilebox.smallEnd(Direction::z));
+        tilebox_fine.setBig(Direction::z, tilebox.bigEnd(Direction::z));
+        tilebox_fine.grow({depos_order_xy, depos_order_xy, 0});
+        amrex::RealBox const grid_box_fine{tilebox_fine, gm_fine.CellSize(), gm_fine.ProbLo()};
+        const amrex::GpuArray<amrex::Real, 3> dx_fine_arr = gm_fine.CellSizeArray();
+        const amrex::GpuArray<amrex::Real, 3> xyzmin_fine_arr =
+            {grid_box_fine.lo(0), grid_box_fine.lo(1), grid_box_fine.lo(2)};
+        amrex::Dim3 const lo_fine = amrex::lbound(tilebox_fine);
+        const amrex::Real patch_xlo = patch.lo(0);
+        const amrex::Real patch_xhi = patch.hi(0);
+        const amrex::Real patch_ylo = patch.lo(1);
+        const amrex::Real patch_yhi = patch.hi(1);
+        amrex::Array4<const amrex::Real> const exmby_fine_arr =
+            fine_fab.const_array(Comps[WhichSlice::This]["ExmBy"]);
+        amrex::Array4<const amrex::Real> const eypbx_fine_arr =
+            fine_fab.const_array(Comps[WhichSlice::This]["EypBx"]);
+        amrex::Array4<const amrex::Real> const ez_fine_arr =
+            fine_fab.const_array(Comps[WhichSlice::This]["Ez"]);
+        amrex::Array4<const amrex::Real> const bx_fine_arr =
+            fine_fab.const_array(Comps[WhichSlice::This]["Bx"]);
+        amrex::Array4<const amrex::Real> const by_fine_arr =
+            fine_fab.const_array(Comps[WhichSlice::This]["By"]);
+        amrex::Array4<const amrex::Real> const bz_fine_arr =
+            fine_fab.const_array(Comps[WhichSlice::This]["Bz"]);
+
+        // Extract particle properties
+        auto& soa = beam.GetStructOfArrays(); // For momenta and weights
+        amrex::Real * const uxp = soa.GetRealData(BeamIdx::ux).data() + offset;
+        amrex::Real * const uyp = soa.GetRealData(BeamIdx::uy).data() + offset;
+        amrex::Real * const uzp = soa.GetRealData(BeamIdx::uz).data() + offset;
+
+        const auto getPosition = GetParticlePosition<BeamParticleContainer>(beam, offset);
+        const auto setPosition = SetParticlePosition<BeamParticleContainer>(beam, offset);
+        const auto enforceBC = EnforceBC<BeamParticleContainer>(beam, lev, offset);
+
+        const amrex::Real zmin = xyzmin[2];
+
+        // Declare a DenseBins to pass it to doDepositionShapeN, although it will not be used.
+        BeamBins::index_type*
+            indices = nullptr;
+        BeamBins::index_type const *
+            offsets = nullptr;
+        indices = bins.permutationPtr();
+        offsets = bins.offsetsPtr();
+        BeamBins::index_type const
+            cell_start = offsets[islice_local], cell_stop = offsets[islice_local+1];
+        // The particles that are in slice islice_local are
+        // given by the indices[cell_start:cell_stop]
+
+        int const num_particles = cell_stop-cell_start;
+
+        const amrex::Real clightsq = 1.0_rt/(phys_const.c*phys_const.c);
+        const amrex::Real charge_mass_ratio = - phys_const.q_e / phys_const.m_e;
+        const amrex::Real external_ExmBy_slope = Hipace::m_external_ExmBy_slope;
+        const amrex::Real external_Ez_slope = Hipace::m_external_Ez_slope;
+        const amrex::Real external_Ez_uniform = Hipace::m_external_Ez_uniform;
+
+        // Sub-cycling: the time step resolving the betatron period of a particle with Lorentz
+        // factor gamma is sqrt(gamma)*dt_betatron_coeff
+        const int max_substeps = dt_betatron_coeff > 0._rt ? beam.m_max_substeps : 1;
+
+        amrex::ParallelFor(
+            num_particles,
+            [=] AMREX_GPU_DEVICE (long idx) {
+                const int ip = indices[cell_start+idx];
+
+                amrex::ParticleReal xp, yp, zp;
+                int pid;
+                getPosition(ip, xp, yp, zp, pid);
+                if (pid < 0) return;
+
+                // Particles with a betatron period short compared with dt are pushed with
+                // several sub-steps in the fields of this slice
+                int n_substeps = 1;
+                if (max_substeps > 1) {
+                    const amrex::ParticleReal gamma_init = sqrt(
+                        1.0_rt + uxp[ip]*uxp[ip]*clightsq
+                        + uyp[ip]*uyp[ip]*clightsq + uzp[ip]*uzp[ip]*clightsq);
+                    const amrex::Real dt_betatron = sqrt(gamma_init)*dt_betatron_coeff;
+                    n_substeps = amrex::min(max_substeps,
+                                            amrex::max(1, int(std::ceil(dt/dt_betatron))));
+                }
+                const amrex::Real dt_sub = dt/n_substeps;
+
+                for (int isub = 0; isub < n_substeps; ++isub) {
+
+                    const amrex::ParticleReal gammap = sqrt(
+                        1.0_rt + uxp[ip]*uxp[ip]*clightsq
+                        + uyp[ip]*uyp[ip]*clightsq + uzp[ip]*uzp[ip]*clightsq);
+
+                    // first we do half a step in x,y
+                    // This is not required in z, which is pushed in one step later
+                    xp += dt_sub * 0.5_rt * uxp[ip] / gammap;
+                    yp += dt_sub * 0.5_rt * uyp[ip] / gammap;
+
+                    setPosition(ip, xp, yp, zp);
+                    if (enforceBC(ip)) return;
+
+                    // define field at particle position reals
+                    amrex::ParticleReal ExmByp = 0._rt, EypBxp = 0._rt, Ezp = 0._rt;
+                    amrex::ParticleReal Bxp = 0._rt, Byp = 0._rt, Bzp = 0._rt;
+
+                    // field gather for a single particle, on the finest level that contains it
+                    if (xp >= patch_xlo && xp < patch_xhi && yp >= patch_ylo && yp < patch_yhi) {
+                        doGatherShapeN<depos_order_xy, 0>(
+                            xp, yp, zmin, ExmByp, EypBxp, Ezp, Bxp, Byp, Bzp,
+                            exmby_fine_arr, eypbx_fine_arr, ez_fine_arr,
+                            bx_fine_arr, by_fine_arr, bz_fine_arr,
+                            dx_fine_arr, xyzmin_fine_arr, lo_fine);
+                    } else {
+                        doGatherShapeN<depos_order_xy, 0>(
+                            xp, yp, zmin, ExmByp, EypBxp, Ezp, Bxp, Byp, Bzp,
+                            exmby_arr, eypbx_arr, ez_arr, bx_arr, by_arr, bz_arr,
+                            dx_arr, xyzmin_arr, lo);
+                    }
+
+                    ApplyExternalField(xp, yp, zp, ExmByp, EypBxp, Ezp, external_ExmBy_slope,
+                                       external_Ez_slope, external_Ez_uniform);
+
+                    // use intermediate fields to calculate next (n+1) transverse momenta
+                    const amrex::ParticleReal ux_next = uxp[ip] + dt_sub * charge_mass_ratio
+                        * ( ExmByp + ( phys_const.c - uzp[ip] / gammap ) * Byp );
+                    const amrex::ParticleReal uy_next = uyp[ip] + dt_sub * charge_mass_ratio
+                        * ( EypBxp + ( uzp[ip] / gammap - phys_const.c ) * Bxp );
+
+                    // Now computing new longitudinal momentum
+                    const amrex::ParticleReal ux_intermediate = ( ux_next + uxp[ip] ) * 0.5_rt;
+                    const amrex::ParticleReal uy_intermediate = ( uy_next + uyp[ip] ) * 0.5_rt;
+                    const amrex::ParticleReal uz_intermediate = uzp[ip]
+                        + dt_sub * 0.5_rt * charge_mass_ratio * Ezp;
+
+                    const amrex::ParticleReal gamma_intermediate = sqrt(
+                        1.0_rt + ux_intermediate*ux_intermediate*clightsq +
+                        uy_intermediate*uy_intermediate*clightsq +
+                        uz_intermediate*uz_intermediate*clightsq );
+
+                    const amrex::ParticleReal uz_next = uzp[ip] + dt_sub * charge_mass_ratio
+                        * ( Ezp + ( ux_intermediate * Byp - uy_intermediate * Bxp )
+                            / gamma_intermediate );
+
+                    /* computing next gamma value */
+                    const amrex::ParticleReal gamma_next = sqrt(
+                        1.0_rt + uz_next*uz_next*clightsq
+                        + ux_next*ux_next*clightsq + uy_next*uy_next*clightsq );
+
+                    /*
+                     * computing positions and setting momenta for the next timestep
+                     *(n+1)
+                     * The longitudinal position is updated here as well, but in
+                     * first-order (i.e. without the intermediary half-step) using
+                     * a simple Galilean transformation
+                     */
+                    xp += dt_sub * 0.5_rt * ux_next  / gamma_next;
+                    yp += dt_sub * 0.5_rt * uy_next  / gamma_next;
+                    if (do_z_push) zp += dt_sub * ( uz_next  / gamma_next - phys_const.c );
+                    setPosition(ip, xp, yp, zp);
+                    if (enforceBC(ip)) return;
+                    uxp[ip] = ux_next;
+                    uyp[ip] = uy_next;
+                    uzp[ip] = uz_next;
+                }
+            });
+    }
+}
+
 void
 AdvanceBeamParticlesSlice (BeamParticleContainer& beam, Fields& fields, amrex::Geometry const& gm,
                            int const lev, const int islice, const amrex::Box box, const int offset,
-                           BeamBins& bins)
+                           BeamBins& bins, const amrex::Real dt_betatron_coeff)
 {
     HIPACE_PROFILE("AdvanceBeamParticlesSlice()");
-    using namespace amrex::literals;
-
-    // Extract properties associated with physical size of the box
-    amrex::Real const * AMREX_RESTRICT dx = gm.CellSize();
-    const PhysConst phys_const = get_phys_const();
-
-    const bool do_z_push = beam.m_do_z_push;
-
-    const amrex::Real dt = Hipace::m_dt;
-
-    // Assumes '2' == 'z' == 'the long dimension'.
-    int islice_local = islice - box.smallEnd(2);
-
-    // Extract properties associated with the extent of the current box
-    const int depos_order_xy = Hipace::m_depos_order_xy;
-    amrex::Box tilebox = box;
-    tilebox.grow({depos_order_xy, depos_order_xy, Hipace::m_depos_order_z});
-
-    amrex::RealBox const grid_box{tilebox, gm.CellSize(), gm.ProbLo()};
-    amrex::Real const * AMREX_RESTRICT xyzmin = grid_box.lo();
-    amrex::Dim3 const lo = amrex::lbound(tilebox);
-
-    // Extract the fields
-    const amrex::MultiFab& S = fields.getSlices(lev, WhichSlice::This);
-    const amrex::MultiFab exmby(S, amrex::make_alias, Comps[WhichSlice::This]["ExmBy"], 1);
-    const amrex::MultiFab eypbx(S, amrex::make_alias, Comps[WhichSlice::This]["EypBx"], 1);
-    const amrex::MultiFab ez(S, amrex::make_alias, Comps[WhichSlice::This]["Ez"], 1);
-    const amrex::MultiFab bx(S, amrex::make_alias, Comps[WhichSlice::This]["Bx"], 1);
-    const amrex::MultiFab by(S, amrex::make_alias, Comps[WhichSlice::This]["By"], 1);
-    const amrex::MultiFab bz(S, amrex::make_alias, Comps[WhichSlice::This]["Bz"], 1);
-
-    // Extract field array from FabArrays in MultiFabs.
-    // (because there is currently no transverse parallelization, the index
-    // we want in the slice multifab is always 0. Fix later.
-    amrex::Array4<const amrex::Real> const& exmby_arr = exmby[0].array();
-    amrex::Array4<const amrex::Real> const& eypbx_arr = eypbx[0].array();
-    amrex::Array4<const amrex::Real> const& ez_arr = ez[0].array();
-    amrex::Array4<const amrex::Real> const& bx_arr = bx[0].array();
-    amrex::Array4<const amrex::Real> const& by_arr = by[0].array();
-    amrex::Array4<const amrex::Real> const& bz_arr = bz[0].array();
-
-    const amrex::GpuArray<amrex::Real, 3> dx_arr = {dx[0], dx[1], dx[2]};
-    const amrex::GpuArray<amrex::Real, 3> xyzmin_arr = {xyzmin[0], xyzmin[1], xyzmin[2]};
-
-    // Extract particle properties
-    auto& soa = beam.GetStructOfArrays(); // For momenta and weights
-    amrex::Real * const uxp = soa.GetRealData(BeamIdx::ux).data() + offset;
-    amrex::Real * const uyp = soa.GetRealData(BeamIdx::uy).data() + offset;
-    amrex::Real * const uzp = soa.GetRealData(BeamIdx::uz).data() + offset;
-
-    const auto getPosition = GetParticlePosition<BeamParticleContainer>(beam, offset);
-    const auto setPosition = SetParticlePosition<BeamParticleContainer>(beam, offset);
-    const auto enforceBC = EnforceBC<BeamParticleContainer>(beam, lev, offset);
-
-    const amrex::Real zmin = xyzmin[2];
-
-    // Declare a DenseBins to pass it to doDepositionShapeN, although it will not be used.
-    BeamBins::index_type*
-        indices = nullptr;
-    BeamBins::index_type const *
-        offsets = nullptr;
-    indices = bins.permutationPtr();
-    offsets = bins.offsetsPtr();
-    BeamBins::index_type const
-        cell_start = offsets[islice_local], cell_stop = offsets[islice_local+1];
-    // The particles that are in slice islice_local are
-    // given by the indices[cell_start:cell_stop]
-
-    int const num_particles = cell_stop-cell_start;
-
-    const amrex::Real clightsq = 1.0_rt/(phys_const.c*phys_const.c);
-    const amrex::Real charge_mass_ratio = - phys_const.q_e / phys_const.m_e;
-    const amrex::Real external_ExmBy_slope = Hipace::m_external_ExmBy_slope;
-    const amrex::Real external_Ez_slope = Hipace::m_external_Ez_slope;
-    const amrex::Real external_Ez_uniform = Hipace::m_external_Ez_uniform;
-
-    amrex::ParallelFor(
-        num_particles,
-        [=] AMREX_GPU_DEVICE (long idx) {
-            const int ip = indices[cell_start+idx];
-
-            amrex::ParticleReal xp, yp, zp;
-            int pid;
-            getPosition(ip, xp, yp, zp, pid);
-            if (pid < 0) return;
-
-            const amrex::ParticleReal gammap = sqrt(
-                1.0_rt + uxp[ip]*uxp[ip]*clightsq
-                + uyp[ip]*uyp[ip]*clightsq + uzp[ip]*uzp[ip]*clightsq);
-
-            // first we do half a step in x,y
-            // This is not required in z, which is pushed in one step later
-            xp += dt * 0.5_rt * uxp[ip] / gammap;
-            yp += dt * 0.5_rt * uyp[ip] / gammap;
-
-            setPosition(ip, xp, yp, zp);
-            if (enforceBC(ip)) return;
-
-            // define field at particle position reals
-            amrex::ParticleReal ExmByp = 0._rt, EypBxp = 0._rt, Ezp = 0._rt;
-            amrex::ParticleReal Bxp = 0._rt, Byp = 0._rt, Bzp = 0._rt;
-
-            // field gather for a single particle
-            doGatherShapeN(xp, yp, zmin,
-                           ExmByp, EypBxp, Ezp, Bxp, Byp, Bzp,
-                           exmby_arr, eypbx_arr, ez_arr, bx_arr, by_arr, bz_arr,
-                           dx_arr, xyzmin_arr, lo, depos_order_xy, 0);
-
-            ApplyExternalField(xp, yp, zp, ExmByp, EypBxp, Ezp,
-                               external_ExmBy_slope, external_Ez_slope, external_Ez_uniform);
-
-            // use intermediate fields to calculate next (n+1) transverse momenta
-            const amrex::ParticleReal ux_next = uxp[ip] + dt * charge_mass_ratio
-                * ( ExmByp + ( phys_const.c - uzp[ip] / gammap ) * Byp );
-            const amrex::ParticleReal uy_next = uyp[ip] + dt * charge_mass_ratio
-                * ( EypBxp + ( uzp[ip] / gammap - phys_const.c ) * Bxp );
-
-            // Now computing new longitudinal momentum
-            const amrex::ParticleReal ux_intermediate = ( ux_next + uxp[ip] ) * 0.5_rt;
-            const amrex::ParticleReal uy_intermediate = ( uy_next + uyp[ip] ) * 0.5_rt;
-            const amrex::ParticleReal uz_intermediate = uzp[ip]
-                + dt * 0.5_rt * charge_mass_ratio * Ezp;
-
-            const amrex::ParticleReal gamma_intermediate = sqrt(
-                1.0_rt + ux_intermediate*ux_intermediate*clightsq +
-                uy_intermediate*uy_intermediate*clightsq +
-                uz_intermediate*uz_intermediate*clightsq );
-
-            const amrex::ParticleReal uz_next = uzp[ip] + dt * charge_mass_ratio
-                * ( Ezp + ( ux_intermediate * Byp - uy_intermediate * Bxp )
-                    / gamma_intermediate );
-
-            /* computing next gamma value */
-            const amrex::ParticleReal gamma_next = sqrt( 1.0_rt + uz_next*uz_next*clightsq
-                                                         + ux_next*ux_next*clightsq
-                                                         + uy_next*uy_next*clightsq );
-
-            /*
-             * computing positions and setting momenta for the next timestep
-             *(n+1)
-             * The longitudinal position is updated here as well, but in
-             * first-order (i.e. without the intermediary half-step) using
-             * a simple Galilean transformation
-             */
-            xp += dt * 0.5_rt * ux_next  / gamma_next;
-            yp += dt * 0.5_rt * uy_next  / gamma_next;
-            if (do_z_push) zp += dt * ( uz_next  / gamma_next - phys_const.c );
-            setPosition(ip, xp, yp, zp);
-            if (enforceBC(ip)) return;
-            uxp[ip] = ux_next;
-            uyp[ip] = uy_next;
-            uzp[ip] = uz_next;
-        });
+
+    if        (Hipace::m_depos_order_xy == 0){
+        AdvanceBeamParticlesSliceImpl<0>(beam, fields, gm, lev, islice, box, offset, bins,
+                                         dt_betatron_coeff);
+    } else if (Hipace::m_depos_order_xy == 1){
+        AdvanceBeamParticlesSliceImpl<1>(beam, fields, gm, lev, islice, box, offset, bins,
+                                         dt_betatron_coeff);
+    } else if (Hipace::m_depos_order_xy == 2){
+        AdvanceBeamParticlesSliceImpl<2>(beam, fields, gm, lev, islice, box, offset, bins,
+                                         dt_betatron_coeff);
+    } else if (Hipace::m_depos_order_xy == 3){
+        AdvanceBeamParticlesSliceImpl<3>(beam, fields, gm, lev, islice, box, offset, bins,
+                                         dt_betatron_coeff);
+    } else {
+        amrex::Abort("unknown deposition order");
+    }
 }
@@ -8,163 +8,479 @@
 #include "utils/Constants.H"
 #include "Hipace.H"
 #include "GetAndSetPosition.H"
+#include "particles/deposition/PlasmaDepositCurrentInner.H"
+#include "particles/deposition/ParallelDeposition.H"
 #include "utils/HipaceProfilerWrapper.H"
 
+namespace
+{
+    /** \brief Implementation of AdvancePlasmaParticles for a given deposition order
+     *
+     * \tparam depos_order_xy Order of the transverse shape factor for the field gather
+     * \param[in,out] plasma plasma species to push
+     * \param[in,out] fields the general field class, modified by this function
+     * \param[in] gm Geometry of the simulation, to get the cell size etc.
+     * \param[in] temp_slice if true, the temporary data (x_temp, ...) will be used
+     * \param[in] do_push boolean to define if plasma particles are pushed
+     * \param[in] do_update boolean to define if the force terms are updated
+     * \param[in] lev MR level
+     */
+    template <int depos_order_xy>
+    void AdvancePlasmaParticlesImpl (PlasmaParticleContainer& plasma, Fields & fields,
+                                     amrex::Geometry const& gm, const bool temp_slice,
+                                     const bool do_push, const bool do_update, int const lev)
+    {
+        using namespace amrex::literals;
+
+        // Extract properties associated with physical size of the box
+        amrex::Real const * AMREX_RESTRICT dx = gm.CellSize();
+        const PhysConst phys_const = get_phys_const();
+
+        // Extract the fields
+        const amrex::MultiFab& S = fields.getSlices(lev, WhichSlice::This);
+        const amrex::MultiFab exmby(S, amrex::make_alias, Comps[WhichSlice::This]["ExmBy"], 1);
+        const amrex::MultiFab eypbx(S, amrex::make_alias, Comps[WhichSlice::This]["EypBx"], 1);
+        const amrex::MultiFab ez(S, amrex::make_alias, Comps[WhichSlice::This]["Ez"], 1);
+        const amrex::MultiFab bx(S, amrex::make_alias, Comps[WhichSlice::This]["Bx"], 1);
+        const amrex::MultiFab by(S, amrex::make_alias, Comps[WhichSlice::This]["By"], 1);
+        const amrex::MultiFab bz(S, amrex::make_alias, Comps[WhichSlice::This]["Bz"], 1);
+
+        // Loop over particle tiles, distributed among the threads with tiling on CPU
+#ifdef AMREX_USE_OMP
+#pragma omp parallel if (PlasmaParticleContainer::TilesOnThreads())
+#endif
+        for (PlasmaParticleIterator pti(plasma, lev); pti.isValid(); ++pti)
+        {
+            // Extract properties associated with the extent of the current tile
+            // Grow to capture the extent of the particle shape
+            amrex::Box tilebox = pti.tilebox().grow({depos_order_xy, depos_order_xy, 0});
+
+            amrex::RealBox const grid_box{tilebox, gm.CellSize(), gm.ProbLo()};
+            amrex::Real const * AMREX_RESTRICT xyzmin = grid_box.lo();
+            amrex::Dim3 const lo = amrex::lbound(tilebox);
+
+            // Extract FabArray for this box
+            const amrex::FArrayBox& exmby_fab = exmby[pti];
+            const amrex::FArrayBox& eypbx_fab = eypbx[pti];
+            const amrex::FArrayBox& ez_fab = ez[pti];
+            const amrex::FArrayBox& bx_fab = bx[pti];
+            const amrex::FArrayBox& by_fab = by[pti];
+            const amrex::FArrayBox& bz_fab = bz[pti];
+            // Extract field array from FabArray
+            amrex::Array4<const amrex::Real> const& exmby_arr = exmby_fab.array();
+            amrex::Array4<const amrex::Real> const& eypbx_arr = eypbx_fab.array();
+            amrex::Array4<const amrex::Real> const& ez_arr = ez_fab.array();
+            amrex::Array4<const amrex::Real> const& bx_arr = bx_fab.array();
+            amrex::Array4<const amrex::Real> const& by_arr = by_fab.array();
+            amrex::Array4<const amrex::Real> const& bz_arr = bz_fab.array();
+
+            const amrex::GpuArray<amrex::Real, 3> dx_arr = {dx[0], dx[1], dx[2]};
+            const amrex::GpuArray<amrex::Real, 3> xyzmin_arr = {xyzmin[0], xyzmin[1], xyzmin[2]};
+
+            auto& soa = pti.GetStructOfArrays(); // For momenta and weights
+
+            // loading the data
+            amrex::Real * const uxp = soa.GetRealData(PlasmaIdx::ux).data();
+            amrex::Real * const uyp = soa.GetRealData(PlasmaIdx::uy).data();
+            amrex::Real * const psip = soa.GetRealData(PlasmaIdx::psi).data();
+
+            amrex::Real * const x_prev = soa.GetRealData(PlasmaIdx::x_prev).data();
+            amrex::Real * const y_prev = soa.GetRealData(PlasmaIdx::y_prev).data();
+            const PlasmaForcePtr ux_temp = GetPlasmaForceData(soa, PlasmaIdx::ux_temp);
+            const PlasmaForcePtr uy_temp = GetPlasmaForceData(soa, PlasmaIdx::uy_temp);
+            const PlasmaForcePtr psi_temp = GetPlasmaForceData(soa, PlasmaIdx::psi_temp);
+
+            // Force terms sorted by age, 0 is the most recent, see ForceIdx
+            amrex::GpuArray<PlasmaForcePtr, PlasmaParticleContainer::m_nforce_terms> Fx, Fy;
+            amrex::GpuArray<PlasmaForcePtr, PlasmaParticleContainer::m_nforce_terms> Fux, Fuy;
+            amrex::GpuArray<PlasmaForcePtr, PlasmaParticleContainer::m_nforce_terms> Fpsi;
+            for (int iage = 0; iage < PlasmaParticleContainer::m_nforce_terms; ++iage) {
+                Fx[iage] = GetPlasmaForceData(soa, plasma.ForceIdx(PlasmaIdx::Fx1, iage));
+                Fy[iage] = GetPlasmaForceData(soa, plasma.ForceIdx(PlasmaIdx::Fy1, iage));
+                Fux[iage] = GetPlasmaForceData(soa, plasma.ForceIdx(PlasmaIdx::Fux1, iage));
+                Fuy[iage] = GetPlasmaForceData(soa, plasma.ForceIdx(PlasmaIdx::Fuy1, iage));
+                Fpsi[iage] = GetPlasmaForceData(soa, plasma.ForceIdx(PlasmaIdx::Fpsi1, iage));
+            }
+            int * const ion_lev = soa.GetIntData(PlasmaIdx::ion_lev).data();
+
+            const amrex::Real clightsq = 1.0_rt/(phys_const.c*phys_const.c);
+
+            using PTileType = PlasmaParticleContainer::ParticleTileType;
+            const auto getPosition = GetParticlePosition<PTileType>(pti.GetParticleTile());
+            const auto SetPosition = SetParticlePosition<PTileType>(pti.GetParticleTile());
+            const auto enforceBC = EnforceBC<PTileType>(pti.GetParticleTile(), lev);
+            const amrex::Real zmin = xyzmin[2];
+            const amrex::Real dz = dx[2];
+
+            const amrex::Real charge = plasma.m_charge;
+            const amrex::Real mass = plasma.m_mass;
+            const bool can_ionize = plasma.m_can_ionize;
+            const amrex::Real psi_factor =
+                phys_const.q_e/(phys_const.m_e*phys_const.c*phys_const.c);
+
+#ifndef AMREX_USE_GPU
+            // On CPU, the force terms can be updated in a separate pass, with a gather vectorized
+            // over batches of particles. By default, they are updated in the kernel of the push.
+            const bool gather_in_batches =
+                do_update && PlasmaParticleContainer::m_gather_in_batches;
+            if (gather_in_batches) {
+                GatherFieldsInBatches<depos_order_xy>(
+                    pti.numParticles(), getPosition,
+                    exmby_arr, eypbx_arr, ez_arr, bx_arr, by_arr, bz_arr, dx_arr, xyzmin_arr, lo,
+                    [=] (long ip, amrex::ParticleReal ExmByp, amrex::ParticleReal EypBxp,
+                         amrex::ParticleReal Ezp, amrex::ParticleReal Bxp, amrex::ParticleReal Byp,
+                         amrex::ParticleReal Bzp) {
+                        const amrex::Real q = can_ionize ? ion_lev[ip] * charge : charge;
+                        UpdateForceTerms(uxp[ip], uyp[ip], psi_factor*psip[ip], ExmByp, EypBxp,
+                                         Ezp, Bxp, Byp, Bzp, Fx[0][ip], Fy[0][ip], Fux[0][ip],
+                                         Fuy[0][ip], Fpsi[0][ip], clightsq, phys_const, q, mass);
+                    });
+            }
+            const bool gather_in_kernel = do_update && !gather_in_batches;
+#else
+            const bool gather_in_kernel = do_update;
+#endif
+
+            amrex::ParallelFor(pti.numParticles(),
+                [=] AMREX_GPU_DEVICE (long ip) {
+                    amrex::ParticleReal xp, yp, zp;
+                    int pid;
+                    getPosition(ip, xp, yp, zp, pid);
+
+                    if (pid < 0) return;
+
+                    // define field at particle position reals
+                    amrex::ParticleReal ExmByp = 0._rt, EypBxp = 0._rt, Ezp = 0._rt;
+                    amrex::ParticleReal Bxp = 0._rt, Byp = 0._rt, Bzp = 0._rt;
+
+                    if (gather_in_kernel)
+                    {
+                        // field gather for a single particle
+                        doGatherShapeN<depos_order_xy, 0>(
+                            xp, yp, zmin, ExmByp, EypBxp, Ezp, Bxp, Byp, Bzp,
+                            exmby_arr, eypbx_arr, ez_arr, bx_arr, by_arr, bz_arr,
+                            dx_arr, xyzmin_arr, lo);
+                        // update force terms for a single particle
+                        const amrex::Real q = can_ionize ? ion_lev[ip] * charge : charge;
+                        UpdateForceTerms(uxp[ip], uyp[ip], psi_factor*psip[ip], ExmByp, EypBxp,
+                                         Ezp, Bxp, Byp, Bzp, Fx[0][ip], Fy[0][ip], Fux[0][ip],
+                                         Fuy[0][ip], Fpsi[0][ip], clightsq, phys_const, q, mass);
+                    }
+
+                    if (do_push)
+                    {
+                        // push a single particle
+                        PlasmaParticlePush(
+                            xp, yp, zp, uxp[ip], uyp[ip], psip[ip], x_prev[ip],
+                            y_prev[ip], ux_temp[ip], uy_temp[ip], psi_temp[ip],
+                            Fx[0][ip], Fy[0][ip], Fux[0][ip], Fuy[0][ip], Fpsi[0][ip],
+                            Fx[1][ip], Fy[1][ip], Fux[1][ip], Fuy[1][ip], Fpsi[1][ip],
+                            Fx[2][ip], Fy[2][ip], Fux[2][ip], Fuy[2][ip], Fpsi[2][ip],
+                            Fx[3][ip], Fy[3][ip], Fux[3][ip], Fuy[3][ip], Fpsi[3][ip],
+                            Fx[4][ip], Fy[4][ip], Fux[4][ip], Fuy[4][ip], Fpsi[4][ip],
+                            dz, temp_slice, ip, SetPosition, enforceBC );
+                    }
+                    return;
+                }
+                );
+        }
+    }
+}
+
 void
 AdvancePlasmaParticles (PlasmaParticleContainer& plasma, Fields & fields,
                         amrex::Geometry const& gm, const bool temp_slice, const bool do_push,
                         const bool do_update, const bool do_shift, int const lev)
 {
     HIPACE_PROFILE("UpdateForcePushParticles_PlasmaParticleContainer()");
-    using namespace amrex::literals;
 
-    // Extract properties associated with physical size of the box
-    amrex::Real const * AMREX_RESTRICT dx = gm.CellSize();
-    const PhysConst phys_const = get_phys_const();
+    // The force terms are a circular buffer: shifting them only moves its head. The slot of the
+    // oldest force term becomes the most recent one, so it must be overwritten by the update.
+    AMREX_ALWAYS_ASSERT_WITH_MESSAGE(!do_shift || do_update,
+                                     "the force terms must be updated when they are shifted");
+    if (do_shift) plasma.ShiftForceTerms();
 
-    // Loop over particle boxes
-    for (PlasmaParticleIterator pti(plasma, lev); pti.isValid(); ++pti)
+    if        (Hipace::m_depos_order_xy == 0){
+        AdvancePlasmaParticlesImpl<0>(plasma, fields, gm, temp_slice, do_push, do_update, lev);
+    } else if (Hipace::m_depos_order_xy == 1){
+        AdvancePlasmaParticlesImpl<1>(plasma, fields, gm, temp_slice, do_push, do_update, lev);
+    } else if (Hipace::m_depos_order_xy == 2){
+        AdvancePlasmaParticlesImpl<2>(plasma, fields, gm, temp_slice, do_push, do_update, lev);
+    } else if (Hipace::m_depos_order_xy == 3){
+        AdvancePlasmaParticlesImpl<3>(plasma, fields, gm, temp_slice, do_push, do_update, lev);
+    } else {
+        amrex::Abort("unknow deposition order");
+    }
+}
+
+namespace
+{
+    /** \brief Push the particles of one tile for PushAndDepositPlasmaParticles, and deposit
+     * their transverse currents to the next slice
+     *
+     * \tparam depos_order_xy Order of the transverse shape factor for the deposition
+     * \param[in,out] plasma plasma species to push
+     * \param[in,out] pti particle iterator, contains data of all particles in a tile
+     * \param[in] field_arrs ExmBy, EypBx, Ez, Bx, By and Bz of this slice
+     * \param[in,out] depos jx and jy of the next slice. On CPU, they must be private to the
+     *                 calling thread, see ThreadPrivateDeposition.
+     * \param[in,out] rows rows of depos deposited to, see DepositionRows
+     * \param[in] gm Geometry of the simulation, to get the cell size etc.
+     * \param[in] do_update boolean to define if the force terms are updated before the push
+     * \param[in] lev MR level
+     * \return number of particles violating the quasi-static approximation
+     */
+    template <int depos_order_xy>
+    int PushAndDepositTile (PlasmaParticleContainer& plasma, PlasmaParticleIterator& pti,
+                            amrex::GpuArray<amrex::Array4<const amrex::Real>, 6> const& field_arrs,
+                            amrex::GpuArray<amrex::Array4<amrex::Real>, 2> const& depos,
+                            DepositionRows& rows,
+                            amrex::Geometry const& gm, const bool do_update, int const lev)
     {
-        // Extract properties associated with the extent of the current box
+        using namespace amrex::literals;
+
+        amrex::Real const * AMREX_RESTRICT dx = gm.CellSize();
+        const PhysConst phys_const = get_phys_const();
+        const amrex::Real clightsq = 1.0_rt/(phys_const.c*phys_const.c);
+        const amrex::Real psi_factor = phys_const.q_e/(phys_const.m_e*phys_const.c*phys_const.c);
+        const amrex::Real dxi = 1.0_rt/dx[0];
+        const amrex::Real dyi = 1.0_rt/dx[1];
+        const amrex::Real invvol = Hipace::m_normalized_units ? 1._rt : dxi*dyi/dx[2];
+
+        const amrex::Real charge = plasma.m_charge;
+        const amrex::Real mass = plasma.m_mass;
+        const bool can_ionize = plasma.m_can_ionize;
+        const amrex::Real max_qsa_weighting_factor = plasma.m_max_qsa_weighting_factor;
+
+        // Extract properties associated with the extent of the current tile
         // Grow to capture the extent of the particle shape
-        amrex::Box tilebox = pti.tilebox().grow(
-            {Hipace::m_depos_order_xy, Hipace::m_depos_order_xy, 0});
+        amrex::Box tilebox = pti.tilebox().grow({depos_order_xy, depos_order_xy, 0});
 
         amrex::RealBox const grid_box{tilebox, gm.CellSize(), gm.ProbLo()};
         amrex::Real const * AMREX_RESTRICT xyzmin = grid_box.lo();
         amrex::Dim3 const lo = amrex::lbound(tilebox);
-
-        // Extract the fields
-        const amrex::MultiFab& S = fields.getSlices(lev, WhichSlice::This);
-        const amrex::MultiFab exmby(S, amrex::make_alias, Comps[WhichSlice::This]["ExmBy"], 1);
-        const amrex::MultiFab eypbx(S, amrex::make_alias, Comps[WhichSlice::This]["EypBx"], 1);
-        const amrex::MultiFab ez(S, amrex::make_alias, Comps[WhichSlice::This]["Ez"], 1);
-        const amrex::MultiFab bx(S, amrex::make_alias, Comps[WhichSlice::This]["Bx"], 1);
-        const amrex::MultiFab by(S, amrex::make_alias, Comps[WhichSlice::This]["By"], 1);
-        const amrex::MultiFab bz(S, amrex::make_alias, Comps[WhichSlice::This]["Bz"], 1);
-        // Extract FabArray for this box
-        const amrex::FArrayBox& exmby_fab = exmby[pti];
-        const amrex::FArrayBox& eypbx_fab = eypbx[pti];
-        const amrex::FArrayBox& ez_fab = ez[pti];
-        const amrex::FArrayBox& bx_fab = bx[pti];
-        const amrex::FArrayBox& by_fab = by[pti];
-        const amrex::FArrayBox& bz_fab = bz[pti];
-        // Extract field array from FabArray
-        amrex::Array4<const amrex::Real> const& exmby_arr = exmby_fab.array();
-        amrex::Array4<const amrex::Real> const& eypbx_arr = eypbx_fab.array();
-        amrex::Array4<const amrex::Real> const& ez_arr = ez_fab.array();
-        amrex::Array4<const amrex::Real> const& bx_arr = bx_fab.array();
-        amrex::Array4<const amrex::Real> const& by_arr = by_fab.array();
-        amrex::Array4<const amrex::Real> const& bz_arr = bz_fab.array();
-
         const amrex::GpuArray<amrex::Real, 3> dx_arr = {dx[0], dx[1], dx[2]};
         const amrex::GpuArray<amrex::Real, 3> xyzmin_arr = {xyzmin[0], xyzmin[1], xyzmin[2]};
+        const amrex::Real xmin = xyzmin[0];
+        const amrex::Real ymin = xyzmin[1];
+        const amrex::Real zmin = xyzmin[2];
+        const amrex::Real dz = dx[2];
+        // slice is only one cell thick
+        AMREX_ASSERT(pti.tilebox().smallEnd(2) == pti.tilebox().bigEnd(2));
+        const int z_index = pti.tilebox().smallEnd(2);
 
-        auto& soa = pti.GetStructOfArrays(); // For momenta and weights
+        // Fields of this slice, to update the force terms
+        amrex::Array4<const amrex::Real> const& exmby_arr = field_arrs[0];
+        amrex::Array4<const amrex::Real> const& eypbx_arr = field_arrs[1];
+        amrex::Array4<const amrex::Real> const& ez_arr = field_arrs[2];
+        amrex::Array4<const amrex::Real> const& bx_arr = field_arrs[3];
+        amrex::Array4<const amrex::Real> const& by_arr = field_arrs[4];
+        amrex::Array4<const amrex::Real> const& bz_arr = field_arrs[5];
 
-        // loading the data
+        auto& soa = pti.GetStructOfArrays();
+        amrex::Real * const wp = soa.GetRealData(PlasmaIdx::w).data();
         amrex::Real * const uxp = soa.GetRealData(PlasmaIdx::ux).data();
         amrex::Real * const uyp = soa.GetRealData(PlasmaIdx::uy).data();
         amrex::Real * const psip = soa.GetRealData(PlasmaIdx::psi).data();
-
         amrex::Real * const x_prev = soa.GetRealData(PlasmaIdx::x_prev).data();
         amrex::Real * const y_prev = soa.GetRealData(PlasmaIdx::y_prev).data();
-        amrex::Real * const ux_temp = soa.GetRealData(PlasmaIdx::ux_temp).data();
-        amrex::Real * const uy_temp = soa.GetRealData(PlasmaIdx::uy_temp).data();
-        amrex::Real * const psi_temp = soa.GetRealData(PlasmaIdx::psi_temp).data();
-
-        amrex::Real * const Fx1 = soa.GetRealData(PlasmaIdx::Fx1).data();
-        amrex::Real * const Fy1 = soa.GetRealData(PlasmaIdx::Fy1).data();
-        amrex::Real * const Fux1 = soa.GetRealData(PlasmaIdx::Fux1).data();
-        amrex::Real * const Fuy1 = soa.GetRealData(PlasmaIdx::Fuy1).data();
-        amrex::Real * const Fpsi1 = soa.GetRealData(PlasmaIdx::Fpsi1).data();
-        amrex::Real * const Fx2 = soa.GetRealData(PlasmaIdx::Fx2).data();
-        amrex::Real * const Fy2 = soa.GetRealData(PlasmaIdx::Fy2).data();
-        amrex::Real * const Fux2 = soa.GetRealData(PlasmaIdx::Fux2).data();
-        amrex::Real * const Fuy2 = soa.GetRealData(PlasmaIdx::Fuy2).data();
-        amrex::Real * const Fpsi2 = soa.GetRealData(PlasmaIdx::Fpsi2).data();
-        amrex::Real * const Fx3 = soa.GetRealData(PlasmaIdx::Fx3).data();
-        amrex::Real * const Fy3 = soa.GetRealData(PlasmaIdx::Fy3).data();
-        amrex::Real * const Fux3 = soa.GetRealData(PlasmaIdx::Fux3).data();
-        amrex::Real * const Fuy3 = soa.GetRealData(PlasmaIdx::Fuy3).data();
-        amrex::Real * const Fpsi3 = soa.GetRealData(PlasmaIdx::Fpsi3).data();
-        amrex::Real * const Fx4 = soa.GetRealData(PlasmaIdx::Fx4).data();
-        amrex::Real * const Fy4 = soa.GetRealData(PlasmaIdx::Fy4).data();
-        amrex::Real * const Fux4 = soa.GetRealData(PlasmaIdx::Fux4).data();
-        amrex::Real * const Fuy4 = soa.GetRealData(PlasmaIdx::Fuy4).data();
-        amrex::Real * const Fpsi4 = soa.GetRealData(PlasmaIdx::Fpsi4).data();
-        amrex::Real * const Fx5 = soa.GetRealData(PlasmaIdx::Fx5).data();
-        amrex::Real * const Fy5 = soa.GetRealData(PlasmaIdx::Fy5).data();
-        amrex::Real * const Fux5 = soa.GetRealData(PlasmaIdx::Fux5).data();
-        amrex::Real * const Fuy5 = soa.GetRealData(PlasmaIdx::Fuy5).data();
-        amrex::Real * const Fpsi5 = soa.GetRealData(PlasmaIdx::Fpsi5).data();
+        const PlasmaForcePtr ux_temp = GetPlasmaForceData(soa, PlasmaIdx::ux_temp);
+        const PlasmaForcePtr uy_temp = GetPlasmaForceData(soa, PlasmaIdx::uy_temp);
+        const PlasmaForcePtr psi_temp = GetPlasmaForceData(soa, PlasmaIdx::psi_temp);
         int * const ion_lev = soa.GetIntData(PlasmaIdx::ion_lev).data();
 
-        const int depos_order_xy = Hipace::m_depos_order_xy;
-        const amrex::Real clightsq = 1.0_rt/(phys_const.c*phys_const.c);
+        // Force terms sorted by age, 0 is the most recent, see ForceIdx
+        amrex::GpuArray<PlasmaForcePtr, PlasmaParticleContainer::m_nforce_terms> Fx, Fy;
+        amrex::GpuArray<PlasmaForcePtr, PlasmaParticleContainer::m_nforce_terms> Fux, Fuy;
+        amrex::GpuArray<PlasmaForcePtr, PlasmaParticleContainer::m_nforce_terms> Fpsi;
+        for (int iage = 0; iage < PlasmaParticleContainer::m_nforce_terms; ++iage) {
+            Fx[iage] = GetPlasmaForceData(soa, plasma.ForceIdx(PlasmaIdx::Fx1, iage));
+            Fy[iage] = GetPlasmaForceData(soa, plasma.ForceIdx(PlasmaIdx::Fy1, iage));
+            Fux[iage] = GetPlasmaForceData(soa, plasma.ForceIdx(PlasmaIdx::Fux1, iage));
+            Fuy[iage] = GetPlasmaForceData(soa, plasma.ForceIdx(PlasmaIdx::Fuy1, iage));
+            Fpsi[iage] = GetPlasmaForceData(soa, plasma.ForceIdx(PlasmaIdx::Fpsi1, iage));
+        }
 
         using PTileType = PlasmaParticleContainer::ParticleTileType;
         const auto getPosition = GetParticlePosition<PTileType>(pti.GetParticleTile());
         const auto SetPosition = SetParticlePosition<PTileType>(pti.GetParticleTile());
         const auto enforceBC = EnforceBC<PTileType>(pti.GetParticleTile(), lev);
-        const amrex::Real zmin = xyzmin[2];
-        const amrex::Real dz = dx[2];
 
-        const amrex::Real charge = plasma.m_charge;
-        const amrex::Real mass = plasma.m_mass;
-        const bool can_ionize = plasma.m_can_ionize;
-        amrex::ParallelFor(pti.numParticles(),
-            [=] AMREX_GPU_DEVICE (long ip) {
+#ifndef AMREX_USE_GPU
+        // On CPU, the force terms can be updated in a separate pass, with a gather vectorized
+        // over batches of particles. By default, they are updated in the kernel of the push.
+        const bool gather_in_batches = do_update && PlasmaParticleContainer::m_gather_in_batches;
+        if (gather_in_batches) {
+            GatherFieldsInBatches<depos_order_xy>(
+                pti.numParticles(), getPosition,
+                exmby_arr, eypbx_arr, ez_arr, bx_arr, by_arr, bz_arr, dx_arr, xyzmin_arr, lo,
+                [=] (long ip, amrex::ParticleReal ExmByp, amrex::ParticleReal EypBxp,
+                     amrex::ParticleReal Ezp, amrex::ParticleReal Bxp, amrex::ParticleReal Byp,
+                     amrex::ParticleReal Bzp) {
+                    const amrex::Real q = can_ionize ? ion_lev[ip] * charge : charge;
+                    UpdateForceTerms(uxp[ip], uyp[ip], psi_factor*psip[ip], ExmByp, EypBxp,
+                                     Ezp, Bxp, Byp, Bzp, Fx[0][ip], Fy[0][ip], Fux[0][ip],
+                                     Fuy[0][ip], Fpsi[0][ip], clightsq, phys_const, q, mass);
+                });
+        }
+        const bool gather_in_kernel = do_update && !gather_in_batches;
+#else
+        const bool gather_in_kernel = do_update;
+#endif
+
+        amrex::Gpu::DeviceScalar<int> gpu_n_qsa_violation(0);
+        int* p_n_qsa_violation = gpu_n_qsa_violation.dataPtr();
+
+        // Push each particle to the next slice and deposit its current in the same loop
+        DepositParticles<2>(pti.numParticles(), depos, rows,
+            [=] (long ip) {
+                amrex::ParticleReal xp, yp, zp;
+                int pid;
+                getPosition(ip, xp, yp, zp, pid);
+                return lo.y + (yp - ymin)*dyi;
+            },
+            [=] AMREX_GPU_HOST_DEVICE (long ip,
+                amrex::GpuArray<amrex::Array4<amrex::Real>, 2> const& arrs) {
                 amrex::ParticleReal xp, yp, zp;
                 int pid;
                 getPosition(ip, xp, yp, zp, pid);
 
                 if (pid < 0) return;
 
-                // define field at particle position reals
-                amrex::ParticleReal ExmByp = 0._rt, EypBxp = 0._rt, Ezp = 0._rt;
-                amrex::ParticleReal Bxp = 0._rt, Byp = 0._rt, Bzp = 0._rt;
-
-                if (do_shift)
+                if (gather_in_kernel)
                 {
-                    ShiftForceTerms(Fx1[ip], Fy1[ip], Fux1[ip], Fuy1[ip], Fpsi1[ip],
-                                    Fx2[ip], Fy2[ip], Fux2[ip], Fuy2[ip], Fpsi2[ip],
-                                    Fx3[ip], Fy3[ip], Fux3[ip], Fuy3[ip], Fpsi3[ip],
-                                    Fx4[ip], Fy4[ip], Fux4[ip], Fuy4[ip], Fpsi4[ip],
-                                    Fx5[ip], Fy5[ip], Fux5[ip], Fuy5[ip], Fpsi5[ip] );
+                    amrex::ParticleReal ExmByp = 0._rt, EypBxp = 0._rt, Ezp = 0._rt;
+                    amrex::ParticleReal Bxp = 0._rt, Byp = 0._rt, Bzp = 0._rt;
+                    doGatherShapeN<depos_order_xy, 0>(
+                        xp, yp, zmin, ExmByp, EypBxp, Ezp, Bxp, Byp, Bzp,
+                        exmby_arr, eypbx_arr, ez_arr, bx_arr, by_arr, bz_arr,
+                        dx_arr, xyzmin_arr, lo);
+                    const amrex::Real q = can_ionize ? ion_lev[ip] * charge : charge;
+                    UpdateForceTerms(uxp[ip], uyp[ip], psi_factor*psip[ip], ExmByp, EypBxp,
+                                     Ezp, Bxp, Byp, Bzp, Fx[0][ip], Fy[0][ip], Fux[0][ip],
+                                     Fuy[0][ip], Fpsi[0][ip], clightsq, phys_const, q, mass);
                 }
 
-                if (do_update)
+                // push to the next slice, into the temporary data
+                PlasmaParticlePush(xp, yp, zp, uxp[ip], uyp[ip], psip[ip], x_prev[ip],
+                                   y_prev[ip], ux_temp[ip], uy_temp[ip], psi_temp[ip],
+                                   Fx[0][ip], Fy[0][ip], Fux[0][ip], Fuy[0][ip], Fpsi[0][ip],
+                                   Fx[1][ip], Fy[1][ip], Fux[1][ip], Fuy[1][ip], Fpsi[1][ip],
+                                   Fx[2][ip], Fy[2][ip], Fux[2][ip], Fuy[2][ip], Fpsi[2][ip],
+                                   Fx[3][ip], Fy[3][ip], Fux[3][ip], Fuy[3][ip], Fpsi[3][ip],
+                                   Fx[4][ip], Fy[4][ip], Fux[4][ip], Fuy[4][ip], Fpsi[4][ip],
+                                   dz, true, ip, SetPosition, enforceBC );
+
+                // The boundary conditions may have moved or invalidated the particle
+                getPosition(ip, xp, yp, zp, pid);
+                if (pid < 0) return;
+
+                // deposit jx and jy of the next slice
+                const amrex::Real q = can_ionize ? ion_lev[ip] * charge : charge;
+                const bool qsa_ok =
+                    doDepositionOneParticle<depos_order_xy, true, false, false, false>(
+                    xp, yp, ux_temp[ip], uy_temp[ip], psi_factor*psi_temp[ip], wp[ip], q,
+                    xmin, ymin, dxi, dyi, invvol, lo, z_index,
+                    arrs[0], arrs[1], arrs[0], arrs[0], arrs[0], arrs[0], arrs[0],
+                    max_qsa_weighting_factor, clightsq, phys_const.c);
+
+                if (!qsa_ok)
                 {
-                    // field gather for a single particle
-                    doGatherShapeN(xp, yp, zmin,
-                                   ExmByp, EypBxp, Ezp, Bxp, Byp, Bzp,
-                                   exmby_arr, eypbx_arr, ez_arr, bx_arr, by_arr, bz_arr,
-                                   dx_arr, xyzmin_arr, lo, depos_order_xy, 0);
-                    // update force terms for a single particle
-                    const amrex::Real q = can_ionize ? ion_lev[ip] * charge : charge;
-                    const amrex::Real psi_factor = phys_const.q_e/(phys_const.m_e*phys_const.c*phys_const.c);
-                    UpdateForceTerms(uxp[ip], uyp[ip], psi_factor*psip[ip], ExmByp, EypBxp, Ezp,
-                                     Bxp, Byp, Bzp, Fx1[ip], Fy1[ip], Fux1[ip], Fuy1[ip],
-                                     Fpsi1[ip], clightsq, phys_const, q, mass);
+                    // This particle violates the QSA, discard it
+                    amrex::HostDevice::Atomic::Add(p_n_qsa_violation, 1);
+                    wp[ip] = 0.0_rt;
+                    SetPosition(ip, xp, yp, zp, -std::abs(pid));
                 }
+            }
+            );
+        return gpu_n_qsa_violation.dataValue();
+    }
+
+    /** \brief Implementation of PushAndDepositPlasmaParticles for a given deposition order
+     *
+     * \tparam depos_order_xy Order of the transverse shape factor for the deposition
+     * \param[in,out] plasma plasma species to push
+     * \param[in,out] fields the general field class, modified by this function
+     * \param[in] gm Geometry of the simulation, to get the cell size etc.
+     * \param[in] do_update boolean to define if the force terms are updated before the push
+     * \param[in] lev MR level
+     */
+    template <int depos_order_xy>
+    void PushAndDepositPlasmaParticlesImpl (PlasmaParticleContainer& plasma, Fields & fields,
+                                            amrex::Geometry const& gm, const bool do_update,
+                                            int const lev)
+    {
+        const amrex::MultiFab& S_this = fields.getSlices(lev, WhichSlice::This);
+        amrex::MultiFab& S_next = fields.getSlices(lev, WhichSlice::Next);
+        int n_qsa_violation = 0;
+
+        // Loop over the boxes of the slice. All particle tiles of a box deposit into its arrays.
+        for (amrex::MFIter mfi(S_next); mfi.isValid(); ++mfi)
+        {
+            // Fields of this slice, to update the force terms
+            const amrex::FArrayBox& this_fab = S_this[mfi];
+            const amrex::GpuArray<amrex::Array4<const amrex::Real>, 6> field_arrs {
+                this_fab.const_array(Comps[WhichSlice::This]["ExmBy"]),
+                this_fab.const_array(Comps[WhichSlice::This]["EypBx"]),
+                this_fab.const_array(Comps[WhichSlice::This]["Ez"]),
+                this_fab.const_array(Comps[WhichSlice::This]["Bx"]),
+                this_fab.const_array(Comps[WhichSlice::This]["By"]),
+                this_fab.const_array(Comps[WhichSlice::This]["Bz"])};
 
-                if (do_push)
+            // Currents of the next slice, only jx and jy are deposited
+            amrex::FArrayBox& next_fab = S_next[mfi];
+            const amrex::GpuArray<amrex::Array4<amrex::Real>, 2> arrs {
+                next_fab.array(Comps[WhichSlice::Next]["jx"]),
+                next_fab.array(Comps[WhichSlice::Next]["jy"])};
+
+            auto push_and_deposit_tiles =
+                [&] (amrex::GpuArray<amrex::Array4<amrex::Real>, 2> const& depos,
+                     DepositionRows& rows)
+            {
+                // Loop over particle tiles
+                for (PlasmaParticleIterator pti(plasma, lev); pti.isValid(); ++pti)
                 {
-                    // push a single particle
-                    PlasmaParticlePush(xp, yp, zp, uxp[ip], uyp[ip], psip[ip], x_prev[ip],
-                                       y_prev[ip], ux_temp[ip], uy_temp[ip], psi_temp[ip],
-                                       Fx1[ip], Fy1[ip], Fux1[ip], Fuy1[ip], Fpsi1[ip],
-                                       Fx2[ip], Fy2[ip], Fux2[ip], Fuy2[ip], Fpsi2[ip],
-                                       Fx3[ip], Fy3[ip], Fux3[ip], Fuy3[ip], Fpsi3[ip],
-                                       Fx4[ip], Fy4[ip], Fux4[ip], Fuy4[ip], Fpsi4[ip],
-                                       Fx5[ip], Fy5[ip], Fux5[ip], Fuy5[ip], Fpsi5[ip],
-                                       dz, temp_slice, ip, SetPosition, enforceBC );
+                    if (pti.index() != mfi.index()) continue;
+                    const int n_tile = PushAndDepositTile<depos_order_xy>(
+                        plasma, pti, field_arrs, depos, rows, gm, do_update, lev);
+                    amrex::HostDevice::Atomic::Add(&n_qsa_violation, n_tile);
                 }
-                return;
-          }
-          );
-      }
+            };
+
+            // On CPU, the tiles are distributed among the threads, and each thread deposits its
+            // tiles into a private copy of jx and jy
+            ThreadPrivateDeposition<2>(next_fab.box(), arrs, {true, true},
+                                       Hipace::m_depos_order_xy + 1, push_and_deposit_tiles);
+        }
+
+        if (n_qsa_violation > 0 && (Hipace::m_verbose >= 3))
+            amrex::Print()<< "number of QSA violating particles on this slice: "
+                          << n_qsa_violation << "\n";
+    }
+}
+
+void
+PushAndDepositPlasmaParticles (PlasmaParticleContainer& plasma, Fields & fields,
+                               amrex::Geometry const& gm, const bool do_update,
+                               const bool do_shift, int const lev)
+{
+    HIPACE_PROFILE("PushAndDepositPlasmaParticles()");
+
+    AMREX_ALWAYS_ASSERT_WITH_MESSAGE(!do_shift || do_update,
+                                     "the force terms must be updated when they are shifted");
+    if (do_shift) plasma.ShiftForceTerms();
+
+    if        (Hipace::m_depos_order_xy == 0){
+        PushAndDepositPlasmaParticlesImpl<0>(plasma, fields, gm, do_update, lev);
+    } else if (Hipace::m_depos_order_xy == 1){
+        PushAndDepositPlasmaParticlesImpl<1>(plasma, fields, gm, do_update, lev);
+    } else if (Hipace::m_depos_order_xy == 2){
+        PushAndDepositPlasmaParticlesImpl<2>(plasma, fields, gm, do_update, lev);
+    } else if (Hipace::m_depos_order_xy == 3){
+        PushAndDepositPlasmaParticlesImpl<3>(plasma, fields, gm, do_update, lev);
+    } else {
+        amrex::Abort("unknow deposition order");
+    }
 }
 
 void
@@ -175,14 +491,18 @@ ResetPlasmaParticles (PlasmaParticleContainer& plasma, int const lev, const bool
     using namespace amrex::literals;
 
     const int init_ion_lev = plasma.m_init_ion_lev;
+    // All force terms are set to 0 below, so any slot can be the head of the circular buffer
+    if (initial) plasma.m_force_head = 0;
 
-    // Loop over particle boxes
+    // Loop over particle tiles, distributed among the threads with tiling on CPU
+#ifdef AMREX_USE_OMP
+#pragma omp parallel if (PlasmaParticleContainer::TilesOnThreads())
+#endif
     for (PlasmaParticleIterator pti(plasma, lev); pti.isValid(); ++pti)
     {
         if(initial) {
-            // reset size to initial value
-            unsigned long num_initial_particles = plasma.m_init_num_par[pti.tileIndex()];
-            pti.GetParticleTile().resize(num_initial_particles);
+            // reset size to initial value, including the particles removed during the last step
+            plasma.RestoreRemovedParticles(pti.GetParticleTile(), pti.tileIndex());
         }
 
         auto& soa = pti.GetStructOfArrays(); // For momenta and weights
@@ -191,34 +511,8 @@ ResetPlasmaParticles (PlasmaParticleContainer& plasma, int const lev, const bool
         amrex::Real * const psip = soa.GetRealData(PlasmaIdx::psi).data();
         amrex::Real * const x_prev = soa.GetRealData(PlasmaIdx::x_prev).data();
         amrex::Real * const y_prev = soa.GetRealData(PlasmaIdx::y_prev).data();
-        amrex::Real * const ux_temp = soa.GetRealData(PlasmaIdx::ux_temp).data();
-        amrex::Real * const uy_temp = soa.GetRealData(PlasmaIdx::uy_temp).data();
-        amrex::Real * const psi_temp = soa.GetRealData(PlasmaIdx::psi_temp).data();
-        amrex::Real * const Fx1 = soa.GetRealData(PlasmaIdx::Fx1).data();
-        amrex::Real * const Fy1 = soa.GetRealData(PlasmaIdx::Fy1).data();
-        amrex::Real * const Fux1 = soa.GetRealData(PlasmaIdx::Fux1).data();
-        amrex::Real * const Fuy1 = soa.GetRealData(PlasmaIdx::Fuy1).data();
-        amrex::Real * const Fpsi1 = soa.GetRealData(PlasmaIdx::Fpsi1).data();
-        amrex::Real * const Fx2 = soa.GetRealData(PlasmaIdx::Fx2).data();
-        amrex::Real * const Fy2 = soa.GetRealData(PlasmaIdx::Fy2).data();
-        amrex::Real * const Fux2 = soa.GetRealData(PlasmaIdx::Fux2).data();
-        amrex::Real * const Fuy2 = soa.GetRealData(PlasmaIdx::Fuy2).data();
-        amrex::Real * const Fpsi2 = soa.GetRealData(PlasmaIdx::Fpsi2).data();
-        amrex::Real * const Fx3 = soa.GetRealData(PlasmaIdx::Fx3).data();
-        amrex::Real * const Fy3 = soa.GetRealData(PlasmaIdx::Fy3).data();
-        amrex::Real * const Fux3 = soa.GetRealData(PlasmaIdx::Fux3).data();
-        amrex::Real * const Fuy3 = soa.GetRealData(PlasmaIdx::Fuy3).data();
-        amrex::Real * const Fpsi3 = soa.GetRealData(PlasmaIdx::Fpsi3).data();
-        amrex::Real * const Fx4 = soa.GetRealData(PlasmaIdx::Fx4).data();
-        amrex::Real * const Fy4 = soa.GetRealData(PlasmaIdx::Fy4).data();
-        amrex::Real * const Fux4 = soa.GetRealData(PlasmaIdx::Fux4).data();
-        amrex::Real * const Fuy4 = soa.GetRealData(PlasmaIdx::Fuy4).data();
-        amrex::Real * const Fpsi4 = soa.GetRealData(PlasmaIdx::Fpsi4).data();
-        amrex::Real * const Fx5 = soa.GetRealData(PlasmaIdx::Fx5).data();
-        amrex::Real * const Fy5 = soa.GetRealData(PlasmaIdx::Fy5).data();
-        amrex::Real * const Fux5 = soa.GetRealData(PlasmaIdx::Fux5).data();
-        amrex::Real * const Fuy5 = soa.GetRealData(PlasmaIdx::Fuy5).data();
-        amrex::Real * const Fpsi5 = soa.GetRealData(PlasmaIdx::Fpsi5).data();
+        // Temporary momenta and all force terms
+        const auto force_data = GetAllPlasmaForceData(soa);
         amrex::Real * const x0 = soa.GetRealData(PlasmaIdx::x0).data();
         amrex::Real * const y0 = soa.GetRealData(PlasmaIdx::y0).data();
         amrex::Real * const w = soa.GetRealData(PlasmaIdx::w).data();
@@ -246,34 +540,7 @@ ResetPlasmaParticles (PlasmaParticleContainer& plasma, int const lev, const bool
                     psip[ip] = 0._rt;
                     x_prev[ip] = 0._rt;
                     y_prev[ip] = 0._rt;
-                    ux_temp[ip] = 0._rt;
-                    uy_temp[ip] = 0._rt;
-                    psi_temp[ip] = 0._rt;
-                    Fx1[ip] = 0._rt;
-                    Fy1[ip] = 0._rt;
-                    Fux1[ip] = 0._rt;
-                    Fuy1[ip] = 0._rt;
-                    Fpsi1[ip] = 0._rt;
-                    Fx2[ip] = 0._rt;
-                    Fy2[ip] = 0._rt;
-                    Fux2[ip] = 0._rt;
-                    Fuy2[ip] = 0._rt;
-                    Fpsi2[ip] = 0._rt;
-                    Fx3[ip] = 0._rt;
-                    Fy3[ip] = 0._rt;
-                    Fux3[ip] = 0._rt;
-                    Fuy3[ip] = 0._rt;
-                    Fpsi3[ip] = 0._rt;
-                    Fx4[ip] = 0._rt;
-                    Fy4[ip] = 0._rt;
-                    Fux4[ip] = 0._rt;
-                    Fuy4[ip] = 0._rt;
-                    Fpsi4[ip] = 0._rt;
-                    Fx5[ip] = 0._rt;
-                    Fy5[ip] = 0._rt;
-                    Fux5[ip] = 0._rt;
-                    Fuy5[ip] = 0._rt;
-                    Fpsi5[ip] = 0._rt;
+                    for (int i = 0; i < PlasmaNForceAttribs; ++i) force_data[i][ip] = 0._rt;
                     ion_lev[ip] = init_ion_lev;
                 }
         }
@@ -48,15 +48,35 @@ AdaptiveTimeStep::WaitTimeStep (amrex::Real& dt, MPI_Comm a_comm_z)
 }
 #endif
 
+amrex::Real
+AdaptiveTimeStep::BetatronTimeStepCoeff (const amrex::Real plasma_density,
+                                         const amrex::Real external_ExmBy_slope) const
+{
+    using namespace amrex::literals;
+    const PhysConst phys_const = get_phys_const();
+    // Gradient of the transverse force per unit charge: ion channel plus external field
+    const amrex::Real focusing_gradient = std::max(plasma_density, 0._rt) * phys_const.q_e
+        / (2._rt * phys_const.ep0) + std::abs(external_ExmBy_slope);
+    if (focusing_gradient <= 0.) return 0.;
+    // The betatron frequency of a particle with Lorentz factor gamma is
+    // sqrt(q_e*focusing_gradient/(gamma*m_e))
+    const amrex::Real omega_gradient = std::sqrt(phys_const.q_e * focusing_gradient
+                                                 / phys_const.m_e);
+    return m_nt_per_omega_betatron/omega_gradient;
+}
+
 void
 AdaptiveTimeStep::Calculate (amrex::Real& dt, MultiBeam& beams, amrex::Real plasma_density,
-                             const int it, const amrex::Vector<BoxSorter>& a_box_sorter_vec,
+                             const amrex::Real dz, const int it,
+                             const amrex::Vector<BoxSorter>& a_box_sorter_vec,
                              const bool initial)
 {
     HIPACE_PROFILE("AdaptiveTimeStep::Calculate()");
 
     if (m_do_adaptive_time_step == 0) return;
     if (!Hipace::HeadRank() && initial) return;
+    // Beams generated per box have no particles yet, the initial time step is kept
+    if (initial && beams.AnyLazyGeneration()) return;
     AMREX_ALWAYS_ASSERT_WITH_MESSAGE( plasma_density != 0.,
         "A >0 plasma density must be specified to use an adaptive time step.");
 
@@ -151,6 +171,19 @@ AdaptiveTimeStep::Calculate (amrex::Real& dt, MultiBeam& beams, amrex::Real plas
             const amrex::Real omega_p = std::sqrt(plasma_density * phys_const.q_e*phys_const.q_e
                                           / ( phys_const.ep0*phys_const.m_e ));
             new_dt = sqrt(2.*chosen_min_uz)/omega_p * m_nt_per_omega_betatron;
+            // Particles with a shorter betatron period are sub-cycled in the beam push, so the
+            // time step is only limited by the bulk of the beam
+            const int max_substeps = beams.MaxSubsteps();
+            if (max_substeps > 1) {
+                new_dt = std::min(sqrt(2.*mean_uz), max_substeps*sqrt(2.*chosen_min_uz))
+                    /omega_p * m_nt_per_omega_betatron;
+                // All sub-steps gather the fields of the slice of the particle at the beginning
+                // of the step, so a particle must not slip by more than one cell during a step:
+                // dt*|v_z - c| <= dz, with c - v_z = c/(gamma*(gamma + u_z)) for u_z = gamma*beta_z
+                const amrex::Real gamma_min = std::sqrt(1. + chosen_min_uz*chosen_min_uz);
+                new_dt = std::min(new_dt,
+                                  dz*gamma_min*(gamma_min + chosen_min_uz)/phys_const.c);
+            }
         }
 
         /* set the new time step */
@@ -39,9 +39,6 @@ GridCurrent::DepositCurrentSlice (Fields& fields, const amrex::Geometry& geom, i
     amrex::MultiFab& S = fields.getSlices(lev, WhichSlice::This);
     amrex::MultiFab jz(S, amrex::make_alias, Comps[WhichSlice::This]["jz_beam"], 1);
 
-    // Extract FabArray for this box
-    amrex::FArrayBox& jz_fab = jz[0];
-
     const amrex::Real z = plo[2] + islice*dx_arr[2];
     const amrex::Real delta_z = (z - pos_mean[2]) / pos_std[2];
     const amrex::Real long_pos_factor =  std::exp( -0.5_rt*(delta_z*delta_z) );
@@ -49,7 +46,7 @@ GridCurrent::DepositCurrentSlice (Fields& fields, const amrex::Geometry& geom, i
 
     for ( amrex::MFIter mfi(S, amrex::TilingIfNotGPU()); mfi.isValid(); ++mfi ){
         const amrex::Box& bx = mfi.tilebox();
-        amrex::Array4<amrex::Real> const& jz_arr = jz_fab.array();
+        amrex::Array4<amrex::Real> const& jz_arr = jz.array(mfi);
 
         amrex::ParallelFor( bx,
         [=] AMREX_GPU_DEVICE(int i, int j, int k)
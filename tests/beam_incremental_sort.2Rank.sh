@@ -0,0 +1,32 @@
+#! /usr/bin/env bash
+
+# This file is part of the Hipace++ test suite.
+# It runs a Hipace simulation with slow beams, which slip across boxes and ranks, with the full
+# sort of the beam particles by box in serial and with the incremental sort in parallel, and
+# checks that they give the same result up to round-off errors. The transverse field is also
+# checked with analysis_transverse.py.
+
+# abort on first encounted error
+set -eu -o pipefail
+
+# Read input parameters
+HIPACE_EXECUTABLE=$1
+HIPACE_SOURCE_DIR=$2
+
+HIPACE_EXAMPLE_DIR=${HIPACE_SOURCE_DIR}/examples/beam_in_vacuum
+HIPACE_TEST_DIR=${HIPACE_SOURCE_DIR}/tests
+
+FILE_NAME=`basename "$0"`
+TEST_NAME="${FILE_NAME%.*}"
+
+$HIPACE_TEST_DIR/compare_runs.sh --np-ref 1 --rtol 1.e-5 --species "beam beam2" \
+    --fields "Ez Bx By jz" \
+    $HIPACE_EXECUTABLE $HIPACE_SOURCE_DIR $HIPACE_EXAMPLE_DIR/inputs_normalized_transverse \
+    $TEST_NAME \
+    -- beams.incremental_sort = 0 \
+    -- beams.incremental_sort = 1
+
+# Compare the serial and parallel transverse fields
+$HIPACE_EXAMPLE_DIR/analysis_transverse.py \
+    --serial REF_$TEST_NAME \
+    --parallel $TEST_NAME
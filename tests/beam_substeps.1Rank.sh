@@ -0,0 +1,67 @@
+#! /usr/bin/env bash
+
+# This file is part of the Hipace++ test suite.
+# It runs Hipace simulations of a beam in a linear focusing field, with time steps 10 times
+# longer than in beam_evolution.1Rank, and sub-cycles the beam push so that each sub-step
+# resolves the betatron period. The focusing field is first an external field without plasma, then
+# the field of an ion column, made of a heavy plasma species. The beam width is compared with
+# theory in both cases.
+
+# abort on first encounted error
+set -eu -o pipefail
+
+# Read input parameters
+HIPACE_EXECUTABLE=$1
+HIPACE_SOURCE_DIR=$2
+
+HIPACE_EXAMPLE_DIR=${HIPACE_SOURCE_DIR}/examples/beam_in_vacuum
+HIPACE_TEST_DIR=${HIPACE_SOURCE_DIR}/tests
+
+FILE_NAME=`basename "$0"`
+TEST_NAME="${FILE_NAME%.*}"
+
+rm -rf ${TEST_NAME}_external ${TEST_NAME}_plasma
+
+# The number of sub-steps is set by the focusing gradient, .5 in both cases. With the default
+# hipace.nt_per_omega_betatron, each step of 30 is split into 10 sub-steps of 3, the time step of
+# beam_evolution.1Rank.
+COMMON_ARGS=(
+    max_step = 2
+    hipace.dt = 30.
+    hipace.output_period = 2
+    beam.max_substeps = 20
+    beam.density = 1.e-8
+    beam.radius = 1.
+    beam.ppc = 4 4 1
+)
+
+# External focusing field, no plasma
+mpiexec -n 1 $HIPACE_EXECUTABLE $HIPACE_EXAMPLE_DIR/inputs_normalized \
+        "${COMMON_ARGS[@]}" \
+        amr.n_cell = 32 32 10 \
+        geometry.prob_lo = -2. -2. -2. \
+        geometry.prob_hi =  2.  2.  2. \
+        hipace.external_ExmBy_slope = .5 \
+        hipace.file_prefix = ${TEST_NAME}_external
+
+$HIPACE_EXAMPLE_DIR/analysis_beam_push.py --output-dir=${TEST_NAME}_external
+
+# Ion column of density 1 and radius 2, which gives the same focusing field inside the column.
+# The ions are immobile, and the open boundary solver removes the image charges of the
+# domain boundaries.
+mpiexec -n 1 $HIPACE_EXECUTABLE $HIPACE_EXAMPLE_DIR/inputs_normalized \
+        "${COMMON_ARGS[@]}" \
+        amr.n_cell = 64 64 10 \
+        geometry.prob_lo = -4. -4. -2. \
+        geometry.prob_hi =  4.  4.  2. \
+        fields.do_open_boundary_poisson = 1 \
+        plasmas.names = ions \
+        ions.density = 1. \
+        ions.radius = 2. \
+        ions.ppc = 2 2 \
+        ions.charge = 1. \
+        ions.mass = 1.e10 \
+        ions.neutralize_background = 0 \
+        hipace.file_prefix = ${TEST_NAME}_plasma
+
+$HIPACE_EXAMPLE_DIR/analysis_beam_push.py --output-dir=${TEST_NAME}_plasma
@@ -0,0 +1,34 @@
+#! /usr/bin/env bash
+
+# This file is part of the Hipace++ test suite.
+# It runs the normalized blowout_wake.2Rank test with a HiPACE_MIXED_PRECISION build,
+# and compares the result with the benchmark of the default build, with a relaxed
+# tolerance.
+
+# abort on first encounted error
+set -eu -o pipefail
+
+# Read input parameters
+HIPACE_EXECUTABLE=$1
+HIPACE_SOURCE_DIR=$2
+
+HIPACE_EXAMPLE_DIR=${HIPACE_SOURCE_DIR}/examples/blowout_wake
+HIPACE_TEST_DIR=${HIPACE_SOURCE_DIR}/tests
+
+FILE_NAME=`basename "$0"`
+TEST_NAME="${FILE_NAME%.*}"
+
+rm -rf $TEST_NAME
+# Run the simulation
+mpiexec -n 2 $HIPACE_EXECUTABLE $HIPACE_EXAMPLE_DIR/inputs_normalized \
+        hipace.file_prefix=$TEST_NAME/ \
+        max_step=1
+
+# Compare the results with the checksum benchmark of the default build. The force terms of
+# the plasma particles are stored in single precision, see docs/source/building/building.rst
+$HIPACE_TEST_DIR/checksum/checksumAPI.py \
+    --evaluate \
+    --file_name $TEST_NAME/ \
+    --test-name blowout_wake.2Rank \
+    --skip "{'beam': 'id'}" \
+    --rtol 1.e-4
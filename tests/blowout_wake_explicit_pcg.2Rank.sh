@@ -0,0 +1,32 @@
+#! /usr/bin/env bash
+
+# This file is part of the Hipace++ test suite.
+# It runs a Hipace simulation in normalized units with the explicit solver in the blowout
+# regime, with the multigrid and with the PCG solver for Bx and By, and checks that they give
+# the same result within the tolerance of the solvers.
+
+# abort on first encounted error
+set -eu -o pipefail
+
+# Read input parameters
+HIPACE_EXECUTABLE=$1
+HIPACE_SOURCE_DIR=$2
+
+HIPACE_EXAMPLE_DIR=${HIPACE_SOURCE_DIR}/examples/blowout_wake
+HIPACE_TEST_DIR=${HIPACE_SOURCE_DIR}/tests
+
+FILE_NAME=`basename "$0"`
+TEST_NAME="${FILE_NAME%.*}"
+
+# Both solvers discretize the equation in the same way and stop at the same residual, so they
+# must agree to about the solver tolerance. The error accumulates over the slices through the
+# plasma particles, hence the factor 100 in the comparison.
+$HIPACE_TEST_DIR/compare_runs.sh --rtol 1.e-6 --species beam \
+    $HIPACE_EXECUTABLE $HIPACE_SOURCE_DIR $HIPACE_EXAMPLE_DIR/inputs_normalized $TEST_NAME \
+    hipace.bxby_solver=explicit \
+    hipace.MG_tolerance_rel=1.e-8 \
+    max_step=1 \
+    -- \
+    hipace.explicit_linear_solver=mlmg \
+    -- \
+    hipace.explicit_linear_solver=pcg
@@ -0,0 +1,49 @@
+#! /usr/bin/env bash
+
+# This file is part of the Hipace++ test suite.
+# It runs a Hipace simulation in normalized units in the blowout regime, in a narrow box where
+# plasma particles are lost through the transverse boundaries, with and without removing the
+# invalid particles, and checks that they give the same result up to round-off errors.
+# The blowout wake of the blowout_wake.2Rank test is also run with compaction, and compared
+# with its checksum benchmark.
+
+# abort on first encounted error
+set -eu -o pipefail
+
+# Read input parameters
+HIPACE_EXECUTABLE=$1
+HIPACE_SOURCE_DIR=$2
+
+HIPACE_EXAMPLE_DIR=${HIPACE_SOURCE_DIR}/examples/blowout_wake
+HIPACE_TEST_DIR=${HIPACE_SOURCE_DIR}/tests
+
+FILE_NAME=`basename "$0"`
+TEST_NAME="${FILE_NAME%.*}"
+
+$HIPACE_TEST_DIR/compare_runs.sh --rtol 1.e-5 --species beam \
+    $HIPACE_EXECUTABLE $HIPACE_SOURCE_DIR $HIPACE_EXAMPLE_DIR/inputs_normalized $TEST_NAME \
+    amr.n_cell = 32 32 100 \
+    geometry.is_periodic = 0 0 0 \
+    geometry.prob_lo = -4. -4. -6. \
+    geometry.prob_hi =  4.  4.  6. \
+    max_step=2 \
+    -- \
+    -- plasmas.compaction_interval = 5 \
+       beams.compaction_interval = 1 \
+       hipace.verbose = 3
+
+rm -rf ${TEST_NAME}_blowout
+
+mpiexec -n 2 $HIPACE_EXECUTABLE $HIPACE_EXAMPLE_DIR/inputs_normalized \
+        plasmas.compaction_interval = 5 \
+        beams.compaction_interval = 1 \
+        hipace.file_prefix=${TEST_NAME}_blowout \
+        max_step=1
+
+# Compare the results with checksum benchmark
+$HIPACE_TEST_DIR/checksum/checksumAPI.py \
+    --evaluate \
+    --file_name ${TEST_NAME}_blowout \
+    --test-name blowout_wake.2Rank \
+    --skip "{'beam': 'id'}" \
+    --rtol 1.e-5
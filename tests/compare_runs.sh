@@ -0,0 +1,72 @@
+#! /usr/bin/env bash
+
+# This file is part of the Hipace++ test suite.
+# It runs a reference simulation and a simulation to compare, from the same input file, and checks
+# with analysis_compare.py that both give the same fields and beam particles up to a tolerance.
+# It is called by the tests, e.g. to compare a run with and without an optimization, or on a
+# different number of ranks.
+#
+# Usage: compare_runs.sh [options] <executable> <source dir> <inputs> <name> \
+#            [common arguments] -- [reference arguments] -- [arguments]
+# Options:
+#   --np-ref <n>     number of ranks of the reference run (default 2)
+#   --np <n>         number of ranks of the compared run (default 2)
+#   --rtol <r>       tolerance on the error, relative to the maximum of the reference (default 0)
+#   --species "<s>"  beam species to compare (default none)
+#   --fields "<f>"   fields to compare (default: those of analysis_compare.py)
+# The reference run writes to REF_<name>, the compared run to <name>.
+
+# abort on first encounted error
+set -eu -o pipefail
+
+NP_REF=2
+NP=2
+RTOL=0.
+SPECIES=""
+FIELDS=""
+while [[ $# -gt 0 && $1 == --* ]]; do
+    case $1 in
+        --np-ref) NP_REF=$2 ;;
+        --np) NP=$2 ;;
+        --rtol) RTOL=$2 ;;
+        --species) SPECIES=$2 ;;
+        --fields) FIELDS=$2 ;;
+        *) echo "compare_runs.sh: unknown option $1"; exit 1 ;;
+    esac
+    shift 2
+done
+
+HIPACE_EXECUTABLE=$1
+HIPACE_SOURCE_DIR=$2
+INPUTS=$3
+NAME=$4
+shift 4
+
+# Split the remaining arguments at --
+COMMON_ARGS=()
+REF_ARGS=()
+while [[ $# -gt 0 && $1 != "--" ]]; do COMMON_ARGS+=("$1"); shift; done
+if [[ $# -gt 0 ]]; then shift; fi
+while [[ $# -gt 0 && $1 != "--" ]]; do REF_ARGS+=("$1"); shift; done
+if [[ $# -gt 0 ]]; then shift; fi
+
+rm -rf REF_$NAME $NAME
+
+mpiexec -n $NP_REF $HIPACE_EXECUTABLE $INPUTS \
+        ${COMMON_ARGS[@]+"${COMMON_ARGS[@]}"} \
+        ${REF_ARGS[@]+"${REF_ARGS[@]}"} \
+        hipace.file_prefix=REF_$NAME
+
+mpiexec -n $NP $HIPACE_EXECUTABLE $INPUTS \
+        ${COMMON_ARGS[@]+"${COMMON_ARGS[@]}"} \
+        "$@" \
+        hipace.file_prefix=$NAME
+
+COMPARE_ARGS=(--species $SPECIES)
+if [[ -n $FIELDS ]]; then COMPARE_ARGS+=(--fields $FIELDS); fi
+
+$HIPACE_SOURCE_DIR/examples/blowout_wake/analysis_compare.py \
+    --ref-dir=REF_$NAME \
+    --output-dir=$NAME \
+    --rtol=$RTOL \
+    "${COMPARE_ARGS[@]}"
@@ -0,0 +1,28 @@
+#! /usr/bin/env bash
+
+# This file is part of the Hipace++ test suite.
+# It runs a Hipace simulation for a can beam in vacuum with the Dirichlet Poisson solver,
+# on a grid whose size is not a power of two, and compares the fields with theory.
+
+# abort on first encounted error
+set -eu -o pipefail
+
+# Read input parameters
+HIPACE_EXECUTABLE=$1
+HIPACE_SOURCE_DIR=$2
+
+HIPACE_EXAMPLE_DIR=${HIPACE_SOURCE_DIR}/examples/beam_in_vacuum
+HIPACE_TEST_DIR=${HIPACE_SOURCE_DIR}/tests
+
+FILE_NAME=`basename "$0"`
+TEST_NAME="${FILE_NAME%.*}"
+
+rm -rf $TEST_NAME
+
+mpiexec -n 1 $HIPACE_EXECUTABLE $HIPACE_EXAMPLE_DIR/inputs_normalized \
+        amr.n_cell = 520 780 4 \
+        fields.do_dirichlet_poisson = 1 \
+        hipace.depos_order_xy=0 \
+        hipace.file_prefix=$TEST_NAME
+
+$HIPACE_EXAMPLE_DIR/analysis.py --normalized-units --output-dir=$TEST_NAME
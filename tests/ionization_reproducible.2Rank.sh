@@ -0,0 +1,33 @@
+#! /usr/bin/env bash
+
+# This file is part of the Hipace++ test suite.
+# It runs the same Hipace simulation with field ionization twice, and checks that the results
+# are identical, i.e. that the placement of the new electrons does not depend on the
+# scheduling of the threads. The result is also compared with the checksum benchmark of the
+# ionization.2Rank test, which runs the same simulation.
+
+# abort on first encounted error
+set -eu -o pipefail
+
+# Read input parameters
+HIPACE_EXECUTABLE=$1
+HIPACE_SOURCE_DIR=$2
+
+HIPACE_EXAMPLE_DIR=${HIPACE_SOURCE_DIR}/examples/blowout_wake
+HIPACE_TEST_DIR=${HIPACE_SOURCE_DIR}/tests
+
+FILE_NAME=`basename "$0"`
+TEST_NAME="${FILE_NAME%.*}"
+
+$HIPACE_TEST_DIR/compare_runs.sh --species beam --fields "ExmBy EypBx Ez Bx By Bz jz rho" \
+    $HIPACE_EXECUTABLE $HIPACE_SOURCE_DIR $HIPACE_EXAMPLE_DIR/inputs_ionization_SI $TEST_NAME \
+    hipace.dt = 1e-12 \
+    hipace.output_period = 2 \
+    max_step=2
+
+# Compare the results with checksum benchmark
+$HIPACE_TEST_DIR/checksum/checksumAPI.py \
+    --evaluate \
+    --file_name $TEST_NAME \
+    --test-name ionization.2Rank \
+    --skip "{'beam': 'id'}"
@@ -0,0 +1,35 @@
+#! /usr/bin/env bash
+
+# This file is part of the Hipace++ test suite.
+# It runs Hipace simulations with beams generated per box, for a fixed_ppc beam in the blowout
+# regime and for a fixed_weight beam in vacuum, on 1 and 2 ranks, and checks that they give
+# the same result. The fixed_weight beam is also compared with its input parameters.
+
+# abort on first encounted error
+set -eu -o pipefail
+
+# Read input parameters
+HIPACE_EXECUTABLE=$1
+HIPACE_SOURCE_DIR=$2
+
+HIPACE_EXAMPLE_DIR=${HIPACE_SOURCE_DIR}/examples
+HIPACE_TEST_DIR=${HIPACE_SOURCE_DIR}/tests
+
+FILE_NAME=`basename "$0"`
+TEST_NAME="${FILE_NAME%.*}"
+
+# fixed_ppc beam
+$HIPACE_TEST_DIR/compare_runs.sh --np-ref 1 --rtol 1.e-5 --species beam \
+    $HIPACE_EXECUTABLE $HIPACE_SOURCE_DIR $HIPACE_EXAMPLE_DIR/blowout_wake/inputs_normalized \
+    ${TEST_NAME}_ppc \
+    beam.lazy_generation = 1 \
+    max_step=2
+
+# fixed_weight beam
+$HIPACE_TEST_DIR/compare_runs.sh --np-ref 1 --rtol 1.e-5 --species beam \
+    $HIPACE_EXECUTABLE $HIPACE_SOURCE_DIR $HIPACE_EXAMPLE_DIR/gaussian_weight/inputs_normalized \
+    ${TEST_NAME}_weight \
+    beam.lazy_generation = 1 \
+    max_step=1
+
+$HIPACE_EXAMPLE_DIR/gaussian_weight/analysis.py --normalized-units --output-dir=${TEST_NAME}_weight
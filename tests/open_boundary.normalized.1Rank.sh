@@ -0,0 +1,32 @@
+#! /usr/bin/env bash
+
+# This file is part of the Hipace++ test suite.
+# It runs a Hipace simulation for a can beam in vacuum with the open boundary Poisson solver,
+# in a box 8 times narrower than in inputs_normalized, and compares the fields with theory.
+
+# abort on first encounted error
+set -eu -o pipefail
+
+# Read input parameters
+HIPACE_EXECUTABLE=$1
+HIPACE_SOURCE_DIR=$2
+
+HIPACE_EXAMPLE_DIR=${HIPACE_SOURCE_DIR}/examples/beam_in_vacuum
+HIPACE_TEST_DIR=${HIPACE_SOURCE_DIR}/tests
+
+FILE_NAME=`basename "$0"`
+TEST_NAME="${FILE_NAME%.*}"
+
+rm -rf $TEST_NAME
+
+# Same resolution as inputs_normalized. With Dirichlet boundaries, the image charges would
+# perturb the fields in this box.
+mpiexec -n 1 $HIPACE_EXECUTABLE $HIPACE_EXAMPLE_DIR/inputs_normalized \
+        amr.n_cell = 64 96 4 \
+        geometry.prob_lo = -25. -25. -2. \
+        geometry.prob_hi =  25.  25.  2. \
+        fields.do_open_boundary_poisson = 1 \
+        hipace.depos_order_xy=0 \
+        hipace.file_prefix=$TEST_NAME
+
+$HIPACE_EXAMPLE_DIR/analysis.py --normalized-units --output-dir=$TEST_NAME
@@ -0,0 +1,37 @@
+#! /usr/bin/env bash
+
+# This file is part of the Hipace++ test suite.
+# It runs a Hipace simulation in normalized units in the blowout regime, with and without
+# sorting the plasma particles by cell, and checks that they give the same result up to
+# round-off errors. The sorted run is also compared with the checksum benchmark of the
+# blowout_wake.2Rank test, which runs the same simulation without sorting.
+
+# abort on first encounted error
+set -eu -o pipefail
+
+# Read input parameters
+HIPACE_EXECUTABLE=$1
+HIPACE_SOURCE_DIR=$2
+
+HIPACE_EXAMPLE_DIR=${HIPACE_SOURCE_DIR}/examples/blowout_wake
+HIPACE_TEST_DIR=${HIPACE_SOURCE_DIR}/tests
+
+FILE_NAME=`basename "$0"`
+TEST_NAME="${FILE_NAME%.*}"
+
+# Sort periodically, and in between when the particles are disordered
+$HIPACE_TEST_DIR/compare_runs.sh --rtol 1.e-5 --species beam \
+    $HIPACE_EXECUTABLE $HIPACE_SOURCE_DIR $HIPACE_EXAMPLE_DIR/inputs_normalized $TEST_NAME \
+    max_step=1 \
+    -- \
+    -- plasmas.sort_interval=10 \
+       plasmas.sort_disorder_threshold=0.2 \
+       plasmas.sort_disorder_check_interval=2
+
+# Compare the results with checksum benchmark
+$HIPACE_TEST_DIR/checksum/checksumAPI.py \
+    --evaluate \
+    --file_name $TEST_NAME \
+    --test-name blowout_wake.2Rank \
+    --skip "{'beam': 'id'}" \
+    --rtol 1.e-5
@@ -0,0 +1,55 @@
+#! /usr/bin/env bash
+
+# This file is part of the Hipace++ test suite.
+# It runs a Hipace simulation of a grid current in vacuum with the slice distributed over 2 ranks
+# in x or in y, and checks that it gives the same fields as on 1 rank, for the Dirichlet and the
+# periodic Poisson solvers, with and without the spectral gradient.
+
+# abort on first encounted error
+set -eu -o pipefail
+
+# Read input parameters
+HIPACE_EXECUTABLE=$1
+HIPACE_SOURCE_DIR=$2
+
+HIPACE_EXAMPLE_DIR=${HIPACE_SOURCE_DIR}/examples/beam_in_vacuum
+HIPACE_TEST_DIR=${HIPACE_SOURCE_DIR}/tests
+
+FILE_NAME=`basename "$0"`
+TEST_NAME="${FILE_NAME%.*}"
+
+# Grid current only: particles are not distributed over the transverse boxes
+COMMON_ARGS=(
+    amr.n_cell = 64 64 8
+    max_step = 0
+    geometry.prob_lo = -8. -8. -6.
+    geometry.prob_hi =  8.  8.  6.
+    beams.names = no_beam
+    grid_current.use_grid_current = 1
+    grid_current.peak_current_density = 0.2
+    grid_current.position_mean = 0.5 -0.3 0.
+    grid_current.position_std = 1. 1.5 2.
+    hipace.MG_tolerance_rel = 1.e-8
+)
+
+for SOLVER in dirichlet periodic; do
+    if [[ $SOLVER == dirichlet ]]; then DIRICHLET=1; else DIRICHLET=0; fi
+    for GRADIENT in 0 1; do
+        for DECOMPOSITION in "2 1" "1 2"; do
+            read NX NY <<< "$DECOMPOSITION"
+            $HIPACE_TEST_DIR/compare_runs.sh \
+                --np-ref 1 --np 2 --rtol 1.e-6 \
+                $HIPACE_EXECUTABLE $HIPACE_SOURCE_DIR $HIPACE_EXAMPLE_DIR/inputs_normalized \
+                ${TEST_NAME}_${SOLVER}_${GRADIENT}_${NX}${NY} \
+                "${COMMON_ARGS[@]}" \
+                fields.do_dirichlet_poisson = $DIRICHLET \
+                fields.spectral_gradient = $GRADIENT \
+                -- \
+                hipace.numprocs_x = 1 \
+                hipace.numprocs_y = 1 \
+                -- \
+                hipace.numprocs_x = $NX \
+                hipace.numprocs_y = $NY
+        done
+    done
+done